@@ -1,5 +1,6 @@
 #!/bin/bash
 
 make
+make e502convert
 fakeroot dpkg-deb --build deb-bundle
 mv deb-bundle.deb deb-pkg/e502monitor_0.8-1_amd64.deb
@@ -0,0 +1,1862 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "acquisition.c" contains realization of data
+    collection from one module.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "acquisition.h"
+#include "device.h"
+#include "files.h"
+#include "logging.h"
+#include "stats.h"
+#include "common.h"
+#include "realtime.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+    Function for running in receiving thread.
+    Reads blocks from module and passes them to queue.
+*/
+static void* receive_data(void* arg);
+
+/*
+    Function for running in writing thread.
+    Writes data on disk.
+*/
+static void* write_data(void* arg);
+
+/*
+    Function for running in backlog thread.
+    Writes blocks which don't fit in queue in backlog
+    file and moves them back to queue.
+*/
+static void* spill_data(void* arg);
+
+/*
+    Function for running in thread of measurement of
+    latency. Thread has priority and cores of receiving
+    thread, so its lateness is lateness of receiving
+    thread, but receiving thread doesn't sleep for it.
+*/
+static void* probe_latency(void* arg);
+
+/*
+    Writes complete frames from buffers of routing
+    plan in output files or passes them to writing
+    threads.
+
+    acq             - acquisition
+    real_file_sizes - counts of frames in each file
+    min_frames      - frames are written only if file
+                      has at least min_frames frames
+*/
+static void write_frames(acquisition* acq, long long* real_file_sizes, int min_frames);
+
+/*
+    Writes part of raw words of block in raw
+    file (raw capture mode).
+
+    acq       - acquisition
+    block     - received block
+    offset    - index of first word of part
+    size      - count of words in part
+    first_lch - logical channel of first word of part
+    gap       - lost data before part (NULL - none)
+*/
+static void write_raw_data(acquisition* acq,
+                           data_block* block,
+                           int offset,
+                           int size,
+                           int first_lch,
+                           gap_info* gap);
+
+/*
+    Demultiplexes part of converted samples of
+    block and writes complete frames.
+
+    acq             - acquisition
+    block           - received block
+    offset          - index of first sample of part
+    size            - count of samples in part
+    first_lch       - logical channel of first sample of part
+    real_file_sizes - counts of frames in each file
+*/
+static void write_samples(acquisition* acq,
+                          data_block* block,
+                          int offset,
+                          int size,
+                          int first_lch,
+                          long long* real_file_sizes);
+
+/*
+    Logs lost data, counts it in statistics and adds
+    it to gaps of current files and of pre-roll ring.
+
+    acq               - acquisition
+    gap               - lost data, position and length in samples of stream
+    gaps              - lost data in current files
+    gaps_count        - count of gaps
+    file_first_sample - index of first sample of current files
+    next_boundary     - index of first sample of next segment
+*/
+static void record_gap(acquisition* acq,
+                       gap_info* gap,
+                       gap_info* gaps,
+                       int* gaps_count,
+                       long long file_first_sample,
+                       long long next_boundary);
+
+/*
+    Finishes files of current segment and starts
+    next segment. Segment ends exactly after
+    file_size seconds of samples.
+
+    acq             - acquisition
+    real_file_sizes - counts of frames in each file
+    gaps            - lost data in current files
+    gaps_count      - count of gaps
+    start_us        - wall time of first sample of segment
+    finish_us       - wall time of end of segment
+
+    Returns error index. On error files of next segment
+    weren't opened and current files are continued.
+*/
+static int finish_segment(acquisition* acq,
+                           long long* real_file_sizes,
+                           gap_info* gaps,
+                           int gaps_count,
+                           long long start_us,
+                           long long finish_us);
+
+/*
+    Adds time of return from X502_Recv of block to
+    clock model of module and updates statistics of clock.
+*/
+static void observe_block_time(acquisition* acq, data_block* block, int size);
+
+/*
+    Returns wall time of sample by clock model.
+
+    acq   - acquisition
+    index - index of sample (samples of all channels)
+*/
+static long long sample_wall_us(acquisition* acq, long long index);
+
+/*
+    Measures offset of wall time for next segment.
+    Large steps of system clock are logged.
+*/
+static void refresh_wall_offset(acquisition* acq);
+
+/*
+    Returns index of first sample of next segment.
+    Segments are file_size seconds of clock of module
+    counted from first sample of recording, boundary
+    is rounded to whole frame.
+
+    acq          - acquisition
+    index        - index of sample inside current segment
+    first_sample - index of first sample of recording
+*/
+static long long next_segment_boundary(acquisition* acq, long long index, long long first_sample);
+
+/*
+    Fills quality of clock model for properties of files.
+*/
+static void get_clock_quality(acquisition* acq, clock_quality* clock);
+
+/*
+    Copies samples of block in pre-roll ring and passes
+    requested snapshot to its thread.
+*/
+static void update_preroll(acquisition* acq, data_block* block, int size);
+
+/*
+    Fills start and finish time fields of header.
+
+    hdr       - header
+    start_us  - start time (us from epoch)
+    finish_us - finish time (us from epoch)
+*/
+static void set_header_time(header* hdr, long long start_us, long long finish_us);
+
+/*
+    Returns block for next reading from module.
+    If pool is exhausted applies overflow policy
+    from configuration.
+*/
+static data_block* take_block_for_receiving(acquisition* acq);
+
+/*
+    Returns received block in its pool.
+*/
+static void release_received_block(acquisition* acq, data_block* block);
+
+/*
+    Passes received block to writing thread
+    through queue or backlog thread.
+*/
+static void deliver_block(acquisition* acq, data_block* block, int size, int first_lch);
+
+/*
+    Checks continuity of received words and passes
+    them to queue. At each break of stream block is
+    split, so every passed block has consecutive
+    samples and lost samples make gap of indexes.
+
+    acq          - acquisition
+    block        - received block, its sample_index is
+                   index of first word
+    size         - count of received words
+    prev_end_us  - monotonic time of end of previous block
+                   (-1 - there was no previous block)
+*/
+static void deliver_received(acquisition* acq, data_block* block, int size, long long prev_end_us);
+
+/*
+    Reads raw words from module in block.
+
+    Returns result of X502_Recv.
+*/
+static int32_t receive_block(acquisition* acq, data_block* block, int size, int timeout);
+
+/*
+    Closes module after error of receiving, opens it
+    again, applies configuration and restarts streams.
+    Module is searched by serial number. Attempts are
+    repeated every RECONNECT_RETRY_MS until success
+    or stop of program.
+
+    Returns error index (E502M_ERR if program was stopped).
+*/
+static int reconnect_device(acquisition* acq);
+
+/*
+    Moves blocks from backlog file to queue while
+    there are free blocks in pool. Called only from
+    backlog thread.
+
+    max_blocks - max count of moved blocks
+                 (-1 - until backlog is empty)
+*/
+static void drain_backlog(acquisition* acq, int max_blocks);
+
+/*
+    Touches pages of queue blocks and buffers of
+    files before start of data collection.
+*/
+static void prefault_buffers(acquisition* acq);
+
+/*
+    Places threads of module on cores from configuration
+    and sets real-time priority of receiving thread.
+*/
+static void place_threads(acquisition* acq);
+
+// Counts memory of buffer in stats by kind of its pages
+static void count_sample_memory(sample_memory* mem)
+{
+    stats_add(mem->pages != HUGE_PAGES_OFF ? &g_stats.huge_pages_bytes :
+                                             &g_stats.ordinary_pages_bytes,
+              (long long)mem->bytes);
+}
+
+static int is_stopped(acquisition* acq)
+{
+    return __atomic_load_n(acq->stop, __ATOMIC_RELAXED);
+}
+
+acquisition* create_acquisition(e502monitor_config* config, int* stop)
+{
+    acquisition* acq = (acquisition*)calloc(1, sizeof(acquisition));
+
+    if(acq == NULL){ return NULL; }
+
+    acq->config = config;
+    acq->stop = stop;
+    acq->last_recv_end = -1;
+
+    if( init_continuity_checker(&acq->continuity, config) != E502M_ERR_OK )
+    {
+        printf("Неверные каналы для проверки непрерывности данных.\n");
+
+        free(acq);
+        return NULL;
+    }
+
+    // observations are counted in samples of all channels
+    init_clock_model(&acq->clock, config->adc_freq * config->channel_count);
+    acq->wall_offset_us = wall_clock_offset();
+
+    // directories of modules from "devices" list
+    mkdir(config->bin_dir, 0755);
+    mkdir(config->spill_dir, 0755);
+
+    // blocks of pool have max size of read
+    init_block_tuning(&acq->tuning, config);
+
+    config->read_block_size = acq->tuning.max_block_size;
+    config->read_timeout = acq->tuning.read_timeout;
+
+    stats_set(&acq->stats.read_block_size, acq->tuning.block_size);
+    stats_set(&acq->stats.driver_buffer_size, acq->tuning.driver_buffer_size);
+    stats_set(&acq->stats.read_timeout_ms, acq->tuning.read_timeout);
+
+    // one block is received and one is written
+    // while queue_depth blocks are waiting
+    int pool_blocks_count = config->queue_depth + 2;
+    int sample_bytes = config->sample_path == SAMPLE_PATH_FLOAT32 ? sizeof(float) : sizeof(double);
+    long long block_bytes = (sizeof(uint32_t) + sample_bytes) * (long long)config->read_block_size;
+
+    if( config->queue_memory_limit > 0 )
+    {
+        long long limit_blocks = (long long)config->queue_memory_limit *
+                                 1024 * 1024 / block_bytes;
+
+        if( limit_blocks < 3 ){ limit_blocks = 3; }
+
+        if( limit_blocks < pool_blocks_count )
+        {
+            printf("Очередь ограничена %lld блоками (%d МБ)\n",
+                   limit_blocks, config->queue_memory_limit);
+
+            pool_blocks_count = (int)limit_blocks;
+        }
+    }
+
+    acq->pool_blocks_count = pool_blocks_count;
+
+    logg("Создаю очередь для хранения данных");
+    acq->data_ring = create_spsc_ring(pool_blocks_count);
+
+    if( acq->data_ring == NULL )
+    {
+        printf("Ошибка создания очереди для хранения данных.\n");
+        logg("Ошибка создания очереди для хранения данных");
+
+        destroy_acquisition(&acq);
+        return NULL;
+    }
+
+    logg("Выделяю память под блоки данных");
+    acq->block_pool = create_block_pool(config->read_block_size, pool_blocks_count,
+                                        config->sample_path, config->huge_pages);
+
+    if( acq->block_pool == NULL )
+    {
+        printf("Не удалось выделить память под блоки данных.\n");
+        logg("Не удалось выделить память под блоки данных");
+
+        destroy_acquisition(&acq);
+        return NULL;
+    }
+
+    if( config->overflow_policy == OVERFLOW_SPILL )
+    {
+        logg("Создаю файл буферизации");
+
+        acq->spill_backlog = create_spill_backlog(config->spill_dir);
+        acq->spill_pool = create_block_pool(config->read_block_size, SPILL_POOL_BLOCKS,
+                                             config->sample_path, config->huge_pages);
+
+        // any received block can be passed to backlog thread
+        acq->spill_ring = create_spsc_ring(pool_blocks_count + SPILL_POOL_BLOCKS);
+
+        if( acq->spill_backlog == NULL || acq->spill_pool == NULL || acq->spill_ring == NULL )
+        {
+            printf("Не удалось создать файл буферизации в %s.\n", config->spill_dir);
+            logg("Не удалось создать файл буферизации");
+
+            destroy_acquisition(&acq);
+            return NULL;
+        }
+    }
+
+    if( config->preroll_seconds > 0 && config->capture_mode == CAPTURE_RAW )
+    {
+        printf("Предзапись недоступна в режиме raw.\n");
+        logg("Предзапись недоступна в режиме raw");
+    }
+    else if( config->preroll_seconds > 0 )
+    {
+        acq->preroll = create_preroll_ring(config);
+
+        if( acq->preroll == NULL )
+        {
+            destroy_acquisition(&acq);
+            return NULL;
+        }
+
+        count_sample_memory(&acq->preroll->memory);
+    }
+
+    count_sample_memory(&acq->block_pool->raw_mapping);
+    count_sample_memory(&acq->block_pool->data_mapping);
+
+    // blocks of spill pool aren't counted
+    acq->stats.pool_min_free = pool_blocks_count;
+    acq->block_pool->min_free = &acq->stats.pool_min_free;
+
+    stats_add(&g_stats.pool_blocks_count, pool_blocks_count);
+    stats_add(&g_stats.queue_memory_bytes, block_bytes * pool_blocks_count);
+
+    register_module_stats(&acq->stats, config->serial);
+
+    return acq;
+}
+
+int start_acquisition(acquisition* acq, t_x502_devrec* devrec, struct timeval* start_time)
+{
+    e502monitor_config* config = acq->config;
+
+    acq->device_hnd = open_device(devrec, 0);
+
+    if(acq->device_hnd == NULL)
+    {
+        printf("Ошибка установления связи с модулем %s.\n", devrec->serial);
+        logg("Ошибка установления связи с модулем");
+
+        return E502M_ERR;
+    }
+
+    // "serial" of configuration is empty for the only module
+    snprintf(acq->serial, sizeof(acq->serial), "%s", devrec->serial);
+
+    print_info_about_device(acq->device_hnd);
+
+    logg("Настраиваю устройство...");
+    configure_device(acq->device_hnd, config);
+
+    if( acq->tuning.driver_buffer_size > 0 &&
+        X502_SetStreamBufSize(acq->device_hnd, X502_STREAM_CH_IN,
+                              acq->tuning.driver_buffer_size) != X502_ERR_OK )
+    {
+        logg("Не удалось установить размер буфера драйвера");
+        stats_set(&acq->stats.driver_buffer_size, 0);
+    }
+
+    logg("Устройство настроено...");
+
+    // initialize some header fields
+    acq->hdr.adc_freq = config->adc_freq / config->channel_count;
+    strcpy(acq->hdr.module_name, config->module_name);
+    strcpy(acq->hdr.place, config->place);
+
+    logg("Создаю файлы");
+
+    if( config->capture_mode == CAPTURE_RAW )
+    {
+        t_x502_info info;
+
+        if( X502_GetDevInfo(acq->device_hnd, &info) == X502_ERR_OK )
+        {
+            acq->raw_cbr = info.cbr;
+            acq->raw_cbr_valid = 1;
+        }
+
+        acq->raw_segment = create_raw_segment(config,
+                                              acq->serial,
+                                              acq->raw_cbr_valid ? &acq->raw_cbr : NULL,
+                                              config->bin_dir,
+                                              NULL);
+    } else {
+        acq->rotator = create_segment_rotator(config, start_time);
+    }
+
+    if( acq->rotator == NULL && acq->raw_segment == NULL )
+    {
+        logg("Ошибка создания описателей выходных файлов");
+
+        return E502M_ERR;
+    }
+
+    // raw words aren't distributed by files
+    if( config->capture_mode == CAPTURE_WAV )
+    {
+        // each block contains at most block_size / channel_count + 1 frames of file,
+        // buffer keeps less than write_batch_frames frames between blocks
+        acq->routing_plan = create_routing_plan(config,
+                                                acq->block_pool->block_size / config->channel_count + 2 +
+                                                config->write_batch_frames);
+
+        if( acq->routing_plan == NULL )
+        {
+            logg("Ошибка создания таблицы распределения каналов по файлам");
+
+            return E502M_ERR;
+        }
+
+        count_sample_memory(&acq->routing_plan->frames_memory);
+
+        char log_msg[100] = "";
+        sprintf(log_msg, "Распределение отсчетов по файлам: %s", demux_kernel_name(acq->routing_plan));
+        logg(log_msg);
+    }
+
+    if( config->writer_threads > 0 && config->capture_mode == CAPTURE_WAV )
+    {
+        int writers_count = config->writer_threads < config->files_count ?
+                            config->writer_threads : config->files_count;
+
+        acq->writers = create_writer_group(writers_count,
+                                           acq->routing_plan,
+                                           acq->rotator->current->files,
+                                           config->huge_pages);
+
+        if( acq->writers == NULL )
+        {
+            logg("Ошибка запуска потоков записи файлов");
+
+            return E502M_ERR;
+        }
+
+        for(int w = 0; w < acq->writers->writers_count; w++)
+        {
+            count_sample_memory(&acq->writers->writers[w].memory);
+        }
+    }
+
+    adc_converter* converter = NULL;
+
+    if( config->converter == CONVERTER_NATIVE && config->capture_mode == CAPTURE_WAV )
+    {
+        t_x502_info info;
+        t_x502_cbr* cbr = NULL;
+
+        if( config->software_calibration && X502_GetDevInfo(acq->device_hnd, &info) == X502_ERR_OK )
+        {
+            cbr = &info.cbr;
+        }
+
+        if( init_adc_converter(&acq->adc_converter, config, cbr) != E502M_ERR_OK )
+        {
+            logg("Ошибка настройки перевода отсчетов в вольты");
+
+            return E502M_ERR;
+        }
+
+        char log_msg[100] = "";
+        sprintf(log_msg, "Перевод отсчетов в вольты: %s", adc_isa_name(acq->adc_converter.isa));
+        logg(log_msg);
+
+        converter = &acq->adc_converter;
+    }
+
+    // raw words are written without conversion
+    if( config->capture_mode == CAPTURE_WAV )
+    {
+        logg("Запускаю потоки обработки данных");
+
+        acq->conversion = create_conversion_stage(config->conversion_threads,
+                                                  acq->pool_blocks_count,
+                                                  acq->block_pool,
+                                                  acq->device_hnd,
+                                                  converter);
+
+        if( acq->conversion == NULL )
+        {
+            logg("Ошибка запуска потоков обработки данных");
+
+            return E502M_ERR;
+        }
+    }
+
+    if( config->prefault_buffers ){ prefault_buffers(acq); }
+
+    int32_t err = X502_StreamsStart(acq->device_hnd);
+
+    if(err != X502_ERR_OK)
+    {
+        fprintf(stderr,
+                "Ошибка запуска сбора данных: %s!\n",
+                X502_GetErrorString(err)
+                );
+        logg("Ошибка запуска сбора данных");
+
+        return E502M_ERR;
+    }
+
+    logg("Создаю отдельный поток для записи данных");
+
+    pthread_create(&acq->write_thread, NULL, write_data, acq);
+
+    if( acq->spill_backlog != NULL ){ pthread_create(&acq->spill_thread, NULL, spill_data, acq); }
+
+    pthread_create(&acq->receive_thread, NULL, receive_data, acq);
+
+    pthread_create(&acq->probe_thread, NULL, probe_latency, acq);
+
+    acq->started = 1;
+
+    place_threads(acq);
+
+    return E502M_ERR_OK;
+}
+
+void wait_acquisition(acquisition* acq)
+{
+    if(!acq->started){ return; }
+
+    pthread_join(acq->receive_thread, NULL);
+
+    __atomic_store_n(&acq->probe_done, 1, __ATOMIC_RELEASE);
+
+    pthread_join(acq->probe_thread, NULL);
+
+    // data from backlog must be written before exit
+    if( acq->spill_backlog != NULL )
+    {
+        __atomic_store_n(&acq->spill_done, 1, __ATOMIC_RELEASE);
+
+        pthread_join(acq->spill_thread, NULL);
+    }
+
+    __atomic_store_n(&acq->receive_done, 1, __ATOMIC_RELEASE);
+
+#ifdef DBG
+    printf("Ожидаю заверешения потока записи данных...\n");
+    logg("Ожидаю заверешения потока записи данных");
+#endif
+
+    pthread_join(acq->write_thread, NULL);
+
+    acq->started = 0;
+}
+
+void request_snapshot(acquisition* acq)
+{
+    if( acq->preroll == NULL )
+    {
+        logg("Снимок не записан: предзапись выключена (preroll_seconds = 0)");
+        return;
+    }
+
+    request_preroll_snapshot(acq->preroll);
+}
+
+void destroy_acquisition(acquisition** acq)
+{
+    acquisition* a = *acq;
+
+    unregister_module_stats(&a->stats);
+
+    if( a->preroll != NULL ){ destroy_preroll_ring(&a->preroll); }
+
+    if( a->conversion != NULL ){ destroy_conversion_stage(&a->conversion); }
+
+    if( a->writers != NULL ){ destroy_writer_group(&a->writers); }
+
+    if( a->device_hnd != NULL )
+    {
+        X502_Close(a->device_hnd);
+        X502_Free(a->device_hnd);
+    }
+
+    if( a->rotator != NULL )
+    {
+        logg("Особождаю память от заголовков файлов");
+
+        destroy_segment_rotator(&a->rotator);
+    }
+
+    if( a->data_ring != NULL ){ destroy_spsc_ring(&a->data_ring); }
+
+    if( a->spill_ring != NULL ){ destroy_spsc_ring(&a->spill_ring); }
+
+    if( a->block_pool != NULL ){ destroy_block_pool(&a->block_pool); }
+
+    if( a->spill_pool != NULL ){ destroy_block_pool(&a->spill_pool); }
+
+    if( a->spill_backlog != NULL )
+    {
+        logg("Удаляю файл буферизации");
+
+        destroy_spill_backlog(&a->spill_backlog);
+    }
+
+    if( a->routing_plan != NULL ){ destroy_routing_plan(&a->routing_plan); }
+
+    if( a->config != NULL ){ destroy_config(&a->config); }
+
+    free(a);
+    *acq = NULL;
+}
+
+static void* receive_data(void* arg)
+{
+    acquisition* acq = (acquisition*)arg;
+    e502monitor_config* config = acq->config;
+
+    int read_timeout = config->read_timeout;
+
+    // words of all channels per second
+    double words_rate = config->adc_freq * config->channel_count;
+
+    long long last_block_end_us = -1; // monotonic time of last received sample
+    int reconnected = 0;              // 1 - first data after reconnect is expected
+    int short_read = 0;               // 1 - previous read was short
+
+    while(!is_stopped(acq))
+    {
+        data_block* block = take_block_for_receiving(acq);
+        block->sample_index = acq->received_samples;
+        block->gap_cause = acq->next_gap_cause;
+        acq->next_gap_cause = 0;
+
+        // reads have constant size, files are changed
+        // by writing thread at exact sample
+        int requested = acq->tuning.block_size;
+        int32_t rcv_size = receive_block(acq, block, requested, read_timeout);
+
+        if(rcv_size < 0) // some errors
+        {
+            logg("Ошибка получения данных");
+
+            release_received_block(acq, block);
+
+            // queue, writers and output files are kept,
+            // only connection with module is restored
+            if( reconnect_device(acq) != E502M_ERR_OK ){ break; } // program is stopped
+
+            reconnected = 1;
+            continue;
+        }
+
+        if(reconnected && rcv_size > 0)
+        {
+            // samples are lost from last sample before error
+            // until first sample after restart of streams
+            long long gap_us = block->mono_us - (long long)(rcv_size * 1000000. / words_rate) -
+                               last_block_end_us;
+
+            long long lost_samples = gap_us > 0 ? (long long)(gap_us * words_rate / 1000000. + 0.5) : 0;
+
+            // restarted stream begins with first logical channel
+            long long next_index = acq->received_samples + lost_samples;
+            next_index += (config->channel_count - next_index % config->channel_count) %
+                          config->channel_count;
+
+            lost_samples = next_index - acq->received_samples;
+
+            acq->received_samples = next_index;
+            block->sample_index = next_index;
+            block->gap_cause = GAP_RECONNECT;
+
+            stats_add(&acq->stats.reconnect_lost_samples, lost_samples);
+            stats_set(&acq->stats.reconnect_gap_us_last, gap_us);
+            stats_update_max(&acq->stats.reconnect_gap_us_max, gap_us);
+
+            char log_msg[200] = "";
+            sprintf(log_msg, "Связь с модулем восстановлена: пропущено %lld отсчетов (%lld мкс)",
+                    lost_samples, gap_us);
+            logg(log_msg);
+
+            reconnected = 0;
+        }
+
+        // driver had less data than requested during timeout
+        if(rcv_size < requested)
+        {
+            stats_add(&acq->stats.short_reads, 1);
+
+            if(!short_read)
+            {
+                char log_msg[200] = "";
+                sprintf(log_msg, "Получено %d слов вместо %d за %d мс",
+                        rcv_size, requested, read_timeout);
+                logg(log_msg);
+            }
+        }
+
+        short_read = rcv_size < requested;
+
+        long long block_end_us = block->mono_us;
+
+        deliver_received(acq, block, rcv_size, last_block_end_us);
+
+        if(rcv_size > 0){ last_block_end_us = block_end_us; }
+
+        if( acq->tuning.enabled )
+        {
+            uint32_t ready_count = 0;
+
+            X502_GetRecvReadyCount(acq->device_hnd, &ready_count);
+
+            if( tune_block_size(&acq->tuning, ready_count, ring_size(acq->data_ring),
+                                acq->pool_blocks_count) )
+            {
+                stats_set(&acq->stats.read_block_size, acq->tuning.block_size);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void* spill_data(void* arg)
+{
+    acquisition* acq = (acquisition*)arg;
+
+    data_block* block;
+    int size, first_lch, last_buffer_index;
+
+    while(1)
+    {
+        int done = __atomic_load_n(&acq->spill_done, __ATOMIC_ACQUIRE);
+
+        // blocks in backlog wait for free blocks of pool
+        pop_from_ring(acq->spill_ring,
+                      (void**)&block,
+                      &size,
+                      &first_lch,
+                      &last_buffer_index,
+                      backlog_empty(acq->spill_backlog) ? SPILL_POP_TIMEOUT : BACKLOG_POLL_MS);
+
+        if(block != NULL)
+        {
+            if( spill_block(acq->spill_backlog, block, size, first_lch, NOT_LAST_BUFFER) != E502M_ERR_OK )
+            {
+                stats_add(&acq->stats.dropped_blocks, 1);
+                stats_add(&acq->stats.dropped_samples, size);
+
+                __atomic_fetch_sub(&acq->spill_pending, 1, __ATOMIC_RELEASE);
+            }
+
+            release_received_block(acq, block);
+        }
+
+        // after stop of receiving all blocks are moved
+        drain_backlog(acq, done ? -1 : BACKLOG_DRAIN_BLOCKS);
+
+        if(done && ring_empty(acq->spill_ring) && backlog_empty(acq->spill_backlog)){ break; }
+    }
+
+    return NULL;
+}
+
+static void* probe_latency(void* arg)
+{
+    acquisition* acq = (acquisition*)arg;
+
+    while( !__atomic_load_n(&acq->probe_done, __ATOMIC_ACQUIRE) )
+    {
+        // stop is checked often, so end of collection doesn't wait for interval
+        for(int waited = 0;
+            waited < SCHED_PROBE_INTERVAL_MS && !__atomic_load_n(&acq->probe_done, __ATOMIC_ACQUIRE);
+            waited += SCHED_PROBE_POLL_MS)
+        {
+            usleep(SCHED_PROBE_POLL_MS * 1000);
+        }
+
+        long long latency = probe_sched_latency();
+
+        stats_set(&acq->stats.sched_latency_us_last, latency);
+        stats_add(&acq->stats.sched_latency_us_total, latency);
+        stats_add(&acq->stats.sched_latency_count, 1);
+        stats_update_max(&acq->stats.sched_latency_us_max, latency);
+    }
+
+    return NULL;
+}
+
+static void* write_data(void* arg)
+{
+    acquisition* acq = (acquisition*)arg;
+    e502monitor_config* config = acq->config;
+
+    long long* real_file_sizes = (long long*)malloc(sizeof(long long) * config->files_count);
+    for(int i = 0; i < config->files_count; i++)
+    {
+        real_file_sizes[i] = 0;
+    }
+
+    int ch_cntr; // logical channel of first sample in block
+    int size;
+
+#ifdef DBG
+    printf("Эталонное количество сэмплов во всех файлах: %lld\n",
+           (long long)(config->file_size * config->adc_freq * config->channel_count));
+#endif
+
+    data_block *block = NULL;
+
+    int pop_timeout = config->read_timeout / 2;
+    int last_buffer_index = NOT_LAST_BUFFER;
+
+    long long expected_sample_index = -1; // index of first sample of next block
+    long long first_sample = -1;          // index of first sample of recording
+    long long file_first_sample = -1;     // index of first sample of current files
+    long long next_boundary = -1;         // index of first sample of next segment
+    long long segment_start_us = -1;      // wall time of first sample of current files
+    long long last_sample_us = -1;        // wall time of last written sample
+
+    gap_info gaps[MAX_SEGMENT_GAPS];      // lost data in current files
+    int gaps_count = 0;
+
+    long long lost_end = -1;              // index after last block which wasn't converted
+    int lost_cause = 0;                   // cause of blocks which weren't converted
+
+    while( !__atomic_load_n(&acq->receive_done, __ATOMIC_ACQUIRE) || !ring_empty(acq->data_ring) )
+    {
+        pop_from_ring(acq->data_ring,
+                      (void**)&block,
+                      &size,
+                      &ch_cntr,
+                      &last_buffer_index,
+                      pop_timeout);
+
+        if(block == NULL){ continue; }
+
+        if( acq->conversion != NULL ){ wait_block_converted(acq->conversion, block); }
+
+        observe_block_time(acq, block, size);
+
+        if(next_boundary < 0)
+        {
+            first_sample = file_first_sample = block->sample_index;
+            next_boundary = next_segment_boundary(acq, first_sample, first_sample);
+            acq->wall_offset_us = update_wall_offset();
+            segment_start_us = sample_wall_us(acq, first_sample);
+        }
+
+        // module was closed before block was converted,
+        // its samples are part of gap before next block
+        if( acq->conversion != NULL && block->lost )
+        {
+            if(expected_sample_index < 0)
+            {
+                expected_sample_index = block->sample_index;
+                last_sample_us = sample_wall_us(acq, expected_sample_index);
+            }
+
+            stats_add(&acq->stats.unconverted_blocks, 1);
+
+            lost_cause = GAP_RECONNECT;
+            lost_end = block->sample_index + size;
+
+            release_block(acq->block_pool, block);
+            continue;
+        }
+
+        // lost data before block, position and length in samples of stream
+        gap_info block_gap;
+        int block_has_gap = 0;
+
+        // some blocks were dropped before this block
+        if(expected_sample_index >= 0 && block->sample_index > expected_sample_index)
+        {
+            block_gap.position = expected_sample_index;
+            block_gap.length = block->sample_index - expected_sample_index;
+            block_gap.cause = block->gap_cause != 0 ? block->gap_cause :
+                              lost_cause != 0 ? lost_cause : GAP_OVERFLOW;
+            block_gap.time_us = last_sample_us;
+            block_gap.duration_us = sample_wall_us(acq, block->sample_index) - last_sample_us;
+
+            block_has_gap = 1;
+
+            record_gap(acq, &block_gap, gaps, &gaps_count, file_first_sample, next_boundary);
+        }
+
+        lost_cause = 0;
+
+        // lost samples are zeros of module in merged file
+        if( acq->merge != NULL && block->fdata != NULL )
+        {
+            push_merge_samples_float(acq->merge,
+                                     acq->merge_input,
+                                     block->fdata,
+                                     block->data_size,
+                                     block->sample_index,
+                                     &acq->clock,
+                                     block->mono_us,
+                                     block_has_gap ? block_gap.cause : 0);
+        }
+        else if( acq->merge != NULL )
+        {
+            push_merge_samples(acq->merge,
+                               acq->merge_input,
+                               block->data,
+                               block->data_size,
+                               block->sample_index,
+                               &acq->clock,
+                               block->mono_us,
+                               block_has_gap ? block_gap.cause : 0);
+        }
+
+        expected_sample_index = block->sample_index + size;
+        last_sample_us = sample_wall_us(acq, expected_sample_index);
+
+        // block is split at boundary of segments, so
+        // each segment has file_size seconds of clock of module
+        int done = 0;
+
+        while(1)
+        {
+            long long index = block->sample_index + done;
+
+            if(index >= next_boundary)
+            {
+                long long boundary_us = sample_wall_us(acq, index);
+
+                int err = finish_segment(acq,
+                                         real_file_sizes,
+                                         gaps,
+                                         gaps_count,
+                                         segment_start_us,
+                                         boundary_us);
+
+                // boundary could be in lost data
+                next_boundary = next_segment_boundary(acq, index, first_sample);
+
+                // current files are continued until next boundary
+                if(err == E502M_ERR_OK)
+                {
+                    file_first_sample = index;
+                    gaps_count = 0;
+
+                    // system clock could be synchronized or stepped
+                    refresh_wall_offset(acq);
+                    segment_start_us = sample_wall_us(acq, index);
+                }
+            }
+
+            if(done == size){ break; }
+
+            int part = size - done;
+
+            if(index + part > next_boundary){ part = (int)(next_boundary - index); }
+
+            int first_lch = (ch_cntr + done) % config->channel_count;
+
+            if( config->capture_mode == CAPTURE_RAW )
+            {
+                // converter restores gap from header of block
+                write_raw_data(acq, block, done, part, first_lch,
+                               done == 0 && block_has_gap ? &block_gap : NULL);
+            } else {
+                write_samples(acq, block, done, part, first_lch, real_file_sizes);
+            }
+
+            done += part;
+        }
+
+        if( acq->preroll != NULL ){ update_preroll(acq, block, size); }
+
+        release_block(acq->block_pool, block);
+    }
+
+    // blocks at the end weren't converted
+    if(expected_sample_index >= 0 && lost_end > expected_sample_index)
+    {
+        gap_info end_gap;
+
+        end_gap.position = expected_sample_index;
+        end_gap.length = lost_end - expected_sample_index;
+        end_gap.cause = lost_cause;
+        end_gap.time_us = last_sample_us;
+        end_gap.duration_us = sample_wall_us(acq, lost_end) - last_sample_us;
+
+        record_gap(acq, &end_gap, gaps, &gaps_count, file_first_sample, next_boundary);
+    }
+
+    // files are finished at time of last sample
+    if(segment_start_us < 0)
+    {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        segment_start_us = last_sample_us = (long long)now.tv_sec * 1000000 + now.tv_usec;
+    }
+
+    set_header_time(&acq->hdr, segment_start_us, last_sample_us);
+
+    if( acq->routing_plan != NULL ){ write_frames(acq, real_file_sizes, 0); }
+
+    if( acq->writers != NULL ){ wait_writers_idle(acq->writers); }
+
+    clock_quality clock;
+    get_clock_quality(acq, &clock);
+
+    if( acq->rotator != NULL )
+    {
+        close_current_segment(acq->rotator,
+                              &acq->hdr,
+                              real_file_sizes,
+                              gaps,
+                              gaps_count,
+                              &clock);
+    }
+
+    if( acq->raw_segment != NULL )
+    {
+        close_raw_segment(&acq->raw_segment, config->bin_dir, &acq->hdr, &clock);
+    }
+
+    write_stats_file(STATS_FILE_NAME);
+
+    free(real_file_sizes);
+
+    return NULL;
+}
+
+static void record_gap(acquisition* acq,
+                       gap_info* gap,
+                       gap_info* gaps,
+                       int* gaps_count,
+                       long long file_first_sample,
+                       long long next_boundary)
+{
+    e502monitor_config* config = acq->config;
+
+    char log_msg[200] = "";
+    sprintf(log_msg, "Пропуск данных (%s): потеряно %lld отсчетов",
+            gap_cause_name(gap->cause), gap->length);
+    logg(log_msg);
+
+    stats_add(&acq->stats.gaps, 1);
+    stats_add(&acq->stats.gap_lost_samples, gap->length);
+
+    if(*gaps_count < MAX_SEGMENT_GAPS && gap->position < next_boundary)
+    {
+        gap_info* file_gap = &gaps[*gaps_count];
+
+        file_gap->position = (gap->position - file_first_sample) / config->channel_count;
+        // incomplete frame around gap is dropped too
+        file_gap->length = (gap->length + config->channel_count - 1) / config->channel_count;
+        file_gap->cause = gap->cause;
+        file_gap->time_us = gap->time_us;
+        file_gap->duration_us = gap->duration_us;
+
+        (*gaps_count)++;
+    }
+
+    if( acq->preroll != NULL ){ add_preroll_gap(acq->preroll, gap); }
+
+    // frames contain samples from before the gap
+    if( acq->routing_plan != NULL ){ reset_frames(acq->routing_plan); }
+}
+
+static void write_frames(acquisition* acq, long long* real_file_sizes, int min_frames)
+{
+    routing_plan* plan = acq->routing_plan;
+
+    for(int i = 0; i < plan->files_count; i++)
+    {
+        demux_buffer* buffer = &plan->buffers[i];
+
+        if(buffer->frames_count == 0 || buffer->frames_count < min_frames){ continue; }
+
+        real_file_sizes[i] += buffer->frames_count;
+
+        if( acq->writers != NULL )
+        {
+            // writing thread takes buffer with frames,
+            // plan continues in free batch of file
+            replace_frames(plan, i, submit_frames(acq->writers, i, buffer->frames, buffer->frames_count));
+        }
+        else
+        {
+            write_audio_frames(acq->rotator->current->files[i], buffer->frames, buffer->frames_count);
+
+            stats_add(&g_stats.write_calls, 1);
+
+            consume_frames(plan, i);
+        }
+    }
+}
+
+static data_block* take_block_for_receiving(acquisition* acq)
+{
+    data_block* block = try_acquire_block(acq->block_pool);
+
+    if(block != NULL){ return block; }
+
+    stats_add(&g_stats.pool_exhausted, 1);
+
+    if(acq->config->overflow_policy == OVERFLOW_SPILL)
+    {
+        // block will be written in backlog file by its thread
+        block = try_acquire_block(acq->spill_pool);
+
+        if(block != NULL){ return block; }
+
+        logg("Файл буферизации не успевает. Ожидаю освобождения блока");
+
+        return acquire_block(acq->spill_pool);
+    }
+
+    if(acq->config->overflow_policy == OVERFLOW_DROP_OLDEST)
+    {
+        data_block* old_block;
+        int size, first_lch, last_buffer_index;
+
+        if( drop_oldest_from_ring(acq->data_ring,
+                                  (void**)&old_block,
+                                  &size,
+                                  &first_lch,
+                                  &last_buffer_index) )
+        {
+            stats_add(&acq->stats.dropped_blocks, 1);
+            stats_add(&acq->stats.dropped_samples, size);
+
+            release_block(acq->block_pool, old_block);
+        }
+    } else {
+        logg("Очередь переполнена. Ожидаю освобождения блока");
+    }
+
+    return acquire_block(acq->block_pool);
+}
+
+static void release_received_block(acquisition* acq, data_block* block)
+{
+    if( acq->spill_pool != NULL && block_in_pool(acq->spill_pool, block) )
+    {
+        release_block(acq->spill_pool, block);
+    } else {
+        release_block(acq->block_pool, block);
+    }
+}
+
+static void deliver_block(acquisition* acq, data_block* block, int size, int first_lch)
+{
+    // while backlog isn't empty new blocks go after it,
+    // queue is filled only by backlog thread
+    if( acq->spill_backlog != NULL &&
+        (block_in_pool(acq->spill_pool, block) ||
+         __atomic_load_n(&acq->spill_pending, __ATOMIC_ACQUIRE) > 0) )
+    {
+        __atomic_fetch_add(&acq->spill_pending, 1, __ATOMIC_RELAXED);
+
+        push_to_ring(acq->spill_ring, block, size, first_lch, NOT_LAST_BUFFER);
+
+        return;
+    }
+
+    if( acq->conversion != NULL ){ convert_block_async(acq->conversion, block, size, first_lch); }
+
+    push_to_ring(acq->data_ring, block, size, first_lch, NOT_LAST_BUFFER);
+
+    stats_update_max(&g_stats.queue_high_water, ring_size(acq->data_ring));
+}
+
+// Returns index of first word after break. Stream is
+// aligned, so this word gets index of its logical channel
+static long long index_after_break(acquisition* acq,
+                                   data_block* block,
+                                   int size,
+                                   continuity_break* brk,
+                                   long long prev_end_us)
+{
+    e502monitor_config* config = acq->config;
+    int channel_count = config->channel_count;
+
+    long long index = block->sample_index + brk->position;
+    long long lost = 0;
+
+    if(brk->kind == CONTINUITY_OVERRUN)
+    {
+        // samples were lost in module, count of them is
+        // estimated by time between ends of blocks and
+        // words which are still in driver buffer
+        uint32_t ready_count = 0;
+        X502_GetRecvReadyCount(acq->device_hnd, &ready_count);
+
+        double words_rate = config->adc_freq * channel_count;
+        long long samples = size - brk->skip;
+
+        if(prev_end_us >= 0)
+        {
+            lost = (long long)((block->mono_us - prev_end_us) * words_rate / 1000000.) -
+                   samples - ready_count;
+        }
+
+        if(lost < 0){ lost = 0; }
+
+        stats_add(&acq->stats.fifo_overruns, 1);
+    }
+    else if(brk->kind == CONTINUITY_MISALIGN)
+    {
+        // damaged words and words of ambiguous
+        // channel take places of samples
+        lost = brk->skip;
+
+        stats_add(&acq->stats.channel_misalignments, 1);
+    }
+    else
+    {
+        stats_add(&acq->stats.unexpected_words, brk->skip);
+    }
+
+    index += lost;
+
+    // next sample has known logical channel
+    if(brk->lch >= 0)
+    {
+        index += ((brk->lch - index % channel_count) + channel_count) % channel_count;
+    }
+    else if(brk->kind == CONTINUITY_OVERRUN)
+    {
+        index += (channel_count - index % channel_count) % channel_count;
+    }
+
+    lost = index - (block->sample_index + brk->position);
+
+    if(brk->kind == CONTINUITY_OVERRUN){ stats_add(&acq->stats.overrun_lost_samples, lost); }
+    if(brk->kind == CONTINUITY_MISALIGN){ stats_add(&acq->stats.misalign_lost_samples, lost); }
+
+    if(brk->kind != CONTINUITY_FOREIGN)
+    {
+        char log_msg[200] = "";
+        sprintf(log_msg, "%s: пропущено %lld отсчетов после отсчета %lld",
+                brk->kind == CONTINUITY_OVERRUN ? "Переполнение буфера модуля" :
+                                                  "Нарушен порядок каналов",
+                lost, block->sample_index + brk->position);
+        logg(log_msg);
+    }
+
+    return index;
+}
+
+static void deliver_received(acquisition* acq, data_block* block, int size, long long prev_end_us)
+{
+    int channel_count = acq->config->channel_count;
+    double word_us = 1000000. / (acq->config->adc_freq * channel_count);
+
+    continuity_break brk;
+
+    while(1)
+    {
+        // stream contains only ADC samples, so channel
+        // is defined by position of sample in stream
+        int first_lch = block->sample_index % channel_count;
+
+        if( check_continuity(&acq->continuity, block->raw, size, first_lch, &brk) == CONTINUITY_OK )
+        {
+            acq->received_samples = block->sample_index + size;
+
+            deliver_block(acq, block, size, first_lch);
+            return;
+        }
+
+        long long next_index = index_after_break(acq, block, size, &brk, prev_end_us);
+        int gap_cause = brk.kind == CONTINUITY_OVERRUN ? GAP_OVERRUN :
+                        brk.kind == CONTINUITY_MISALIGN ? GAP_MISALIGN : 0;
+
+        // nothing is passed before break, so earlier gap
+        // and this one are the same gap
+        if(brk.position == 0 && gap_cause == 0){ gap_cause = block->gap_cause; }
+
+        int tail = brk.position + brk.skip;
+        int tail_size = size - tail;
+        long long end_us = block->mono_us;
+
+        // loss is counted once, next part is continuous
+        prev_end_us = -1;
+
+        // words after break go to next block
+        data_block* next = block;
+
+        if(brk.position > 0 && tail_size > 0)
+        {
+            next = take_block_for_receiving(acq);
+            memcpy(next->raw, block->raw + tail, sizeof(uint32_t) * tail_size);
+        }
+
+        if(brk.position > 0)
+        {
+            block->mono_us = end_us - (long long)(tail_size * word_us);
+            acq->received_samples = block->sample_index + brk.position;
+
+            deliver_block(acq, block, brk.position, first_lch);
+        }
+
+        if(tail_size == 0)
+        {
+            // gap is before next received block
+            if(brk.position == 0){ release_received_block(acq, block); }
+
+            acq->received_samples = next_index;
+            acq->next_gap_cause = gap_cause;
+
+            return;
+        }
+
+        if(next == block){ memmove(block->raw, block->raw + tail, sizeof(uint32_t) * tail_size); }
+
+        next->sample_index = next_index;
+        next->mono_us = end_us;
+        next->gap_cause = gap_cause;
+
+        block = next;
+        size = tail_size;
+    }
+}
+
+static int32_t receive_block(acquisition* acq, data_block* block, int size, int timeout)
+{
+    if(acq->last_recv_end >= 0)
+    {
+        long long gap = monotonic_us() - acq->last_recv_end;
+
+        stats_add(&g_stats.recv_gap_us_total, gap);
+        stats_add(&g_stats.recv_gap_count, 1);
+        stats_update_max(&g_stats.recv_gap_us_max, gap);
+    }
+
+    int32_t rcv_size = X502_Recv(acq->device_hnd, block->raw, size, timeout);
+
+    // time of the last sample of block, it is
+    // mapped to wall time by clock model of module
+    acq->last_recv_end = monotonic_us();
+    block->mono_us = acq->last_recv_end;
+
+    return rcv_size;
+}
+
+static int reconnect_device(acquisition* acq)
+{
+    long long start = monotonic_us();
+
+    X502_StreamsStop(acq->device_hnd);
+
+    // blocks which are already received are converted by old handle
+    if( acq->conversion != NULL ){ set_conversion_device(acq->conversion, NULL); }
+
+    X502_Close(acq->device_hnd);
+    X502_Free(acq->device_hnd);
+
+    acq->device_hnd = NULL;
+
+    stats_add(&acq->stats.reconnects, 1);
+
+    for(int attempt = 1; !is_stopped(acq); attempt++)
+    {
+        t_x502_devrec* devrec_list = NULL;
+        t_x502_hnd hnd = NULL;
+
+        uint32_t devices_count = get_usb_devrec(&devrec_list);
+
+        if(devices_count > 0)
+        {
+            int index = find_device(devrec_list, devices_count, acq->config->serial);
+
+            if(index >= 0){ hnd = open_device(devrec_list, index); }
+
+            X502_FreeDevRecordList(devrec_list, devices_count);
+            free(devrec_list);
+        }
+
+        if( hnd != NULL && configure_device(hnd, acq->config) == E502M_ERR_OK )
+        {
+            if( acq->tuning.driver_buffer_size > 0 )
+            {
+                X502_SetStreamBufSize(hnd, X502_STREAM_CH_IN, acq->tuning.driver_buffer_size);
+            }
+
+            if( X502_StreamsStart(hnd) == X502_ERR_OK )
+            {
+                if( acq->conversion != NULL ){ set_conversion_device(acq->conversion, hnd); }
+
+                acq->device_hnd = hnd;
+
+                char log_msg[200] = "";
+                sprintf(log_msg, "Модуль переподключен: попыток %d, %lld мс",
+                        attempt, (monotonic_us() - start) / 1000);
+                logg(log_msg);
+
+                return E502M_ERR_OK;
+            }
+        }
+
+        if( hnd != NULL )
+        {
+            X502_Close(hnd);
+            X502_Free(hnd);
+        }
+
+        usleep(RECONNECT_RETRY_MS * 1000);
+    }
+
+    return E502M_ERR;
+}
+
+static void drain_backlog(acquisition* acq, int max_blocks)
+{
+    for(int i = 0; i != max_blocks && !backlog_empty(acq->spill_backlog); i++)
+    {
+        // module is reconnected, blocks wait for new handle in backlog,
+        // after stop they are passed and become gap
+        if( max_blocks >= 0 && acq->conversion != NULL &&
+            !conversion_device_ready(acq->conversion) ){ return; }
+
+        data_block* block = max_blocks < 0 ? acquire_block(acq->block_pool) :
+                                             try_acquire_block(acq->block_pool);
+
+        if(block == NULL){ return; }
+
+        int size, first_lch, last_buffer_index;
+        int blocks_count = acq->spill_backlog->blocks_count;
+
+        if( unspill_block(acq->spill_backlog, block, &size, &first_lch,
+                          &last_buffer_index) != E502M_ERR_OK )
+        {
+            release_block(acq->block_pool, block);
+
+            // the whole backlog is dropped, lost samples are gap
+            stats_add(&acq->stats.dropped_blocks, blocks_count);
+            __atomic_fetch_sub(&acq->spill_pending, blocks_count, __ATOMIC_RELEASE);
+
+            return;
+        }
+
+        if( acq->conversion != NULL ){ convert_block_async(acq->conversion, block, size, first_lch); }
+
+        push_to_ring(acq->data_ring, block, size, first_lch, last_buffer_index);
+
+        stats_update_max(&g_stats.queue_high_water, ring_size(acq->data_ring));
+
+        // receiving thread fills queue again after the last block
+        __atomic_fetch_sub(&acq->spill_pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void prefault_buffers(acquisition* acq)
+{
+    block_pool* pool = acq->block_pool;
+    long long words = (long long)pool->block_size * pool->blocks_count;
+
+    prefault_memory(pool->raw_memory, words * sizeof(uint32_t));
+    prefault_memory(pool->data_memory, words * pool->sample_bytes);
+
+    if( acq->spill_pool != NULL )
+    {
+        words = (long long)acq->spill_pool->block_size * acq->spill_pool->blocks_count;
+
+        prefault_memory(acq->spill_pool->raw_memory, words * sizeof(uint32_t));
+        prefault_memory(acq->spill_pool->data_memory, words * acq->spill_pool->sample_bytes);
+    }
+
+    for(int i = 0; acq->routing_plan != NULL && i < acq->routing_plan->files_count; i++)
+    {
+        demux_buffer* buffer = &acq->routing_plan->buffers[i];
+
+        prefault_memory(buffer->frames, (long long)buffer->capacity * buffer->channels * sizeof(float));
+    }
+
+    if( acq->writers != NULL )
+    {
+        for(int i = 0; i < acq->writers->writers_count; i++)
+        {
+            sample_memory* memory = &acq->writers->writers[i].memory;
+
+            prefault_memory(memory->memory, (long long)memory->bytes);
+        }
+    }
+
+    logg("Буферы заполнены до начала сбора");
+}
+
+static void place_threads(acquisition* acq)
+{
+    e502monitor_config* config = acq->config;
+
+    set_thread_cpus(acq->receive_thread, config->receive_cpus, "приема");
+    set_thread_cpus(acq->write_thread, config->writer_cpus, "записи");
+
+    if( acq->spill_backlog != NULL )
+    {
+        set_thread_cpus(acq->spill_thread, config->writer_cpus, "буферизации");
+    }
+
+    if( set_thread_priority(acq->receive_thread, config->receive_priority, "приема") == E502M_ERR_OK )
+    {
+        stats_set(&acq->stats.receive_priority, config->receive_priority);
+    }
+
+    // latency of receiving thread is measured in the same conditions
+    set_thread_cpus(acq->probe_thread, config->receive_cpus, "измерения задержки");
+    set_thread_priority(acq->probe_thread, config->receive_priority, "измерения задержки");
+
+    if( acq->conversion != NULL )
+    {
+        for(int i = 0; i < acq->conversion->threads_count; i++)
+        {
+            set_thread_cpus(acq->conversion->threads[i], config->conversion_cpus, "обработки");
+        }
+    }
+
+    if( acq->writers != NULL )
+    {
+        for(int i = 0; i < acq->writers->writers_count; i++)
+        {
+            set_thread_cpus(acq->writers->writers[i].thread, config->writer_cpus, "записи файлов");
+        }
+    }
+
+    if( acq->rotator != NULL )
+    {
+        set_thread_cpus(acq->rotator->thread, config->finisher_cpus, "завершения файлов");
+    }
+}
+
+static void write_raw_data(acquisition* acq,
+                           data_block* block,
+                           int offset,
+                           int size,
+                           int first_lch,
+                           gap_info* gap)
+{
+    if( acq->raw_segment != NULL &&
+        write_raw_block(acq->raw_segment,
+                        block->raw + offset,
+                        size,
+                        first_lch,
+                        block->sample_index + offset,
+                        gap) != E502M_ERR_OK )
+    {
+        logg("Ошибка записи raw-файла");
+    }
+}
+
+static void write_samples(acquisition* acq,
+                          data_block* block,
+                          int offset,
+                          int size,
+                          int first_lch,
+                          long long* real_file_sizes)
+{
+    // words without ADC data are skipped by conversion
+    if(offset >= block->data_size){ return; }
+    if(offset + size > block->data_size){ size = block->data_size - offset; }
+
+    long long demux_start = monotonic_us();
+
+    if( block->fdata != NULL )
+    {
+        demux_block_float(acq->routing_plan, block->fdata + offset, size, first_lch);
+    } else {
+        demux_block(acq->routing_plan, block->data + offset, size, first_lch);
+    }
+
+    stats_add(&g_stats.demux_us_total, monotonic_us() - demux_start);
+    stats_add(&g_stats.demux_samples, size);
+
+    write_frames(acq, real_file_sizes, acq->config->write_batch_frames);
+}
+
+static int finish_segment(acquisition* acq,
+                          long long* real_file_sizes,
+                          gap_info* gaps,
+                          int gaps_count,
+                          long long start_us,
+                          long long finish_us)
+{
+    e502monitor_config* config = acq->config;
+
+    set_header_time(&acq->hdr, start_us, finish_us);
+
+    if( config->capture_mode == CAPTURE_RAW )
+    {
+        // next file is created before current one is closed
+        raw_segment* next = create_raw_segment(config,
+                                               acq->serial,
+                                               acq->raw_cbr_valid ? &acq->raw_cbr : NULL,
+                                               config->bin_dir,
+                                               acq->raw_segment);
+
+        if( next == NULL )
+        {
+            // data stays in current file, next attempt is
+            // made at next boundary of segments
+            stats_add(&g_stats.rotation_failures, 1);
+            logg("Ошибка создания raw-файла. Запись продолжается в текущий файл");
+
+            return E502M_ERR;
+        }
+
+        if( acq->raw_segment != NULL )
+        {
+            clock_quality clock;
+            get_clock_quality(acq, &clock);
+
+            close_raw_segment(&acq->raw_segment, config->bin_dir, &acq->hdr, &clock);
+        }
+
+        acq->raw_segment = next;
+    } else {
+        write_frames(acq, real_file_sizes, 0);
+
+        if( acq->writers != NULL ){ wait_writers_idle(acq->writers); }
+
+        clock_quality clock;
+        get_clock_quality(acq, &clock);
+
+        // files are closed and renamed by finishing thread,
+        // files of next segment are already opened
+        output_segment* segment = rotate_segment(acq->rotator,
+                                                 &acq->hdr,
+                                                 real_file_sizes,
+                                                 gaps,
+                                                 gaps_count,
+                                                 &clock);
+
+        if( segment == NULL ){ return E502M_ERR; }
+
+        if( acq->writers != NULL ){ acq->writers->files = segment->files; }
+
+        for(int i = 0; i < config->files_count; i++)
+        {
+            real_file_sizes[i] = 0;
+        }
+    }
+
+    printf("Новые файлы созданы\n");
+
+    write_stats_file(STATS_FILE_NAME);
+
+    return E502M_ERR_OK;
+}
+
+static void observe_block_time(acquisition* acq, data_block* block, int size)
+{
+    if(size <= 0){ return; }
+
+    clock_model* clock = &acq->clock;
+
+    // time of return from X502_Recv is time of last sample of block
+    clock_model_add(clock, (double)(block->sample_index + size), block->mono_us);
+
+    if(clock->rejected)
+    {
+        stats_set(&acq->stats.clock_outliers, clock->outliers);
+        return;
+    }
+
+    stats_set(&acq->stats.clock_residual_us, (long long)clock_model_residual(clock));
+    stats_set(&acq->stats.clock_residual_us_max, (long long)clock->residual_max);
+    stats_set(&acq->stats.clock_drift_ppb, (long long)(clock_model_drift_ppm(clock) * 1000));
+}
+
+static long long sample_wall_us(acquisition* acq, long long index)
+{
+    clock_model* clock = &acq->clock;
+
+    return acq->wall_offset_us + clock->y0 +
+           (long long)clock_model_time(clock, (double)index, clock->y0);
+}
+
+static void refresh_wall_offset(acquisition* acq)
+{
+    long long offset = update_wall_offset();
+    long long step = offset - acq->wall_offset_us;
+
+    if(step > WALL_STEP_LOG_US || step < -WALL_STEP_LOG_US)
+    {
+        char log_msg[200] = "";
+        sprintf(log_msg, "Системное время изменилось на %lld мкс относительно монотонного", step);
+        logg(log_msg);
+    }
+
+    acq->wall_offset_us = offset;
+}
+
+static long long next_segment_boundary(acquisition* acq, long long index, long long first_sample)
+{
+    clock_model* clock = &acq->clock;
+    int channel_count = acq->config->channel_count;
+    double segment_us = acq->config->file_size * 1000000.;
+
+    // grid of boundaries in time from y0
+    double origin_us = clock_model_time(clock, (double)first_sample, clock->y0);
+    double elapsed_us = clock_model_time(clock, (double)index, clock->y0) - origin_us;
+
+    long long k = (long long)floor(elapsed_us / segment_us) + 1;
+
+    double boundary = clock_model_index(clock, clock->y0, origin_us + k * segment_us);
+
+    long long frames = (long long)ceil((boundary - first_sample) / channel_count);
+    long long next = first_sample + frames * channel_count;
+
+    // index is at boundary already because of rounding
+    if(next <= index){ next += channel_count; }
+
+    return next;
+}
+
+static void get_clock_quality(acquisition* acq, clock_quality* clock)
+{
+    clock->rate = clock_model_rate(&acq->clock) / acq->config->channel_count;
+    clock->drift_ppm = clock_model_drift_ppm(&acq->clock);
+    clock->residual_us = clock_model_residual(&acq->clock);
+    clock->residual_max_us = acq->clock.residual_max;
+    clock->outliers = acq->clock.outliers;
+    clock->wall_offset_us = acq->wall_offset_us;
+}
+
+static void update_preroll(acquisition* acq, data_block* block, int size)
+{
+    preroll_ring* ring = acq->preroll;
+
+    if( block->fdata != NULL )
+    {
+        push_preroll_samples(ring, block->fdata, 1, size, block->sample_index);
+    } else {
+        push_preroll_samples(ring, block->data, 0, size, block->sample_index);
+    }
+
+    if( !preroll_snapshot_requested(ring) ){ return; }
+
+    long long first_sample;
+    long long end_sample;
+
+    get_preroll_range(ring, &first_sample, &end_sample);
+
+    // exact times of range are given by clock model
+    take_preroll_snapshot(ring,
+                          first_sample,
+                          end_sample,
+                          sample_wall_us(acq, first_sample),
+                          sample_wall_us(acq, end_sample));
+}
+
+static void set_header_time(header* hdr, long long start_us, long long finish_us)
+{
+    struct tm ts;
+    time_t seconds = start_us / 1000000;
+
+    // headers of modules are filled in different threads
+    gmtime_r(&seconds, &ts);
+
+    hdr->start_year         = 1900 + ts.tm_year;
+    hdr->start_month        = ts.tm_mon + 1;
+    hdr->start_day          = ts.tm_mday;
+    hdr->start_hour         = ts.tm_hour;
+    hdr->start_minut        = ts.tm_min;
+    hdr->start_second       = ts.tm_sec;
+    hdr->start_usecond      = (int)(start_us % 1000000);
+
+    seconds = finish_us / 1000000;
+    gmtime_r(&seconds, &ts);
+
+    hdr->finish_year        = 1900 + ts.tm_year;
+    hdr->finish_month       = ts.tm_mon + 1;
+    hdr->finish_day         = ts.tm_mday;
+    hdr->finish_hour        = ts.tm_hour;
+    hdr->finish_minut       = ts.tm_min;
+    hdr->finish_second      = ts.tm_sec;
+    hdr->finish_usecond     = (int)(finish_us % 1000000);
+}
@@ -0,0 +1,130 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "acquisition.h" contains declaration of data
+    collection from one module. Each module has own
+    receiving thread, queue, conversion threads and
+    writing thread, so modules don't wait for each other.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include "spsc_ring.h"
+#include "block_pool.h"
+#include "spill.h"
+#include "conversion.h"
+#include "adc_convert.h"
+#include "config.h"
+#include "header.h"
+#include "route.h"
+#include "writer.h"
+#include "segment.h"
+#include "raw_capture.h"
+#include "autotune.h"
+#include "merge.h"
+#include "continuity.h"
+#include "clock_model.h"
+#include "preroll.h"
+#include "stats.h"
+#include "e502api.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+
+typedef struct {
+    e502monitor_config* config;        // configuration of module
+    t_x502_hnd        device_hnd;
+    char              serial[33];      // serial number of opened module
+    int*              stop;            // 1 - stop receiving
+
+    header            hdr;             // header with information
+    spsc_ring*        data_ring;       // queue for stored data
+    block_pool*       block_pool;      // preallocated buffers for data
+    int               pool_blocks_count;
+    block_pool*       spill_pool;      // blocks for receiving when pool is exhausted
+    spsc_ring*        spill_ring;      // blocks passed to backlog thread
+    spill_backlog*    spill_backlog;   // file for blocks which don't fit in queue,
+                                       //  used only by backlog thread
+    int               spill_pending;   // blocks in spill_ring and backlog file, while
+                                       //  it isn't 0 only backlog thread fills queue
+    int               spill_done;      // 1 - receiving thread is finished
+    long long         received_samples;// index of next received sample
+    continuity_checker continuity;     // order of channels in received words
+    int               next_gap_cause;  // cause of gap before next received block
+    clock_model       clock;           // index of sample -> monotonic time of module,
+                                       //  used only by writing thread, merge stage
+                                       //  gets its copy with each block
+    long long         wall_offset_us;  // wall time minus monotonic time for times of
+                                       //  current segment, measured at its start
+    conversion_stage* conversion;      // threads for conversion of raw data
+    adc_converter     adc_converter;   // native converter of raw data
+    routing_plan*     routing_plan;    // distribution of channels by files
+    writer_group*     writers;         // threads for writing of files
+    segment_rotator*  rotator;         // current and next output files
+    raw_segment*      raw_segment;     // current raw file in raw capture mode
+    t_x502_cbr        raw_cbr;         // calibration written in raw files
+    int               raw_cbr_valid;   // 1 - raw_cbr is read from module
+    block_tuning      tuning;          // sizes of reads and driver buffer
+    module_stats      stats;           // counters of module in stats file
+    long long         last_recv_end;   // time of end of previous X502_Recv (us)
+    merge_stage*      merge;           // merged output of modules (NULL - off),
+    int               merge_input;     //  set before start of acquisition
+    preroll_ring*     preroll;         // last seconds for snapshot (NULL - off)
+
+    int               receive_done;    // 1 - all received blocks are in queue
+    int               probe_done;      // 1 - measurement of latency must finish
+    int               started;         // 1 - threads are running
+    pthread_t         receive_thread;
+    pthread_t         write_thread;
+    pthread_t         spill_thread;
+    pthread_t         probe_thread;    // measures latency of scheduling of receiving thread
+} acquisition;
+
+/*
+    Creates queue and blocks of module.
+
+    config - configuration of module, acquisition
+             becomes owner of it
+    stop   - pointer to flag of stop of program
+
+    Returns pointer to acquisition or NULL if something was wrong.
+*/
+acquisition* create_acquisition(e502monitor_config* config, int* stop);
+
+/*
+    Opens and configures module, creates output files
+    and starts receiving and writing threads.
+
+    acq         - acquisition
+    devrec      - record of module
+    start_time  - time of start of first files
+
+    Returns error index.
+*/
+int start_acquisition(acquisition* acq, t_x502_devrec* devrec, struct timeval* start_time);
+
+/*
+    Waits until receiving thread is stopped and all
+    received data is written. Called after *stop is set.
+*/
+void wait_acquisition(acquisition* acq);
+
+/*
+    Asks for snapshot of the last seconds of module.
+    Can be called from any thread.
+*/
+void request_snapshot(acquisition* acq);
+
+/*
+    Closes module and frees memory.
+
+    acq - pointer to pointer to acquisition
+*/
+void destroy_acquisition(acquisition** acq);
+
+#endif // ACQUISITION_H
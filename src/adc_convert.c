@@ -0,0 +1,356 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "adc_convert.c" contains realization of converter
+    of raw ADC words to volts.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "adc_convert.h"
+
+#include <immintrin.h>
+
+#define ADC_TAG_MASK (ADC_WORD_FLAG | ADC_WORD_CH_MASK)
+
+// Upper bounds of ranges in volts (X502_ADC_RANGE_*)
+static const double range_volts[X502_ADC_RANGE_CNT] = { 10., 5., 2., 1., 0.5, 0.2 };
+
+int init_adc_converter(adc_converter* conv,
+                       e502monitor_config* config,
+                       t_x502_cbr* cbr)
+{
+    if(config->channel_count < 1 || config->channel_count > MAX_CHANNELS){ return E502M_ERR; }
+
+    conv->channel_count = config->channel_count;
+    conv->use_offsets = 0;
+
+    for(int i = 0; i < ADC_TABLE_SIZE; i++)
+    {
+        int lch = i % conv->channel_count;
+        int range = config->channel_ranges[lch];
+
+        if(range < 0 || range >= X502_ADC_RANGE_CNT){ return E502M_ERR; }
+
+        double scale = range_volts[range] / X502_ADC_SCALE_CODE_MAX;
+        double offset = 0.;
+
+        // module corrects codes as (code + offs) * k
+        if(cbr != NULL)
+        {
+            offset = cbr->adc[range].offs * cbr->adc[range].k * scale;
+            scale *= cbr->adc[range].k;
+
+            if(offset != 0.){ conv->use_offsets = 1; }
+        }
+
+        conv->scales[i] = scale;
+        conv->offsets[i] = offset;
+        conv->tags[i] = ADC_WORD_FLAG |
+                        (((uint32_t)config->channel_numbers[lch] << ADC_WORD_CH_SHIFT) & ADC_WORD_CH_MASK);
+    }
+
+    conv->isa = ADC_ISA_SCALAR;
+
+    if( set_adc_converter_isa(conv, ADC_ISA_AVX2) != E502M_ERR_OK )
+    {
+        set_adc_converter_isa(conv, ADC_ISA_SSE41);
+    }
+
+    return E502M_ERR_OK;
+}
+
+int set_adc_converter_isa(adc_converter* conv, int isa)
+{
+    __builtin_cpu_init();
+
+    if( isa == ADC_ISA_AVX2 && !__builtin_cpu_supports("avx2") ){ return E502M_ERR; }
+    if( isa == ADC_ISA_SSE41 && !__builtin_cpu_supports("sse4.1") ){ return E502M_ERR; }
+
+    if( isa != ADC_ISA_SCALAR && isa != ADC_ISA_SSE41 && isa != ADC_ISA_AVX2 ){ return E502M_ERR; }
+
+    conv->isa = isa;
+
+    return E502M_ERR_OK;
+}
+
+double adc_full_scale_volts(int range)
+{
+    if(range < 0 || range >= X502_ADC_RANGE_CNT){ range = 0; }
+
+    return range_volts[range] * (1 << 23) / X502_ADC_SCALE_CODE_MAX;
+}
+
+const char* adc_isa_name(int isa)
+{
+    switch(isa)
+    {
+        case ADC_ISA_AVX2:  return "avx2";
+        case ADC_ISA_SSE41: return "sse4.1";
+        default:            return "scalar";
+    }
+}
+
+// Converts words from begin to end one by one. Words without
+// ADC data are skipped and don't move logical channel
+static void convert_scalar(adc_converter* conv,
+                           const uint32_t* raw,
+                           int begin,
+                           int end,
+                           int* lch,
+                           void* out,
+                           int out_float,
+                           int* samples,
+                           adc_convert_result* result)
+{
+    int ch = *lch;
+    int n = *samples;
+
+    for(int i = begin; i < end; i++)
+    {
+        uint32_t word = raw[i];
+
+        if( !(word & ADC_WORD_FLAG) )
+        {
+            result->skipped_words++;
+            continue;
+        }
+
+        if( (word & ADC_TAG_MASK) != conv->tags[ch] ){ result->channel_errors++; }
+
+        // sign extension of 24-bit code
+        int32_t code = (int32_t)(word << 8) >> 8;
+
+        double value = code * conv->scales[ch];
+        if(conv->use_offsets){ value += conv->offsets[ch]; }
+
+        if(out_float){ ((float*)out)[n++] = (float)value; }
+        else         { ((double*)out)[n++] = value; }
+
+        if(++ch == conv->channel_count){ ch = 0; }
+    }
+
+    *lch = ch;
+    *samples = n;
+}
+
+__attribute__((target("sse4.1")))
+static void convert_sse41(adc_converter* conv,
+                          const uint32_t* raw,
+                          int size,
+                          int* lch,
+                          void* out,
+                          int out_float,
+                          int* samples,
+                          adc_convert_result* result)
+{
+    const __m128i tag_mask = _mm_set1_epi32((int)ADC_TAG_MASK);
+
+    int ch = *lch;
+    int n = *samples;
+    int i = 0;
+
+    for(; i + 4 <= size; i += 4)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i*)(raw + i));
+        __m128i diff = _mm_xor_si128( _mm_and_si128(words, tag_mask),
+                                      _mm_loadu_si128((const __m128i*)&conv->tags[ch]) );
+
+        // there are words of other type or channel: convert them one by one
+        if( !_mm_testz_si128(diff, diff) )
+        {
+            convert_scalar(conv, raw, i, i + 4, &ch, out, out_float, &n, result);
+            continue;
+        }
+
+        __m128i codes = _mm_srai_epi32(_mm_slli_epi32(words, 8), 8);
+
+        __m128d lo = _mm_mul_pd( _mm_cvtepi32_pd(codes), _mm_loadu_pd(&conv->scales[ch]) );
+        __m128d hi = _mm_mul_pd( _mm_cvtepi32_pd(_mm_srli_si128(codes, 8)),
+                                 _mm_loadu_pd(&conv->scales[ch + 2]) );
+
+        if(conv->use_offsets)
+        {
+            lo = _mm_add_pd(lo, _mm_loadu_pd(&conv->offsets[ch]));
+            hi = _mm_add_pd(hi, _mm_loadu_pd(&conv->offsets[ch + 2]));
+        }
+
+        if(out_float)
+        {
+            _mm_storeu_ps( (float*)out + n, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)) );
+        }
+        else
+        {
+            _mm_storeu_pd((double*)out + n, lo);
+            _mm_storeu_pd((double*)out + n + 2, hi);
+        }
+
+        n += 4;
+        ch += 4;
+        while(ch >= conv->channel_count){ ch -= conv->channel_count; }
+    }
+
+    convert_scalar(conv, raw, i, size, &ch, out, out_float, &n, result);
+
+    *lch = ch;
+    *samples = n;
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(adc_converter* conv,
+                         const uint32_t* raw,
+                         int size,
+                         int* lch,
+                         void* out,
+                         int out_float,
+                         int* samples,
+                         adc_convert_result* result)
+{
+    const __m256i tag_mask = _mm256_set1_epi32((int)ADC_TAG_MASK);
+
+    int ch = *lch;
+    int n = *samples;
+    int i = 0;
+
+    for(; i + 8 <= size; i += 8)
+    {
+        __m256i words = _mm256_loadu_si256((const __m256i*)(raw + i));
+        __m256i diff = _mm256_xor_si256( _mm256_and_si256(words, tag_mask),
+                                         _mm256_loadu_si256((const __m256i*)&conv->tags[ch]) );
+
+        if( !_mm256_testz_si256(diff, diff) )
+        {
+            convert_scalar(conv, raw, i, i + 8, &ch, out, out_float, &n, result);
+            continue;
+        }
+
+        __m256i codes = _mm256_srai_epi32(_mm256_slli_epi32(words, 8), 8);
+
+        __m256d lo = _mm256_mul_pd( _mm256_cvtepi32_pd(_mm256_castsi256_si128(codes)),
+                                    _mm256_loadu_pd(&conv->scales[ch]) );
+        __m256d hi = _mm256_mul_pd( _mm256_cvtepi32_pd(_mm256_extracti128_si256(codes, 1)),
+                                    _mm256_loadu_pd(&conv->scales[ch + 4]) );
+
+        if(conv->use_offsets)
+        {
+            lo = _mm256_add_pd(lo, _mm256_loadu_pd(&conv->offsets[ch]));
+            hi = _mm256_add_pd(hi, _mm256_loadu_pd(&conv->offsets[ch + 4]));
+        }
+
+        if(out_float)
+        {
+            _mm256_storeu_ps( (float*)out + n,
+                              _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo)) );
+        }
+        else
+        {
+            _mm256_storeu_pd((double*)out + n, lo);
+            _mm256_storeu_pd((double*)out + n + 4, hi);
+        }
+
+        n += 8;
+        ch += 8;
+        while(ch >= conv->channel_count){ ch -= conv->channel_count; }
+    }
+
+    convert_scalar(conv, raw, i, size, &ch, out, out_float, &n, result);
+
+    *lch = ch;
+    *samples = n;
+}
+
+static int convert(adc_converter* conv,
+                   const uint32_t* raw,
+                   int size,
+                   int first_lch,
+                   void* out,
+                   int out_float,
+                   adc_convert_result* result)
+{
+    adc_convert_result local;
+    if(result == NULL){ result = &local; }
+
+    result->skipped_words = 0;
+    result->channel_errors = 0;
+
+    int lch = first_lch % conv->channel_count;
+    int samples = 0;
+
+    switch(conv->isa)
+    {
+        case ADC_ISA_AVX2:
+            convert_avx2(conv, raw, size, &lch, out, out_float, &samples, result);
+            break;
+        case ADC_ISA_SSE41:
+            convert_sse41(conv, raw, size, &lch, out, out_float, &samples, result);
+            break;
+        default:
+            convert_scalar(conv, raw, 0, size, &lch, out, out_float, &samples, result);
+    }
+
+    result->samples = samples;
+
+    return samples;
+}
+
+int adc_convert_double(adc_converter* conv,
+                       const uint32_t* raw,
+                       int size,
+                       int first_lch,
+                       double* out,
+                       adc_convert_result* result)
+{
+    return convert(conv, raw, size, first_lch, out, 0, result);
+}
+
+int adc_convert_float(adc_converter* conv,
+                      const uint32_t* raw,
+                      int size,
+                      int first_lch,
+                      float* out,
+                      adc_convert_result* result)
+{
+    return convert(conv, raw, size, first_lch, out, 1, result);
+}
+
+__attribute__((target("avx")))
+static int narrow_avx(const double* in, int size, float* out)
+{
+    int i = 0;
+
+    for(; i + 8 <= size; i += 8)
+    {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+
+        _mm256_storeu_ps(out + i, _mm256_set_m128(hi, lo));
+    }
+
+    return i;
+}
+
+// SSE2 is always available on x86-64
+static int narrow_sse2(const double* in, int size, float* out)
+{
+    int i = 0;
+
+    for(; i + 4 <= size; i += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+
+    return i;
+}
+
+void adc_narrow_samples(const double* in, int size, float* out)
+{
+    int i = __builtin_cpu_supports("avx") ? narrow_avx(in, size, out)
+                                          : narrow_sse2(in, size, out);
+
+    for(; i < size; i++){ out[i] = (float)in[i]; }
+}
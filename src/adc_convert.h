@@ -0,0 +1,135 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "adc_convert.h" contains declaration of converter
+    of raw ADC words to volts. It is used instead of
+    X502_ProcessData for streams with ADC data only.
+
+    Each ADC word contains flag of ADC data (bit 31),
+    number of physical channel (bits 24-27) and signed
+    24-bit code. Code is scaled to volts by range of
+    logical channel. Calibration coefficients are applied
+    by module itself, so they are used here only if
+    software_calibration is set in configuration.
+
+    Conversion is vectorized with AVX2 or SSE4.1.
+    Instruction set is chosen at runtime.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef ADC_CONVERT_H
+#define ADC_CONVERT_H
+
+#include "config.h"
+#include "common.h"
+#include "e502api.h"
+
+#include <stdint.h>
+
+#define ADC_ISA_SCALAR 0
+#define ADC_ISA_SSE41  1
+#define ADC_ISA_AVX2   2
+
+#define ADC_WORD_FLAG     0x80000000 // word contains ADC data
+#define ADC_WORD_CH_MASK  0x0F000000 // number of physical channel
+#define ADC_WORD_CH_SHIFT 24
+
+// Length of periodic tables: channels + one vector
+#define ADC_TABLE_SIZE (MAX_CHANNELS + 8)
+
+typedef struct {
+    int      channel_count;
+    int      isa;                       // used instruction set
+
+    // tables repeat values of logical channels, so vector
+    // of consecutive samples can be loaded from any channel
+    double   scales[ADC_TABLE_SIZE];    // volts per code
+    double   offsets[ADC_TABLE_SIZE];   // volts added after scaling
+    uint32_t tags[ADC_TABLE_SIZE];      // expected flag and channel bits
+    int      use_offsets;               // 1 - offsets aren't zero
+} adc_converter;
+
+typedef struct {
+    int samples;        // count of converted samples
+    int skipped_words;  // count of words without ADC data
+    int channel_errors; // count of samples from unexpected channel
+} adc_convert_result;
+
+/*
+    Initializes converter by configuration.
+
+    conv     - converter
+    config   - configuration with channels and ranges
+    cbr      - calibration coefficients of module
+               (NULL - calibration is done by module)
+
+    Returns error index.
+*/
+int init_adc_converter(adc_converter* conv,
+                       e502monitor_config* config,
+                       t_x502_cbr* cbr);
+
+/*
+    Chooses instruction set for conversion.
+
+    Returns error index. If processor doesn't support
+    instruction set, converter isn't changed.
+*/
+int set_adc_converter_isa(adc_converter* conv, int isa);
+
+/*
+    Returns voltage of code 2^23 (full scale of 24-bit
+    code) for range of channel. It is used for scaling
+    of samples in PCM formats, so PCM24 keeps codes as is.
+*/
+double adc_full_scale_volts(int range);
+
+/*
+    Returns name of instruction set.
+*/
+const char* adc_isa_name(int isa);
+
+/*
+    Converts raw words to volts.
+
+    conv      - converter
+    raw       - raw words from module
+    size      - count of raw words
+    first_lch - logical channel of first word
+    out       - array for samples (at least size items)
+    result    - counters of conversion (may be NULL)
+
+    Returns count of converted samples.
+*/
+int adc_convert_double(adc_converter* conv,
+                       const uint32_t* raw,
+                       int size,
+                       int first_lch,
+                       double* out,
+                       adc_convert_result* result);
+
+/*
+    The same as adc_convert_double, but writes float samples.
+*/
+int adc_convert_float(adc_converter* conv,
+                      const uint32_t* raw,
+                      int size,
+                      int first_lch,
+                      float* out,
+                      adc_convert_result* result);
+
+/*
+    Converts double samples to float by vectors. It is
+    used on float32 path after X502_ProcessData, which
+    returns only double samples.
+
+    in   - double samples
+    size - count of samples
+    out  - array for float samples
+*/
+void adc_narrow_samples(const double* in, int size, float* out);
+
+#endif // ADC_CONVERT_H
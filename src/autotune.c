@@ -0,0 +1,123 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "autotune.c" contains realization of automatic
+    tuning of read block size.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "autotune.h"
+#include "logging.h"
+#include "stats.h"
+
+#include <stdio.h>
+
+void init_block_tuning(block_tuning* tuning, e502monitor_config* config)
+{
+    tuning->blocks = 0;
+    tuning->ready_total = 0;
+    tuning->queue_max = 0;
+
+    if(!config->auto_tune)
+    {
+        tuning->enabled = 0;
+        tuning->min_block_size = config->read_block_size;
+        tuning->max_block_size = config->read_block_size;
+        tuning->block_size = config->read_block_size;
+        tuning->driver_buffer_size = 0;
+        tuning->read_timeout = config->read_timeout;
+
+        return;
+    }
+
+    // words of all channels per second
+    double rate = config->adc_freq * config->channel_count;
+
+    long long block = (long long)(rate * config->latency_ms / 1000.0);
+
+    if(block < TUNE_MIN_BLOCK_SIZE){ block = TUNE_MIN_BLOCK_SIZE; }
+    if(block > TUNE_MAX_BLOCK_SIZE){ block = TUNE_MAX_BLOCK_SIZE; }
+
+    // block starts from the same logical channel
+    block -= block % config->channel_count;
+
+    long long max_block = block * TUNE_MAX_BLOCK_FACTOR;
+
+    while(max_block > TUNE_MAX_BLOCK_SIZE){ max_block /= 2; }
+
+    long long driver_buffer = (long long)(rate * TUNE_DRIVER_BUFFER_MS / 1000.0);
+
+    if(driver_buffer < 4 * max_block){ driver_buffer = 4 * max_block; }
+
+    tuning->enabled = 1;
+    tuning->min_block_size = (int)block;
+    tuning->max_block_size = (int)max_block;
+    tuning->block_size = (int)block;
+    tuning->driver_buffer_size = (int)driver_buffer;
+    tuning->read_timeout = (int)(max_block * 1000 / rate) + TUNE_TIMEOUT_MARGIN_MS;
+
+    char log_msg[300] = "";
+    sprintf(log_msg,
+            "Автонастройка: блок %d отсчетов (до %d), буфер драйвера %d отсчетов, таймаут %d мс",
+            tuning->block_size,
+            tuning->max_block_size,
+            tuning->driver_buffer_size,
+            tuning->read_timeout);
+    logg(log_msg);
+}
+
+int tune_block_size(block_tuning* tuning,
+                    uint32_t ready_count,
+                    int queue_size,
+                    int queue_capacity)
+{
+    if(!tuning->enabled){ return 0; }
+
+    tuning->blocks++;
+    tuning->ready_total += ready_count;
+
+    if(queue_size > tuning->queue_max){ tuning->queue_max = queue_size; }
+
+    if(tuning->blocks < TUNE_INTERVAL_BLOCKS){ return 0; }
+
+    long long ready_avg = tuning->ready_total / tuning->blocks;
+    int queue_max = tuning->queue_max;
+
+    tuning->blocks = 0;
+    tuning->ready_total = 0;
+    tuning->queue_max = 0;
+
+    int block_size = tuning->block_size;
+
+    // reading falls behind module or writer falls behind reading:
+    // larger blocks need fewer calls and the same queue keeps more data
+    if( ready_avg > block_size || queue_max > queue_capacity / 2 )
+    {
+        if(block_size * 2 <= tuning->max_block_size){ block_size *= 2; }
+    }
+    // data doesn't wait anywhere, latency is lowered
+    else if( ready_avg < block_size / 4 && queue_max <= 1 )
+    {
+        if(block_size / 2 >= tuning->min_block_size){ block_size /= 2; }
+    }
+
+    if(block_size == tuning->block_size){ return 0; }
+
+    char log_msg[300] = "";
+    sprintf(log_msg,
+            "Размер блока чтения: %d -> %d (в буфере драйвера %lld, в очереди %d)",
+            tuning->block_size,
+            block_size,
+            ready_avg,
+            queue_max);
+    logg(log_msg);
+
+    tuning->block_size = block_size;
+
+    stats_add(&g_stats.read_block_changes, 1);
+
+    return 1;
+}
@@ -0,0 +1,69 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "autotune.h" contains declaration of automatic tuning
+    of size of read block and stream buffer of driver.
+    Initial block holds samples of latency_ms milliseconds
+    of all channels. While program is working block grows
+    if data waits in buffer of driver or writer falls behind,
+    and returns to initial size when load is gone.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+#define TUNE_MIN_BLOCK_SIZE    1024    // words
+#define TUNE_MAX_BLOCK_SIZE    4194304 // words (16 MB of raw data)
+#define TUNE_MAX_BLOCK_FACTOR  8       // max block / initial block
+#define TUNE_DRIVER_BUFFER_MS  2000    // data kept by driver while program is busy
+#define TUNE_TIMEOUT_MARGIN_MS 100     // added to duration of largest block
+#define TUNE_INTERVAL_BLOCKS   16      // blocks between changes of size
+
+typedef struct {
+    int       enabled;            // 1 - block size is changed at runtime
+    int       min_block_size;     // block of latency target
+    int       max_block_size;     // capacity of blocks of pool
+    int       block_size;         // current size of read
+    int       driver_buffer_size; // stream buffer of driver in words (0 - default)
+    int       read_timeout;       // timeout of receiving in ms
+
+    int       blocks;             // blocks in current measurement
+    long long ready_total;        // sum of words waiting in driver after reads
+    int       queue_max;          // max count of blocks in queue
+} block_tuning;
+
+/*
+    Calculates initial values from configuration.
+    Without auto_tune all sizes are taken from
+    configuration and don't change.
+
+    tuning - structure for filling
+    config - configuration
+*/
+void init_block_tuning(block_tuning* tuning, e502monitor_config* config);
+
+/*
+    Takes measurement after one read and changes
+    size of block after each TUNE_INTERVAL_BLOCKS reads.
+
+    tuning         - tuning
+    ready_count    - words waiting in buffer of driver
+    queue_size     - blocks waiting for writing
+    queue_capacity - max count of blocks in queue
+
+    Returns 1 if size of block was changed, 0 otherwise.
+*/
+int tune_block_size(block_tuning* tuning,
+                    uint32_t ready_count,
+                    int queue_size,
+                    int queue_capacity);
+
+#endif // AUTOTUNE_H
@@ -0,0 +1,173 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "block_pool.c" contains realization of fixed-size
+    pool of data blocks.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "block_pool.h"
+#include "stats.h"
+
+#include <stdlib.h>
+
+block_pool* create_block_pool(int block_size, int blocks_count, int sample_path, int huge_pages)
+{
+    block_pool* pool = (block_pool*)malloc(sizeof(block_pool));
+
+    if(pool == NULL){ return NULL; }
+
+    size_t words = (size_t)block_size * blocks_count;
+
+    pool->sample_path = sample_path;
+    pool->min_free = NULL;
+    pool->sample_bytes = sample_path == SAMPLE_PATH_FLOAT32 ? sizeof(float) : sizeof(double);
+
+    pool->blocks = (data_block*)malloc(sizeof(data_block) * blocks_count);
+    pool->raw_memory = (uint32_t*)alloc_sample_memory(&pool->raw_mapping,
+                                                      sizeof(uint32_t) * words,
+                                                      huge_pages);
+    pool->data_memory = alloc_sample_memory(&pool->data_mapping,
+                                            pool->sample_bytes * words,
+                                            huge_pages);
+
+    if( pool->blocks == NULL || pool->raw_memory == NULL || pool->data_memory == NULL )
+    {
+        free(pool->blocks);
+        free_sample_memory(&pool->raw_mapping);
+        free_sample_memory(&pool->data_mapping);
+        free(pool);
+
+        return NULL;
+    }
+
+    pool->blocks_count = blocks_count;
+    pool->block_size = block_size;
+    pool->free_head = NULL;
+
+    for(int i = blocks_count - 1; i >= 0; i--)
+    {
+        data_block* block = &pool->blocks[i];
+
+        block->raw = pool->raw_memory + (size_t)i * block_size;
+        block->data = NULL;
+        block->fdata = NULL;
+
+        if(sample_path == SAMPLE_PATH_FLOAT32)
+        {
+            block->fdata = (float*)pool->data_memory + (size_t)i * block_size;
+        } else {
+            block->data = (double*)pool->data_memory + (size_t)i * block_size;
+        }
+
+        block->capacity = block_size;
+        block->data_size = 0;
+        block->ready = 0;
+        block->sample_index = 0;
+        block->refs = 0;
+
+        block->next_free = pool->free_head;
+        pool->free_head = block;
+    }
+
+    pool->free_count = blocks_count;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->released, NULL);
+
+    return pool;
+}
+
+void destroy_block_pool(block_pool** pool)
+{
+    pthread_mutex_destroy(&(*pool)->mutex);
+    pthread_cond_destroy(&(*pool)->released);
+
+    free((*pool)->blocks);
+    free_sample_memory(&(*pool)->raw_mapping);
+    free_sample_memory(&(*pool)->data_mapping);
+
+    free(*pool);
+    *pool = NULL;
+}
+
+// Removes first block from free list. Mutex must be locked
+static data_block* take_free_block(block_pool* pool)
+{
+    data_block* block = pool->free_head;
+    pool->free_head = block->next_free;
+    pool->free_count--;
+
+    block->next_free = NULL;
+    block->refs = 1;
+
+    if(pool->min_free != NULL){ stats_update_min(pool->min_free, pool->free_count); }
+
+    return block;
+}
+
+data_block* acquire_block(block_pool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    while(pool->free_head == NULL)
+    {
+        pthread_cond_wait(&pool->released, &pool->mutex);
+    }
+
+    data_block* block = take_free_block(pool);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return block;
+}
+
+data_block* try_acquire_block(block_pool* pool)
+{
+    data_block* block = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if(pool->free_head != NULL){ block = take_free_block(pool); }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return block;
+}
+
+void retain_block(data_block* block)
+{
+    __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+}
+
+void release_block(block_pool* pool, data_block* block)
+{
+    if( __atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) != 0 ){ return; }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    block->next_free = pool->free_head;
+    pool->free_head = block;
+    pool->free_count++;
+
+    pthread_cond_signal(&pool->released);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int free_blocks_count(block_pool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    int count = pool->free_count;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return count;
+}
+
+int block_in_pool(block_pool* pool, data_block* block)
+{
+    return block >= pool->blocks && block < pool->blocks + pool->blocks_count ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "block_pool.h" contains declaration of fixed-size
+    pool of data blocks. All buffers for received and
+    converted data are allocated once at startup and
+    reused, so the receive loop doesn't call malloc.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include "hugemem.h"
+
+#include <stdint.h>
+#include <pthread.h>
+
+typedef struct data_block {
+    uint32_t* raw;      // raw words received from module
+    double*   data;     // samples converted to volts (double path)
+    float*    fdata;    // samples converted to volts (float32 path)
+    int       capacity; // max count of words in block
+    int       data_size; // count of converted samples
+    int       ready;     // 1 - data is converted
+    int       lost;      // 1 - module was closed before conversion,
+                         //  samples of block are gap
+    long long sample_index; // index of first sample of block
+                            //  from start of data collection
+    long long mono_us;      // monotonic time of return from X502_Recv (us)
+    int       gap_cause;    // cause of lost data before block (0 - none)
+    int       refs;     // count of owners of the block
+
+    struct data_block* next_free; // next block in list of free blocks
+} data_block;
+
+typedef struct {
+    data_block* blocks;       // all blocks of pool
+    int         blocks_count; // count of blocks in pool
+    int         block_size;   // capacity of each block (in words)
+
+    uint32_t*   raw_memory;   // memory for raw buffers of all blocks
+    void*       data_memory;  // memory for converted buffers of all blocks
+    int         sample_path;  // type of converted samples (SAMPLE_PATH_*)
+    int         sample_bytes; // size of converted sample
+    sample_memory raw_mapping;  // pages of raw_memory
+    sample_memory data_mapping; // pages of data_memory
+
+    data_block* free_head;    // list of free blocks
+    int         free_count;   // count of free blocks
+    long long*  min_free;     // counter of minimal count of free blocks
+                              //  in stats (NULL - not counted)
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  released; // signaled when block returns in pool
+} block_pool;
+
+/*
+    Creates pool of blocks.
+
+    block_size   - count of words in each block.
+    blocks_count - count of blocks in pool.
+    sample_path  - type of converted samples (SAMPLE_PATH_*),
+                   only data or only fdata of blocks is allocated
+    huge_pages   - pages of buffers of blocks (HUGE_PAGES_*)
+
+    Returns pointer to pool or NULL if memory
+    wasn't allocated.
+*/
+block_pool* create_block_pool(int block_size, int blocks_count, int sample_path, int huge_pages);
+
+/*
+    Frees all memory of pool. All blocks
+    become invalid.
+
+    pool - pointer to pointer to pool
+*/
+void destroy_block_pool(block_pool** pool);
+
+/*
+    Takes free block from pool. If there are no
+    free blocks waits until some block will be
+    released.
+
+    Returns block with one reference.
+*/
+data_block* acquire_block(block_pool* pool);
+
+/*
+    Takes free block from pool without waiting.
+
+    Returns block with one reference or NULL
+    if pool is exhausted.
+*/
+data_block* try_acquire_block(block_pool* pool);
+
+/*
+    Adds one more owner to the block.
+*/
+void retain_block(data_block* block);
+
+/*
+    Removes one owner of the block. When block has
+    no owners it returns in pool.
+*/
+void release_block(block_pool* pool, data_block* block);
+
+/*
+    Returns current count of free blocks.
+*/
+int free_blocks_count(block_pool* pool);
+
+/*
+    Returns 1 if block belongs to pool, 0 otherwise.
+*/
+int block_in_pool(block_pool* pool, data_block* block);
+
+#endif // BLOCK_POOL_H
@@ -0,0 +1,131 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "clock_model.c" contains realization of model of
+    clock of module.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "clock_model.h"
+
+#include <math.h>
+
+void init_clock_model(clock_model* model, double rate)
+{
+    model->nominal_us = 1000000. / rate;
+    model->count = 0;
+    model->y0 = 0;
+    model->weight = 0;
+    model->mean_x = 0;
+    model->mean_y = 0;
+    model->sxx = 0;
+    model->sxy = 0;
+    model->slope_us = model->nominal_us;
+    model->residual_ms = 0;
+    model->residual_max = 0;
+    model->outliers = 0;
+    model->rejects = 0;
+    model->rejected = 0;
+}
+
+// Observation is too far from model. Without
+// warmup spread of residuals isn't known yet
+static int is_outlier(clock_model* model, double residual)
+{
+    if(model->count < CLOCK_WARMUP || model->rejects >= CLOCK_MAX_REJECTS){ return 0; }
+
+    double limit = CLOCK_OUTLIER_SIGMA * sqrt(model->residual_ms);
+
+    if(limit < CLOCK_OUTLIER_MIN_US){ limit = CLOCK_OUTLIER_MIN_US; }
+
+    return fabs(residual) > limit;
+}
+
+double clock_model_add(clock_model* model, double sample_index, long long time_us)
+{
+    double residual = 0;
+
+    if(model->count == 0)
+    {
+        model->y0 = time_us;
+    } else {
+        residual = (double)(time_us - model->y0) - clock_model_time(model, sample_index, model->y0);
+    }
+
+    model->rejected = is_outlier(model, residual);
+
+    if(model->rejected)
+    {
+        model->outliers++;
+        model->rejects++;
+
+        return residual;
+    }
+
+    model->rejects = 0;
+
+    // times are kept from first observation for precision
+    double y = (double)(time_us - model->y0);
+
+    model->weight = CLOCK_FORGET * model->weight + 1;
+
+    double dx = sample_index - model->mean_x;
+    double dy = y - model->mean_y;
+
+    model->mean_x += dx / model->weight;
+    model->mean_y += dy / model->weight;
+
+    model->sxx = CLOCK_FORGET * model->sxx + dx * (sample_index - model->mean_x);
+    model->sxy = CLOCK_FORGET * model->sxy + dx * (y - model->mean_y);
+
+    model->count++;
+
+    if(model->count > 1)
+    {
+        model->residual_ms += (residual * residual - model->residual_ms) / model->weight;
+
+        // model isn't precise during warmup
+        if(model->count > CLOCK_WARMUP && fabs(residual) > model->residual_max)
+        {
+            model->residual_max = fabs(residual);
+        }
+    }
+
+    // slope is unknown until samples cover some time
+    if(model->count > 1 && model->sxx > 0)
+    {
+        model->slope_us = model->sxy / model->sxx;
+    }
+
+    return residual;
+}
+
+double clock_model_time(clock_model* model, double sample_index, long long base_us)
+{
+    return (double)(model->y0 - base_us) + model->mean_y +
+           model->slope_us * (sample_index - model->mean_x);
+}
+
+double clock_model_index(clock_model* model, long long base_us, double offset_us)
+{
+    return model->mean_x +
+           ((double)(base_us - model->y0) + offset_us - model->mean_y) / model->slope_us;
+}
+
+double clock_model_rate(clock_model* model)
+{
+    return 1000000. / model->slope_us;
+}
+
+double clock_model_drift_ppm(clock_model* model)
+{
+    return (model->nominal_us / model->slope_us - 1.) * 1e6;
+}
+
+double clock_model_residual(clock_model* model)
+{
+    return sqrt(model->residual_ms);
+}
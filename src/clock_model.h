@@ -0,0 +1,100 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "clock_model.h" contains declaration of model of
+    clock of module. Model is linear dependence of wall
+    time on index of sample, fitted by least squares with
+    exponential forgetting of old observations, so it
+    follows slow drift of clock of module.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef CLOCK_MODEL_H
+#define CLOCK_MODEL_H
+
+#define CLOCK_FORGET 0.999 // weight of old observations after new one
+
+#define CLOCK_WARMUP         10    // observations before rejection of outliers
+#define CLOCK_OUTLIER_SIGMA  4.0   // outlier is farther than this count of rms residuals
+#define CLOCK_OUTLIER_MIN_US 100.0 // and farther than this time
+#define CLOCK_MAX_REJECTS    20    // after so many outliers in row observation is accepted
+
+typedef struct {
+    double    nominal_us;  // nominal time between samples
+    long long count;       // count of observations
+    long long y0;          // time of first observation (us)
+    double    weight;      // sum of weights of observations
+    double    mean_x;      // weighted mean of sample indexes
+    double    mean_y;      // weighted mean of times from y0
+    double    sxx;         // weighted sums of centered products
+    double    sxy;
+    double    slope_us;    // estimated time between samples
+
+    double    residual_ms; // weighted mean square of residuals of accepted observations
+    double    residual_max;// max absolute residual of accepted observations
+    long long outliers;    // count of rejected observations
+    int       rejects;     // count of rejected observations in row
+    int       rejected;    // 1 - last observation was rejected
+} clock_model;
+
+/*
+    Initializes model.
+
+    model     - model
+    rate      - nominal count of samples per second
+*/
+void init_clock_model(clock_model* model, double rate);
+
+/*
+    Adds observation: sample with index was
+    received at wall time.
+
+    model        - model
+    sample_index - index of sample (may be fractional)
+    time_us      - wall time of sample (us from epoch)
+
+    Returns difference between time and time predicted
+    by model before observation (us). If difference is
+    too large, observation is rejected and model isn't
+    changed.
+*/
+double clock_model_add(clock_model* model, double sample_index, long long time_us);
+
+/*
+    Returns wall time of sample by model. Time is counted
+    from base_us, so microseconds from epoch don't lose
+    precision in double.
+
+    model        - model
+    sample_index - index of sample
+    base_us      - origin of returned time (us from epoch)
+*/
+double clock_model_time(clock_model* model, double sample_index, long long base_us);
+
+/*
+    Returns fractional index of sample at wall time
+    base_us + offset_us.
+*/
+double clock_model_index(clock_model* model, long long base_us, double offset_us);
+
+/*
+    Returns estimated count of samples per second.
+*/
+double clock_model_rate(clock_model* model);
+
+/*
+    Returns deviation of estimated rate from nominal
+    rate in parts per million.
+*/
+double clock_model_drift_ppm(clock_model* model);
+
+/*
+    Returns rms residual of accepted observations (us).
+    It shows how precisely model defines time of samples.
+*/
+double clock_model_residual(clock_model* model);
+
+#endif // CLOCK_MODEL_H
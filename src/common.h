@@ -17,10 +17,23 @@
 
 #define MAX_CHANNELS 16
 
+#define MAX_PINNED_CPU 63 // cores of threads are stored in 64-bit mask
+
 #define TCP_CONNECTION_TOUT 5000
 
 #define VERSION "0.8"
 
 #define MAX_FREQUENCY 2000000
 
+#define DEFAULT_QUEUE_DEPTH 8
+
+#define DEFAULT_CONVERSION_THREADS 1
+
+#define DEFAULT_WRITE_BATCH_FRAMES 0
+#define DEFAULT_WRITER_THREADS 0
+
+#define DEFAULT_LATENCY_MS 100
+
+#define RECONNECT_RETRY_MS 100 // pause between attempts to open module
+
 #endif // COMMON_H
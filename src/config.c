@@ -11,6 +11,7 @@
 
 #include "config.h"
 #include "common.h"
+#include "hugemem.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +21,65 @@
 #include <libconfig.h>
 
 static char path_to_config[256] = ""; // path to configuration file 
+static char device_prefix[32] = "";   // path of section of module in "devices" list
+
+// Returns path of option in section of module if
+// option is set there, otherwise path of common option
+static const char* option_path(config_t* cfg, const char* name)
+{
+    static char path[128];
+
+    if(device_prefix[0] == '\0'){ return name; }
+
+    snprintf(path, sizeof(path), "%s%s", device_prefix, name);
+
+    return config_lookup(cfg, path) != NULL ? path : name;
+}
+
+// Reads list of cores as bit mask. Missing
+// option means any core
+static int read_cpu_mask(config_t* cfg, const char* name, long long* mask)
+{
+    *mask = 0;
+
+    config_setting_t* cpus = config_lookup(cfg, option_path(cfg, name));
+
+    if(cpus == NULL){ return E502M_ERR_OK; }
+
+    for(int i = 0; i < config_setting_length(cpus); i++)
+    {
+        int cpu = config_setting_get_int_elem(cpus, i);
+
+        if(cpu < 0 || cpu > MAX_PINNED_CPU)
+        {
+            printf("Ошибка конфигурационного файла:	номер ядра в %s должен быть от 0 до %d!\n",
+                   name, MAX_PINNED_CPU);
+
+            return E502M_ERR;
+        }
+
+        *mask |= 1LL << cpu;
+    }
+
+    return E502M_ERR_OK;
+}
+
+/*
+    Loads configuration. Options of module with
+    device_index from "devices" list replace
+    common options.
+*/
+static int load_config(e502monitor_config **config, int device_index);
+
+int init_config(e502monitor_config **config)
+{
+    return load_config(config, -1);
+}
+
+int init_device_config(e502monitor_config **config, int device_index)
+{
+    return load_config(config, device_index);
+}
 
 int create_default_config()
 {
@@ -44,6 +104,84 @@ int create_default_config()
         "read_timeout = 2000\n",
         "\n",
 #endif // DBG
+        "# Автоматический подбор размера блока чтения и буфера драйвера\n",
+        "# по частоте сбора и допустимой задержке (1 - да, 0 - нет).\n",
+        "# Выбранные значения пишутся в журнал и в файл статистики\n",
+        "auto_tune = 0\n",
+        "\n",
+        "# Допустимая задержка приема данных в мс (для auto_tune = 1)\n",
+        "latency_ms = 100\n",
+        "\n",
+        "# Количество блоков, которые могут ожидать записи на диск.\n",
+        "# Вся память под блоки выделяется при запуске программы\n",
+        "queue_depth = 8\n",
+        "\n",
+        "# Ограничение памяти под очередь блоков в МБ (0 - без ограничения)\n",
+        "queue_memory_limit = 0\n",
+        "\n",
+        "# Действие при переполнении очереди:\n",
+        "#   \"block\"       - ждать освобождения блока\n",
+        "#   \"drop_oldest\" - удалить самый старый блок (в .prop-файле отмечается пропуск)\n",
+        "#   \"spill\"       - записывать блоки в файл буферизации и\n",
+        "#                   дописывать их в выходные файлы позже\n",
+        "overflow_policy = \"block\"\n",
+        "\n",
+        "# Директория для файла буферизации (по умолчанию bin_dir)\n",
+        "spill_dir = \"data\"\n",
+        "\n",
+        "# Количество потоков для перевода отсчетов АЦП в вольты\n",
+        "conversion_threads = 1\n",
+        "\n",
+        "# Способ перевода отсчетов в вольты:\n",
+        "#   \"x502\"   - функция X502_ProcessData (только один поток обработки)\n",
+        "#   \"native\" - векторизованный перевод (AVX2/SSE4.1), допускает\n",
+        "#              несколько потоков обработки\n",
+        "converter = \"x502\"\n",
+        "\n",
+        "# Применять калибровочные коэффициенты при переводе \"native\"\n",
+        "# (1 - да, 0 - нет, коэффициенты применяет модуль)\n",
+        "software_calibration = 0\n",
+        "\n",
+        "# Количество кадров, накапливаемых перед записью в файл\n",
+        "# (0 - записывать кадры каждого принятого блока)\n",
+        "write_batch_frames = 0\n",
+        "\n",
+        "# Количество потоков записи файлов. Файлы распределяются\n",
+        "# между потоками по очереди (0 - все файлы пишет один поток)\n",
+        "writer_threads = 0\n",
+        "\n",
+        "# Приоритет SCHED_FIFO потока приема данных (1..99, 0 - обычный поток).\n",
+        "# Нужны права root, CAP_SYS_NICE или limits rtprio, иначе поток\n",
+        "# остается обычным и в журнал пишется предупреждение\n",
+        "receive_priority = 0\n",
+        "\n",
+        "# Ядра для потоков приема, обработки, записи и завершения файлов.\n",
+        "# Например, receive_cpus = [2]. Без списка поток работает на любом ядре\n",
+        "# receive_cpus = [2]\n",
+        "# conversion_cpus = [3]\n",
+        "# writer_cpus = [4, 5]\n",
+        "# finisher_cpus = [0, 1]\n",
+        "\n",
+        "# Заполнить страницы буферов до начала сбора (1 - да, 0 - нет)\n",
+        "prefault_buffers = 0\n",
+        "\n",
+        "# Заблокировать память программы в ОЗУ (mlockall, 1 - да, 0 - нет).\n",
+        "# Без прав или при малом ulimit -l программа работает без блокировки\n",
+        "lock_memory = 0\n",
+        "\n",
+        "# Страницы памяти блоков очереди и буферов кадров:\n",
+        "#   \"off\"      - обычные страницы\n",
+        "#   \"thp\"      - прозрачные huge pages (madvise)\n",
+        "#   \"explicit\" - huge pages из vm.nr_hugepages (MAP_HUGETLB),\n",
+        "#                при нехватке используются thp\n",
+        "huge_pages = \"off\"\n",
+        "\n",
+        "# Тип отсчетов в блоках очереди:\n",
+        "#   \"double\"  - 64-битные отсчеты\n",
+        "#   \"float32\" - 32-битные отсчеты, вдвое меньше памяти и\n",
+        "#               обращений к ней (файлы и так хранят float)\n",
+        "sample_path = \"double\"\n",
+        "\n",
         "# Размер выходных файлов (в секундах) \n",
         "file_size = 900\n",
         "\n"
@@ -92,7 +230,58 @@ int create_default_config()
         "count_of_day = 3 \n",
         "\n",
         "# Распределение каналов по flac-файлам.\n"
-        "channel_distribution = ([1,2],[3,4])\n"
+        "channel_distribution = ([1,2],[3,4])\n",
+        "\n",
+        "# Формат отсчетов в файлах: \"float32\", \"double\", \"pcm16\", \"pcm24\".\n",
+        "# Одно значение для всех файлов или список для каждого файла.\n",
+        "# В pcm-форматах полная шкала соответствует максимальному коду\n",
+        "# диапазона канала, множитель для перевода в вольты записывается в .prop-файл\n",
+        "sample_format = \"float32\"\n",
+        "\n",
+        "# Запись выходных файлов:\n",
+        "#   \"sndfile\" - библиотека libsndfile\n",
+        "#   \"native\"  - потоковая запись большими блоками\n",
+        "# Файлы больше 4 ГБ записываются в формате RF64\n",
+        "wav_writer = \"sndfile\"\n",
+        "\n",
+        "# Режим записи:\n",
+        "#   \"wav\" - отсчеты в вольтах в wav-файлах\n",
+        "#   \"raw\" - необработанные слова модуля в raw-файлах без перевода\n",
+        "#           в вольты, wav-файлы создаются позже программой e502convert\n",
+        "capture_mode = \"wav\"\n",
+        "\n",
+        "# Несколько модулей. Каждый модуль задается серийным номером и может\n",
+        "# иметь свои channel_count, adc_freq, channel_numbers, channel_modes,\n",
+        "# channel_ranges, channel_names, channel_distribution, sample_format,\n",
+        "# bin_dir и spill_dir. Без своей bin_dir файлы модуля пишутся\n",
+        "# в <bin_dir>/<serial>. Свои bin_dir и spill_dir модулей не должны\n",
+        "# совпадать. Без списка используется первый найденный модуль\n",
+        "# devices = (\n",
+        "#     { serial = \"1T123456\"; channel_count = 1; channel_numbers = [0];\n",
+        "#       channel_modes = [1]; channel_ranges = [2]; channel_names = [\"ch0\"];\n",
+        "#       channel_distribution = ([0]); },\n",
+        "#     { serial = \"1T654321\"; bin_dir = \"data2\"; }\n",
+        "# )\n",
+        "\n",
+        "# Объединенные файлы всех модулей на общей шкале времени.\n",
+        "# Смещение и скорость часов каждого модуля оцениваются по времени\n",
+        "# получения блоков, частоты модулей должны совпадать:\n",
+        "#   \"off\"      - только файлы каждого модуля\n",
+        "#   \"nearest\"  - ближайший отсчет каждого модуля\n",
+        "#   \"resample\" - интерполяция отсчетов с дробной задержкой\n",
+        "merge = \"off\"\n",
+        "\n",
+        "# Директория объединенных файлов (по умолчанию <bin_dir>/merged)\n",
+        "# merge_dir = \"data/merged\"\n",
+        "\n",
+        "# Предзапись: последние секунды отсчетов всех каналов хранятся в ОЗУ\n",
+        "# (0 - выключено). По сигналу SIGUSR1 (kill -USR1 <pid>) они\n",
+        "# сохраняются в отдельный wav-файл, не дожидаясь конца текущих файлов.\n",
+        "# Память: (preroll_seconds + 5) * adc_freq * channel_count * 4 байт\n",
+        "preroll_seconds = 0\n",
+        "\n",
+        "# Директория снимков предзаписи (по умолчанию <bin_dir>/preroll)\n",
+        "# preroll_dir = \"data/preroll\"\n"
 
     };
 
@@ -115,10 +304,11 @@ int create_default_config()
     return E502M_ERR_OK;
 }
 
-int init_config(e502monitor_config **config)
+static int load_config(e502monitor_config **config, int device_index)
 {
     // get user name
     char* user_name = getenv("USER");
+    path_to_config[0] = '\0';
     strcat(path_to_config, "/home/");
     strcat(path_to_config, user_name);
     strcat(path_to_config, "/.config/e502monitor/e502monitor.cfg");
@@ -176,8 +366,43 @@ int init_config(e502monitor_config **config)
     }
 
     int found_value;
+    config_setting_t* devices = config_lookup(&cfg, "devices");
+
+    e502m_cfg->devices_count = devices != NULL ? config_setting_length(devices) : 0;
+    e502m_cfg->serial[0] = '\0';
+
+    if(device_index >= e502m_cfg->devices_count)
+    {
+        printf("Ошибка конфигурационного файла:	модуль %d не описан в devices!\n", device_index);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    if(device_index >= 0)
+    {
+        sprintf(device_prefix, "devices.[%d].", device_index);
+
+        char path[64] = "";
+        const char* serial;
+
+        sprintf(path, "%sserial", device_prefix);
+
+        if(config_lookup_string(&cfg, path, &serial) == CONFIG_FALSE)
+        {
+            printf("Ошибка конфигурационного файла:	не задан serial модуля %d!\n", device_index);
+
+            config_destroy(&cfg);
+            return E502M_ERR;
+        }
+
+        snprintf(e502m_cfg->serial, sizeof(e502m_cfg->serial), "%s", serial);
+    } else {
+        device_prefix[0] = '\0';
+    }
+
     int err = config_lookup_int(&cfg,
-                                "channel_count",
+                                option_path(&cfg, "channel_count"),
                                 &e502m_cfg->channel_count);
     if(err == CONFIG_FALSE)
     { 
@@ -187,7 +412,7 @@ int init_config(e502monitor_config **config)
         return E502M_ERR;
     }
 
-    err = config_lookup_float(&cfg, "adc_freq", &e502m_cfg->adc_freq);
+    err = config_lookup_float(&cfg, option_path(&cfg, "adc_freq"), &e502m_cfg->adc_freq);
     if(err == CONFIG_FALSE)
     { 
         printf("Ошибка конфигурационного файла:\tчастота сбора АЦП не задана!\n");
@@ -222,6 +447,199 @@ int init_config(e502monitor_config **config)
     e502m_cfg->read_timeout = 2000;
 #endif // DBG
 
+    err = config_lookup_int(&cfg, "auto_tune", &e502m_cfg->auto_tune);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->auto_tune = 0;
+    }
+
+    err = config_lookup_int(&cfg, "latency_ms", &e502m_cfg->latency_ms);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->latency_ms = DEFAULT_LATENCY_MS;
+    }
+
+    if(e502m_cfg->latency_ms < 1)
+    {
+        printf("Ошибка конфигурационного файла:\tlatency_ms должен быть больше нуля!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "queue_depth", &e502m_cfg->queue_depth);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->queue_depth = DEFAULT_QUEUE_DEPTH;
+    }
+
+    if(e502m_cfg->queue_depth < 1)
+    {
+        printf("Ошибка конфигурационного файла:\tqueue_depth должен быть больше нуля!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "queue_memory_limit", &e502m_cfg->queue_memory_limit);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->queue_memory_limit = 0;
+    }
+
+    char* hp;
+    err = config_lookup_string(&cfg, "huge_pages", &hp);
+    if(err == CONFIG_FALSE || strcmp(hp, "off") == 0)
+    {
+        e502m_cfg->huge_pages = HUGE_PAGES_OFF;
+    } else if(strcmp(hp, "thp") == 0) {
+        e502m_cfg->huge_pages = HUGE_PAGES_THP;
+    } else if(strcmp(hp, "explicit") == 0) {
+        e502m_cfg->huge_pages = HUGE_PAGES_EXPLICIT;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение huge_pages: %s\n", hp);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    char* sp;
+    err = config_lookup_string(&cfg, "sample_path", &sp);
+    if(err == CONFIG_FALSE || strcmp(sp, "double") == 0)
+    {
+        e502m_cfg->sample_path = SAMPLE_PATH_DOUBLE;
+    } else if(strcmp(sp, "float32") == 0) {
+        e502m_cfg->sample_path = SAMPLE_PATH_FLOAT32;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение sample_path: %s\n", sp);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    char* op;
+    err = config_lookup_string(&cfg, "overflow_policy", &op);
+    if(err == CONFIG_FALSE || strcmp(op, "block") == 0)
+    {
+        e502m_cfg->overflow_policy = OVERFLOW_BLOCK;
+    } else if(strcmp(op, "drop_oldest") == 0) {
+        e502m_cfg->overflow_policy = OVERFLOW_DROP_OLDEST;
+    } else if(strcmp(op, "spill") == 0) {
+        e502m_cfg->overflow_policy = OVERFLOW_SPILL;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение overflow_policy: %s\n", op);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "conversion_threads", &e502m_cfg->conversion_threads);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->conversion_threads = DEFAULT_CONVERSION_THREADS;
+    }
+
+    char* converter;
+    err = config_lookup_string(&cfg, "converter", &converter);
+    if(err == CONFIG_FALSE || strcmp(converter, "x502") == 0)
+    {
+        e502m_cfg->converter = CONVERTER_X502;
+    } else if(strcmp(converter, "native") == 0) {
+        e502m_cfg->converter = CONVERTER_NATIVE;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение converter: %s\n", converter);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "software_calibration", &e502m_cfg->software_calibration);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->software_calibration = 0;
+    }
+
+    err = config_lookup_int(&cfg, "write_batch_frames", &e502m_cfg->write_batch_frames);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->write_batch_frames = DEFAULT_WRITE_BATCH_FRAMES;
+    }
+
+    if(e502m_cfg->write_batch_frames < 0)
+    {
+        printf("Ошибка конфигурационного файла:\twrite_batch_frames не может быть отрицательным!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "writer_threads", &e502m_cfg->writer_threads);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->writer_threads = DEFAULT_WRITER_THREADS;
+    }
+
+    if(e502m_cfg->writer_threads < 0)
+    {
+        printf("Ошибка конфигурационного файла:\twriter_threads не может быть отрицательным!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, option_path(&cfg, "receive_priority"), &e502m_cfg->receive_priority);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->receive_priority = 0;
+    }
+
+    if(e502m_cfg->receive_priority < 0 || e502m_cfg->receive_priority > 99)
+    {
+        printf("Ошибка конфигурационного файла:\treceive_priority должен быть от 0 до 99!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    if( read_cpu_mask(&cfg, "receive_cpus", &e502m_cfg->receive_cpus) != E502M_ERR_OK ||
+        read_cpu_mask(&cfg, "conversion_cpus", &e502m_cfg->conversion_cpus) != E502M_ERR_OK ||
+        read_cpu_mask(&cfg, "writer_cpus", &e502m_cfg->writer_cpus) != E502M_ERR_OK ||
+        read_cpu_mask(&cfg, "finisher_cpus", &e502m_cfg->finisher_cpus) != E502M_ERR_OK )
+    {
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "prefault_buffers", &e502m_cfg->prefault_buffers);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->prefault_buffers = 0;
+    }
+
+    err = config_lookup_int(&cfg, "lock_memory", &e502m_cfg->lock_memory);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->lock_memory = 0;
+    }
+
+    if(e502m_cfg->conversion_threads < 1)
+    {
+        printf("Ошибка конфигурационного файла:\tconversion_threads должен быть больше нуля!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    // X502_ProcessData keeps number of next logical channel
+    // in module handle, so blocks must be processed one by one
+    if(e502m_cfg->converter == CONVERTER_X502 && e502m_cfg->conversion_threads != 1)
+    {
+        printf("X502_ProcessData обрабатывает блоки только последовательно. "
+               "Используется один поток обработки\n");
+
+        e502m_cfg->conversion_threads = 1;
+    }
+
     err = config_lookup_int(&cfg, "count_of_day", &e502m_cfg->stored_days_count);
     if(err == CONFIG_FALSE)
     { 
@@ -240,7 +658,7 @@ int init_config(e502monitor_config **config)
         return E502M_ERR;
     }
 
-    config_setting_t *channel_numbers = config_lookup(&cfg, "channel_numbers");
+    config_setting_t *channel_numbers = config_lookup(&cfg, option_path(&cfg, "channel_numbers"));
     if(channel_numbers == NULL)
     {
         printf("Ошибка конфигурационного файла:\tномера каналов не заданы!\n");
@@ -266,7 +684,7 @@ int init_config(e502monitor_config **config)
         e502m_cfg->channel_numbers[i] = config_setting_get_int_elem(channel_numbers, i);
     }
 
-    config_setting_t *channel_modes = config_lookup(&cfg, "channel_modes");
+    config_setting_t *channel_modes = config_lookup(&cfg, option_path(&cfg, "channel_modes"));
     if(channel_modes == NULL)
     {
         
@@ -294,7 +712,7 @@ int init_config(e502monitor_config **config)
         e502m_cfg->channel_modes[i] = config_setting_get_int_elem(channel_modes, i);
     }
 
-    config_setting_t *channel_ranges = config_lookup(&cfg, "channel_ranges");
+    config_setting_t *channel_ranges = config_lookup(&cfg, option_path(&cfg, "channel_ranges"));
     if(channel_ranges == NULL)
     {
         
@@ -323,7 +741,8 @@ int init_config(e502monitor_config **config)
     }
 
     char* bd;
-    err = config_lookup_string(&cfg, "bin_dir", &bd);
+    const char* bin_dir_path = option_path(&cfg, "bin_dir");
+    err = config_lookup_string(&cfg, bin_dir_path, &bd);
     if(err == CONFIG_FALSE)
     {
         printf("Ошибка конфигурационного файла:\t директория для выходных файлов не задана\n");
@@ -332,7 +751,37 @@ int init_config(e502monitor_config **config)
         return E502M_ERR;
     }
 
-    strcpy(e502m_cfg->bin_dir, bd);
+    // without own directory files of module are
+    // written in subdirectory named by serial
+    if(device_index >= 0 && strcmp(bin_dir_path, "bin_dir") == 0)
+    {
+        snprintf(e502m_cfg->bin_dir, sizeof(e502m_cfg->bin_dir), "%s/%s", bd, e502m_cfg->serial);
+    } else {
+        strcpy(e502m_cfg->bin_dir, bd);
+    }
+
+    // merged files are common for all modules
+    char* md;
+    err = config_lookup_string(&cfg, "merge_dir", &md);
+    if(err == CONFIG_FALSE)
+    {
+        config_lookup_string(&cfg, "bin_dir", &md);
+        snprintf(e502m_cfg->merge_dir, sizeof(e502m_cfg->merge_dir), "%s/merged", md);
+    } else {
+        strcpy(e502m_cfg->merge_dir, md);
+    }
+
+    char* sd;
+    const char* spill_dir_path = option_path(&cfg, "spill_dir");
+    err = config_lookup_string(&cfg, spill_dir_path, &sd);
+    if(err == CONFIG_FALSE)
+    {
+        strcpy(e502m_cfg->spill_dir, e502m_cfg->bin_dir);
+    } else if(device_index >= 0 && strcmp(spill_dir_path, "spill_dir") == 0) {
+        snprintf(e502m_cfg->spill_dir, sizeof(e502m_cfg->spill_dir), "%s/%s", sd, e502m_cfg->serial);
+    } else {
+        strcpy(e502m_cfg->spill_dir, sd);
+    }
 
     char *mn;
     err = config_lookup_string(&cfg, "module_name", &mn);
@@ -358,7 +807,7 @@ int init_config(e502monitor_config **config)
 
     strcpy(e502m_cfg->place, p);
 
-    config_setting_t *channel_names = config_lookup(&cfg, "channel_names");
+    config_setting_t *channel_names = config_lookup(&cfg, option_path(&cfg, "channel_names"));
 
     if(channel_ranges == NULL)
     {
@@ -389,7 +838,7 @@ int init_config(e502monitor_config **config)
         strcpy(e502m_cfg->channel_names[i], config_setting_get_string_elem(channel_names, i));
     }
 
-    config_setting_t* ch_dist = config_lookup(&cfg, "channel_distribution");
+    config_setting_t* ch_dist = config_lookup(&cfg, option_path(&cfg, "channel_distribution"));
 
     if(ch_dist == NULL)
     {
@@ -425,6 +874,119 @@ int init_config(e502monitor_config **config)
 
     }
 
+    e502m_cfg->sample_formats = (int*)malloc(sizeof(int) * e502m_cfg->files_count);
+
+    const char* format = "float32";
+    config_setting_t* formats = config_lookup(&cfg, option_path(&cfg, "sample_format"));
+
+    if(formats != NULL && config_setting_length(formats) > 0 &&
+       config_setting_length(formats) != e502m_cfg->files_count)
+    {
+        printf("Ошибка конфигурационного файла:\tразмер "
+               "массива sample_format не равен количеству файлов\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    for(int i = 0; i < e502m_cfg->files_count; i++)
+    {
+        // one value for all files or list of values
+        if(formats != NULL)
+        {
+            format = config_setting_length(formats) > 0 ?
+                     config_setting_get_string_elem(formats, i) :
+                     config_setting_get_string(formats);
+        }
+
+        if(format == NULL){ format = ""; }
+
+        if(strcmp(format, "float32") == 0) {
+            e502m_cfg->sample_formats[i] = SAMPLE_FLOAT32;
+        } else if(strcmp(format, "double") == 0) {
+            e502m_cfg->sample_formats[i] = SAMPLE_DOUBLE;
+        } else if(strcmp(format, "pcm16") == 0) {
+            e502m_cfg->sample_formats[i] = SAMPLE_PCM16;
+        } else if(strcmp(format, "pcm24") == 0) {
+            e502m_cfg->sample_formats[i] = SAMPLE_PCM24;
+        } else {
+            printf("Ошибка конфигурационного файла:\tнеизвестное значение sample_format: %s\n", format);
+
+            config_destroy(&cfg);
+            return E502M_ERR;
+        }
+    }
+
+    char* wav_writer;
+    err = config_lookup_string(&cfg, "wav_writer", &wav_writer);
+    if(err == CONFIG_FALSE || strcmp(wav_writer, "sndfile") == 0)
+    {
+        e502m_cfg->wav_writer = WAV_WRITER_SNDFILE;
+    } else if(strcmp(wav_writer, "native") == 0) {
+        e502m_cfg->wav_writer = WAV_WRITER_NATIVE;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение wav_writer: %s\n", wav_writer);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    char* capture_mode;
+    err = config_lookup_string(&cfg, "capture_mode", &capture_mode);
+    if(err == CONFIG_FALSE || strcmp(capture_mode, "wav") == 0)
+    {
+        e502m_cfg->capture_mode = CAPTURE_WAV;
+    } else if(strcmp(capture_mode, "raw") == 0) {
+        e502m_cfg->capture_mode = CAPTURE_RAW;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение capture_mode: %s\n", capture_mode);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    char* merge;
+    err = config_lookup_string(&cfg, "merge", &merge);
+    if(err == CONFIG_FALSE || strcmp(merge, "off") == 0)
+    {
+        e502m_cfg->merge_mode = MERGE_OFF;
+    } else if(strcmp(merge, "nearest") == 0) {
+        e502m_cfg->merge_mode = MERGE_NEAREST;
+    } else if(strcmp(merge, "resample") == 0) {
+        e502m_cfg->merge_mode = MERGE_RESAMPLE;
+    } else {
+        printf("Ошибка конфигурационного файла:\tнеизвестное значение merge: %s\n", merge);
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    err = config_lookup_int(&cfg, "preroll_seconds", &e502m_cfg->preroll_seconds);
+    if(err == CONFIG_FALSE)
+    {
+        e502m_cfg->preroll_seconds = 0;
+    }
+
+    if(e502m_cfg->preroll_seconds < 0)
+    {
+        printf("Ошибка конфигурационного файла:\tpreroll_seconds не может быть меньше нуля!\n");
+
+        config_destroy(&cfg);
+        return E502M_ERR;
+    }
+
+    char* pd;
+    const char* preroll_dir_path = option_path(&cfg, "preroll_dir");
+    err = config_lookup_string(&cfg, preroll_dir_path, &pd);
+    if(err == CONFIG_FALSE)
+    {
+        snprintf(e502m_cfg->preroll_dir, sizeof(e502m_cfg->preroll_dir), "%s/preroll", e502m_cfg->bin_dir);
+    } else if(device_index >= 0 && strcmp(preroll_dir_path, "preroll_dir") == 0) {
+        snprintf(e502m_cfg->preroll_dir, sizeof(e502m_cfg->preroll_dir), "%s/%s", pd, e502m_cfg->serial);
+    } else {
+        strcpy(e502m_cfg->preroll_dir, pd);
+    }
+
     // channel distribution in str
 
     e502m_cfg->channel_distribution_str = (char**)malloc(sizeof(char*) * e502m_cfg->files_count);
@@ -470,14 +1032,90 @@ int init_config(e502monitor_config **config)
     return E502M_ERR_OK;
 }
 
+// Compares paths of directories without trailing slashes
+static int same_dir(const char* a, const char* b)
+{
+    size_t a_len = strlen(a);
+    size_t b_len = strlen(b);
+
+    while(a_len > 1 && a[a_len - 1] == '/'){ a_len--; }
+    while(b_len > 1 && b[b_len - 1] == '/'){ b_len--; }
+
+    return a_len == b_len && strncmp(a, b, a_len) == 0;
+}
+
+int check_device_dirs(e502monitor_config *config, e502monitor_config *other)
+{
+    if( same_dir(config->bin_dir, other->bin_dir) )
+    {
+        printf("Ошибка конфигурационного файла:	модули %s и %s "
+               "пишут файлы в одну директорию %s\n",
+               other->serial, config->serial, config->bin_dir);
+
+        return E502M_ERR;
+    }
+
+    if( config->overflow_policy == OVERFLOW_SPILL &&
+        other->overflow_policy == OVERFLOW_SPILL &&
+        same_dir(config->spill_dir, other->spill_dir) )
+    {
+        printf("Ошибка конфигурационного файла:	модули %s и %s "
+               "используют одну директорию файла буферизации %s\n",
+               other->serial, config->serial, config->spill_dir);
+
+        return E502M_ERR;
+    }
+
+    return E502M_ERR_OK;
+}
+
 void print_config(e502monitor_config *config)
 {
     printf("\nЗагружена следующая конфигурация модуля:\n");
+    if(config->serial[0] != '\0')
+    {
+        printf(" Серийный номер модуля\t\t\t\t\t:%s\n", config->serial);
+    }
     printf(" Количество используемых логических каналов\t\t:%d\n", config->channel_count);
     printf(" Частота сбора АЦП в Гц\t\t\t\t\t:%f\n", config->adc_freq);
     printf(" Количество отсчетов, считываемых за блок\t\t:%d\n", config->read_block_size);
     printf(" Размер файлов (в секундах)\t\t\t\t:%d\n", config->file_size);
     printf(" Таймаут перед считываением блока (мс)\t\t\t:%d\n", config->read_timeout);
+    printf(" Автонастройка размера блока\t\t\t\t:%s\n", config->auto_tune ? "да" : "нет");
+    if(config->auto_tune)
+    {
+        printf(" Допустимая задержка приема (мс)\t\t\t:%d\n", config->latency_ms);
+    }
+    printf(" Количество блоков в очереди на запись\t\t\t:%d\n", config->queue_depth);
+    printf(" Ограничение памяти под очередь (МБ)\t\t\t:%d\n", config->queue_memory_limit);
+    printf(" Действие при переполнении очереди\t\t\t:%s\n",
+           config->overflow_policy == OVERFLOW_DROP_OLDEST ? "drop_oldest" :
+           config->overflow_policy == OVERFLOW_SPILL ? "spill" : "block");
+    if(config->overflow_policy == OVERFLOW_SPILL)
+    {
+        printf(" Директория файла буферизации\t\t\t\t:%s\n", config->spill_dir);
+    }
+    printf(" Количество потоков обработки данных\t\t\t:%d\n", config->conversion_threads);
+    printf(" Кадров в одной записи в файл (0 - блок)\t\t\t:%d\n", config->write_batch_frames);
+    printf(" Количество потоков записи файлов\t\t\t:%d\n", config->writer_threads);
+    printf(" Приоритет SCHED_FIFO потока приема (0 - нет)\t\t:%d\n", config->receive_priority);
+    printf(" Ядра потоков приема/обработки/записи/завершения\t:0x%llx 0x%llx 0x%llx 0x%llx\n",
+           config->receive_cpus,
+           config->conversion_cpus,
+           config->writer_cpus,
+           config->finisher_cpus);
+    printf(" Заполнение буферов до начала сбора\t\t\t:%s\n", config->prefault_buffers ? "да" : "нет");
+    printf(" Блокировка памяти в ОЗУ\t\t\t\t:%s\n", config->lock_memory ? "да" : "нет");
+    printf(" Страницы буферов отсчетов\t\t\t\t:%s\n", huge_pages_name(config->huge_pages));
+    printf(" Тип отсчетов в очереди\t\t\t\t:%s\n",
+           config->sample_path == SAMPLE_PATH_FLOAT32 ? "float32" : "double");
+    printf(" Перевод отсчетов в вольты\t\t\t\t:%s\n",
+           config->converter == CONVERTER_NATIVE ? "native" : "x502");
+    if(config->converter == CONVERTER_NATIVE)
+    {
+        printf(" Программная калибровка\t\t\t\t:%s\n",
+               config->software_calibration ? "Да" : "Нет");
+    }
     printf(" Количество сохраняемых дней\t\t\t\t:%d\n", config->stored_days_count);
     printf(" Количество файлов:\t\t\t\t\t:%d\n", config->files_count);
     printf(" Номера используемых каналов\t\t\t\t:[ ");
@@ -522,7 +1160,41 @@ void print_config(e502monitor_config *config)
         }
         printf(") ");
     }
-    printf("]\n\n");
+    printf("]\n");
+    printf(" Форматы отсчетов в файлах\t\t\t\t:[ ");
+    for(int i = 0; i < config->files_count; i++)
+    {
+        printf("%s ", sample_format_name(config->sample_formats[i]));
+    }
+    printf("]\n");
+    printf(" Запись выходных файлов\t\t\t\t\t:%s\n",
+           config->wav_writer == WAV_WRITER_NATIVE ? "native" : "sndfile");
+    printf(" Режим записи\t\t\t\t\t\t:%s\n",
+           config->capture_mode == CAPTURE_RAW ? "raw" : "wav");
+    printf(" Объединение файлов модулей\t\t\t\t:%s\n",
+           config->merge_mode == MERGE_RESAMPLE ? "resample" :
+           config->merge_mode == MERGE_NEAREST ? "nearest" : "off");
+    if(config->merge_mode != MERGE_OFF)
+    {
+        printf(" Директория объединенных файлов\t\t\t\t:%s\n", config->merge_dir);
+    }
+    printf(" Предзапись в ОЗУ (секунд, 0 - нет)\t\t\t:%d\n", config->preroll_seconds);
+    if(config->preroll_seconds > 0)
+    {
+        printf(" Директория снимков предзаписи\t\t\t\t:%s\n", config->preroll_dir);
+    }
+    printf("\n");
+}
+
+const char* sample_format_name(int format)
+{
+    switch(format)
+    {
+        case SAMPLE_DOUBLE: return "double";
+        case SAMPLE_PCM16:  return "pcm16";
+        case SAMPLE_PCM24:  return "pcm24";
+        default:            return "float32";
+    }
 }
 
 e502monitor_config* create_config()
@@ -537,6 +1209,7 @@ e502monitor_config* create_config()
     config->channel_names           = NULL;
     config->channel_distribution    = NULL;
     config->channel_counts_in_files = NULL;
+    config->sample_formats          = NULL;
 
     return config;
 }
@@ -567,5 +1240,7 @@ void destroy_config(e502monitor_config **config)
         free((*config)->channel_distribution);
     }
 
+    if( (*config)->sample_formats != NULL ){ free((*config)->sample_formats); }
+
     free( (*config) ) ;
 }
\ No newline at end of file
@@ -12,6 +12,43 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// What to do with new data when queue is full
+#define OVERFLOW_BLOCK       0 // wait for free block
+#define OVERFLOW_DROP_OLDEST 1 // drop oldest block in queue
+#define OVERFLOW_SPILL       2 // write blocks in backlog file
+
+// Format of samples in output files
+#define SAMPLE_FLOAT32 0
+#define SAMPLE_DOUBLE  1
+#define SAMPLE_PCM16   2 // full scale is the max code of channel range
+#define SAMPLE_PCM24   3
+
+// Library for writing of output files
+#define WAV_WRITER_SNDFILE 0 // libsndfile
+#define WAV_WRITER_NATIVE  1 // streaming writer of e502monitor
+
+// What is written on disk
+#define CAPTURE_WAV 0 // converted samples in WAV files
+#define CAPTURE_RAW 1 // raw words, converted later by e502convert
+
+// How raw words are converted to volts
+#define CONVERTER_X502   0 // X502_ProcessData
+#define CONVERTER_NATIVE 1 // vectorized converter of e502monitor
+
+// Pages of large sample buffers
+#define HUGE_PAGES_OFF      0 // ordinary pages
+#define HUGE_PAGES_THP      1 // transparent huge pages advised by madvise
+#define HUGE_PAGES_EXPLICIT 2 // MAP_HUGETLB pages from vm.nr_hugepages
+
+// Type of samples between conversion and writing
+#define SAMPLE_PATH_DOUBLE  0 // samples are converted to double
+#define SAMPLE_PATH_FLOAT32 1 // samples are converted to float
+
+// Merged output of several modules on common timeline
+#define MERGE_OFF      0 // files of each module only
+#define MERGE_NEAREST  1 // nearest sample of each module
+#define MERGE_RESAMPLE 2 // fractional delay by interpolation
+
 typedef struct{
 
     int       channel_count;            // Count of use logical chnnels
@@ -20,6 +57,31 @@ typedef struct{
                                         //  that is read at once from the ADC
 
     int       read_timeout;             // Timeout for receiving data in ms.
+    int       auto_tune;                // 1 - block size and driver buffer
+                                        //  are chosen by program
+    int       latency_ms;               // Latency target for auto tuning
+    int       queue_depth;              // Count of blocks that can wait
+                                        //  for writing on disk
+    int       queue_memory_limit;       // Max memory for queue in MB (0 - no limit)
+    int       overflow_policy;          // Queue overflow policy
+    char      spill_dir[101];           // Directory for backlog file
+    int       conversion_threads;       // Count of threads for conversion of data
+    int       converter;                // Converter of raw words to volts
+    int       software_calibration;     // 1 - native converter applies calibration
+    int       write_batch_frames;       // Count of frames written at once
+                                        //  (0 - frames of one block)
+    int       writer_threads;           // Count of threads for writing files
+                                        //  (0 - files are written by main writer)
+    int       receive_priority;         // SCHED_FIFO priority of receiving thread
+                                        //  (0 - ordinary scheduling)
+    long long receive_cpus;             // Cores of threads as bit masks
+    long long conversion_cpus;          //  (0 - any core)
+    long long writer_cpus;
+    long long finisher_cpus;
+    int       prefault_buffers;         // 1 - pages of buffers are touched before start
+    int       lock_memory;              // 1 - memory of process is locked in RAM
+    int       huge_pages;               // Pages of queue blocks and frame buffers
+    int       sample_path;              // Type of converted samples in queue blocks
     int*      channel_numbers;          // Numbers of using logical channels
     int*      channel_modes;            // Operation modes for channels
     int*      channel_ranges;           // Channel measurement ranges
@@ -32,7 +94,18 @@ typedef struct{
     int**     channel_distribution;     // Distribution of channel by files
     int       files_count;              // Count of files for writing
     int*      channel_counts_in_files;  // Count of channels in each flac file
+    int*      sample_formats;           // Format of samples in each file
+    int       wav_writer;               // Library for writing of output files
+    int       capture_mode;             // What is written on disk
     char**    channel_distribution_str; // Channel distribution in string
+    int       devices_count;            // Count of modules in "devices" list
+                                        //  (0 - one module, first found)
+    char      serial[33];               // Serial number of module ("" - any)
+    int       merge_mode;               // Merged output of modules
+    char      merge_dir[101];           // Directory of merged files
+    int       preroll_seconds;          // Seconds of samples kept in RAM for
+                                        //  snapshot on demand (0 - off)
+    char      preroll_dir[101];         // Directory of snapshots
 } e502monitor_config;
 
 /*
@@ -42,6 +115,11 @@ typedef struct{
 */
 int create_default_config();
 
+/*
+    Returns name of sample format as in config file.
+*/
+const char* sample_format_name(int format);
+
 /*
     Prints information about configuration.
 
@@ -76,4 +154,30 @@ void destroy_config(e502monitor_config **config);
 
 int init_config(e502monitor_config **config);
 
+/*
+    Initializes configuration of module from
+    "devices" list. Channel table, sample formats
+    and directories of module replace common
+    options, other options are common.
+
+    config       - pointer to pointer
+                   to special settings
+                   structure.
+    device_index - index of module in "devices" list
+*/
+int init_device_config(e502monitor_config **config, int device_index);
+
+/*
+    Checks that two modules from "devices" list
+    don't share directories. Temporary files of
+    segments in bin_dir and backlog file in
+    spill_dir have the same names for all modules.
+
+    config - configuration of module
+    other  - configuration of other module
+
+    Returns error index.
+*/
+int check_device_dirs(e502monitor_config *config, e502monitor_config *other);
+
 #endif // CONFIG_H
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "continuity.c" contains realization of checker of
+    continuity of data stream.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "continuity.h"
+
+#define TAG_MASK (ADC_WORD_FLAG | ADC_WORD_CH_MASK)
+
+int init_continuity_checker(continuity_checker* checker, e502monitor_config* config)
+{
+    if(config->channel_count < 1 || config->channel_count > MAX_CHANNELS){ return E502M_ERR; }
+
+    checker->channel_count = config->channel_count;
+
+    for(int i = 0; i < config->channel_count; i++)
+    {
+        checker->tags[i] = ADC_WORD_FLAG |
+                           (((uint32_t)config->channel_numbers[i] << ADC_WORD_CH_SHIFT) & ADC_WORD_CH_MASK);
+    }
+
+    return E502M_ERR_OK;
+}
+
+// Returns logical channel of word, -1 if channel isn't used
+// or -2 if several logical channels have the same tag
+static int find_lch(continuity_checker* checker, uint32_t word)
+{
+    int lch = -1;
+
+    for(int i = 0; i < checker->channel_count; i++)
+    {
+        if( (word & TAG_MASK) != checker->tags[i] ){ continue; }
+
+        if(lch >= 0){ return -2; }
+
+        lch = i;
+    }
+
+    return lch;
+}
+
+int check_continuity(continuity_checker* checker,
+                     const uint32_t* raw,
+                     int size,
+                     int first_lch,
+                     continuity_break* brk)
+{
+    int lch = first_lch;
+    int i = 0;
+
+    for(; i < size; i++)
+    {
+        if( (raw[i] & TAG_MASK) != checker->tags[lch] ){ break; }
+
+        if(++lch == checker->channel_count){ lch = 0; }
+    }
+
+    brk->kind = CONTINUITY_OK;
+    brk->position = i;
+    brk->skip = 0;
+    brk->lch = lch;
+
+    if(i == size){ return CONTINUITY_OK; }
+
+    if(raw[i] & ADC_WORD_FLAG)
+    {
+        brk->kind = CONTINUITY_MISALIGN;
+        brk->lch = find_lch(checker, raw[i]);
+
+        // channel isn't used: word is damaged and
+        // its sample is lost
+        if(brk->lch == -1){ brk->skip = 1; }
+
+        // channel of word is ambiguous: words are lost
+        // up to word of known channel
+        for(; brk->lch == -2 && i < size; i++)
+        {
+            brk->skip++;
+            brk->lch = i + 1 < size ? find_lch(checker, raw[i + 1]) : -1;
+        }
+
+        return brk->kind;
+    }
+
+    brk->kind = CONTINUITY_FOREIGN;
+
+    for(; i < size && !(raw[i] & ADC_WORD_FLAG); i++)
+    {
+        if(raw[i] == STREAM_MSG_OVERFLOW){ brk->kind = CONTINUITY_OVERRUN; }
+
+        brk->skip++;
+    }
+
+    brk->lch = i < size ? find_lch(checker, raw[i]) : -1;
+
+    // next word is in order of stream if its channel is ambiguous
+    if(brk->lch == -2){ brk->lch = -1; }
+
+    return brk->kind;
+}
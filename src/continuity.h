@@ -0,0 +1,81 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "continuity.h" contains declaration of checker of
+    continuity of data stream. Stream contains only ADC
+    words, so each word must have flag of ADC data and
+    physical channel of the next logical channel. Checker
+    finds words which break this order:
+
+      - message of module about overflow of its buffer
+        (samples were lost in module);
+      - ADC word of other logical channel (samples
+        were lost or stream is shifted). Channel field of
+        word holds 4 bits, so logical channels with the same
+        physical channel or channels which differ by 16 can't
+        be told apart: such words are skipped as lost samples
+        up to word of channel which is found unambiguously;
+      - other words without ADC data.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef CONTINUITY_H
+#define CONTINUITY_H
+
+#include "adc_convert.h"
+
+#include <stdint.h>
+
+#define STREAM_MSG_OVERFLOW 0x01010000 // message about overflow of buffer of module
+
+// Kinds of break of stream
+#define CONTINUITY_OK       0 // all words are in order
+#define CONTINUITY_OVERRUN  1 // overflow message, samples were lost in module
+#define CONTINUITY_MISALIGN 2 // ADC word of unexpected logical channel
+#define CONTINUITY_FOREIGN  3 // words without ADC data, no samples are lost
+
+typedef struct {
+    int      channel_count;
+    uint32_t tags[MAX_CHANNELS]; // flag and channel bits of each logical channel
+} continuity_checker;
+
+typedef struct {
+    int kind;     // CONTINUITY_*
+    int position; // index of first word which breaks order
+    int skip;     // count of skipped words from position
+    int lch;      // logical channel of word after skipped words
+                  //  (-1 - unknown or no ADC words after them in block)
+} continuity_break;
+
+/*
+    Initializes checker by channels of configuration.
+
+    checker - checker
+    config  - configuration with channel numbers
+
+    Returns error index.
+*/
+int init_continuity_checker(continuity_checker* checker, e502monitor_config* config);
+
+/*
+    Checks order of words of block.
+
+    checker   - checker
+    raw       - raw words from module
+    size      - count of words
+    first_lch - expected logical channel of first word
+    brk       - description of first break
+
+    Returns CONTINUITY_OK if all words are in order,
+    otherwise kind of first break.
+*/
+int check_continuity(continuity_checker* checker,
+                     const uint32_t* raw,
+                     int size,
+                     int first_lch,
+                     continuity_break* brk);
+
+#endif // CONTINUITY_H
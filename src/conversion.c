@@ -0,0 +1,340 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "conversion.c" contains realization of conversion stage.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "conversion.h"
+#include "common.h"
+#include "stats.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    conversion_stage* stage;
+    int               index;
+} conversion_thread_arg;
+
+static void convert_block(conversion_stage* stage,
+                          data_block* block,
+                          int size,
+                          int first_lch,
+                          double* scratch)
+{
+    long long start = monotonic_us();
+
+    uint32_t adc_size = size;
+
+    if(stage->converter != NULL)
+    {
+        adc_convert_result result;
+
+        if(block->fdata != NULL)
+        {
+            adc_size = adc_convert_float(stage->converter,
+                                         block->raw,
+                                         size,
+                                         first_lch,
+                                         block->fdata,
+                                         &result);
+        } else {
+            adc_size = adc_convert_double(stage->converter,
+                                          block->raw,
+                                          size,
+                                          first_lch,
+                                          block->data,
+                                          &result);
+        }
+
+        if(result.channel_errors != 0 || result.skipped_words != 0)
+        {
+            char log_msg[200] = "";
+            sprintf(log_msg, "Ошибка обработки данных: неверный канал у %d отсчетов, "
+                             "пропущено %d слов", result.channel_errors, result.skipped_words);
+            logg(log_msg);
+
+            stats_add(&g_stats.conversion_errors, 1);
+        }
+    }
+    else
+    {
+        pthread_rwlock_rdlock(&stage->device_lock);
+
+        // module was closed on reconnection and
+        // stop came before it was opened again
+        if(stage->device_hnd == NULL)
+        {
+            pthread_rwlock_unlock(&stage->device_lock);
+
+            block->lost = 1;
+            block->data_size = 0;
+
+            return;
+        }
+
+        int32_t err = X502_ProcessData(stage->device_hnd,
+                                       block->raw,
+                                       size,
+                                       X502_PROC_FLAGS_VOLT,
+                                       block->fdata != NULL ? scratch : block->data,
+                                       &adc_size,
+                                       NULL,
+                                       NULL);
+
+        pthread_rwlock_unlock(&stage->device_lock);
+
+        if(err != X502_ERR_OK)
+        {
+            char log_msg[200] = "";
+            sprintf(log_msg, "Ошибка обработки данных: %s", X502_GetErrorString(err));
+            logg(log_msg);
+
+            stats_add(&g_stats.conversion_errors, 1);
+        }
+
+        // library returns only double samples
+        if(block->fdata != NULL){ adc_narrow_samples(scratch, adc_size, block->fdata); }
+    }
+
+    block->data_size = adc_size;
+
+    long long elapsed = monotonic_us() - start;
+
+    stats_add(&g_stats.conversion_us_total, elapsed);
+    stats_add(&g_stats.conversion_count, 1);
+    stats_update_max(&g_stats.conversion_us_max, elapsed);
+}
+
+static void free_scratch(conversion_stage* stage)
+{
+    if(stage->scratch == NULL){ return; }
+
+    for(int i = 0; i < stage->threads_count; i++){ free(stage->scratch[i]); }
+
+    free(stage->scratch);
+    stage->scratch = NULL;
+}
+
+static int alloc_scratch(conversion_stage* stage)
+{
+    stage->scratch = (double**)calloc(stage->threads_count, sizeof(double*));
+
+    if(stage->scratch == NULL){ return E502M_ERR; }
+
+    for(int i = 0; i < stage->threads_count; i++)
+    {
+        stage->scratch[i] = (double*)malloc(sizeof(double) * stage->pool->block_size);
+
+        if(stage->scratch[i] == NULL)
+        {
+            free_scratch(stage);
+            return E502M_ERR;
+        }
+    }
+
+    return E502M_ERR_OK;
+}
+
+static void* conversion_thread(void* arg)
+{
+    conversion_stage* stage = ((conversion_thread_arg*)arg)->stage;
+    int index = ((conversion_thread_arg*)arg)->index;
+    spsc_ring* ring = stage->rings[index];
+    double* scratch = stage->scratch != NULL ? stage->scratch[index] : NULL;
+
+    free(arg);
+
+    data_block* block;
+    int size, first_lch, last_buffer_index;
+
+    while( !__atomic_load_n(&stage->stop, __ATOMIC_ACQUIRE) || !ring_empty(ring) )
+    {
+        pop_from_ring(ring,
+                      (void**)&block,
+                      &size,
+                      &first_lch,
+                      &last_buffer_index,
+                      CONVERSION_POP_TIMEOUT);
+
+        if(block == NULL){ continue; }
+
+        convert_block(stage, block, size, first_lch, scratch);
+
+        pthread_mutex_lock(&stage->mutex);
+        __atomic_store_n(&block->ready, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_sub(&stage->pending, 1, __ATOMIC_RELAXED);
+        pthread_cond_broadcast(&stage->converted);
+        pthread_mutex_unlock(&stage->mutex);
+
+        release_block(stage->pool, block);
+    }
+
+    return NULL;
+}
+
+conversion_stage* create_conversion_stage(int threads_count,
+                                          int ring_capacity,
+                                          block_pool* pool,
+                                          t_x502_hnd device_hnd,
+                                          adc_converter* converter)
+{
+    conversion_stage* stage = (conversion_stage*)malloc(sizeof(conversion_stage));
+
+    if(stage == NULL){ return NULL; }
+
+    stage->threads_count = threads_count;
+    stage->threads = (pthread_t*)malloc(sizeof(pthread_t) * threads_count);
+    stage->rings = (spsc_ring**)malloc(sizeof(spsc_ring*) * threads_count);
+    stage->next_thread = 0;
+    stage->pool = pool;
+    stage->device_hnd = device_hnd;
+    stage->converter = converter;
+    stage->scratch = NULL;
+    stage->stop = 0;
+    stage->pending = 0;
+
+    pthread_mutex_init(&stage->mutex, NULL);
+    pthread_cond_init(&stage->converted, NULL);
+    pthread_rwlock_init(&stage->device_lock, NULL);
+
+    for(int i = 0; i < threads_count; i++)
+    {
+        stage->rings[i] = create_spsc_ring(ring_capacity);
+
+        if(stage->rings[i] == NULL)
+        {
+            logg("Ошибка создания очереди потока обработки данных");
+
+            while(i--){ destroy_spsc_ring(&stage->rings[i]); }
+
+            pthread_mutex_destroy(&stage->mutex);
+            pthread_cond_destroy(&stage->converted);
+            pthread_rwlock_destroy(&stage->device_lock);
+
+            free(stage->threads);
+            free(stage->rings);
+            free(stage);
+
+            return NULL;
+        }
+    }
+
+    // X502_ProcessData writes double samples in scratch
+    if( converter == NULL && pool->sample_path == SAMPLE_PATH_FLOAT32 &&
+        alloc_scratch(stage) != E502M_ERR_OK )
+    {
+        logg("Ошибка выделения памяти для потоков обработки данных");
+
+        for(int i = 0; i < threads_count; i++){ destroy_spsc_ring(&stage->rings[i]); }
+
+        pthread_mutex_destroy(&stage->mutex);
+        pthread_cond_destroy(&stage->converted);
+        pthread_rwlock_destroy(&stage->device_lock);
+
+        free(stage->threads);
+        free(stage->rings);
+        free(stage);
+
+        return NULL;
+    }
+
+    for(int i = 0; i < threads_count; i++)
+    {
+        conversion_thread_arg* arg = (conversion_thread_arg*)malloc(sizeof(conversion_thread_arg));
+        arg->stage = stage;
+        arg->index = i;
+
+        pthread_create(&stage->threads[i], NULL, conversion_thread, arg);
+    }
+
+    return stage;
+}
+
+void destroy_conversion_stage(conversion_stage** stage)
+{
+    __atomic_store_n(&(*stage)->stop, 1, __ATOMIC_RELEASE);
+
+    for(int i = 0; i < (*stage)->threads_count; i++)
+    {
+        pthread_join((*stage)->threads[i], NULL);
+        destroy_spsc_ring(&(*stage)->rings[i]);
+    }
+
+    pthread_mutex_destroy(&(*stage)->mutex);
+    pthread_cond_destroy(&(*stage)->converted);
+    pthread_rwlock_destroy(&(*stage)->device_lock);
+
+    free_scratch(*stage);
+
+    free((*stage)->threads);
+    free((*stage)->rings);
+    free(*stage);
+
+    *stage = NULL;
+}
+
+void convert_block_async(conversion_stage* stage,
+                         data_block* block,
+                         int size,
+                         int first_lch)
+{
+    block->ready = 0;
+    block->lost = 0;
+    block->data_size = 0;
+
+    retain_block(block);
+
+    __atomic_fetch_add(&stage->pending, 1, __ATOMIC_RELAXED);
+
+    push_to_ring(stage->rings[stage->next_thread],
+                 block,
+                 size,
+                 first_lch,
+                 NOT_LAST_BUFFER);
+
+    stage->next_thread = (stage->next_thread + 1) % stage->threads_count;
+}
+
+void wait_block_converted(conversion_stage* stage, data_block* block)
+{
+    if( __atomic_load_n(&block->ready, __ATOMIC_ACQUIRE) ){ return; }
+
+    pthread_mutex_lock(&stage->mutex);
+
+    while( !__atomic_load_n(&block->ready, __ATOMIC_ACQUIRE) )
+    {
+        pthread_cond_wait(&stage->converted, &stage->mutex);
+    }
+
+    pthread_mutex_unlock(&stage->mutex);
+}
+
+void set_conversion_device(conversion_stage* stage, t_x502_hnd device_hnd)
+{
+    pthread_mutex_lock(&stage->mutex);
+
+    while( __atomic_load_n(&stage->pending, __ATOMIC_RELAXED) > 0 )
+    {
+        pthread_cond_wait(&stage->converted, &stage->mutex);
+    }
+
+    pthread_mutex_unlock(&stage->mutex);
+
+    // backlog thread could pass block after wait, its
+    // conversion with old handle is finished before return
+    pthread_rwlock_wrlock(&stage->device_lock);
+    __atomic_store_n(&stage->device_hnd, device_hnd, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&stage->device_lock);
+}
+
+int conversion_device_ready(conversion_stage* stage)
+{
+    return stage->converter != NULL ||
+           __atomic_load_n(&stage->device_hnd, __ATOMIC_RELAXED) != NULL;
+}
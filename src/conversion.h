@@ -0,0 +1,106 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "conversion.h" contains declaration of conversion stage.
+    Receiving thread only reads raw words from module and
+    passes blocks to conversion threads, which convert them
+    to volts. Blocks are distributed between threads in turn,
+    so the writing thread gets them in the order of receiving.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+#include "block_pool.h"
+#include "spsc_ring.h"
+#include "adc_convert.h"
+#include "e502api.h"
+
+#include <pthread.h>
+
+#define CONVERSION_POP_TIMEOUT 100 // ms
+
+typedef struct {
+    int          threads_count;
+    pthread_t*   threads;
+    spsc_ring**  rings;         // input queue of each thread
+    int          next_thread;   // thread for next block
+
+    block_pool*  pool;
+    t_x502_hnd   device_hnd;    // NULL - module is closed
+    pthread_rwlock_t device_lock; // X502_ProcessData holds it for reading
+    adc_converter* converter;   // NULL - X502_ProcessData is used
+    double**     scratch;       // double samples of each thread for X502_ProcessData
+                                //  on float32 path (NULL - not needed)
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  converted;  // signaled when some block is converted
+    int          pending;       // blocks passed to threads and not converted yet
+
+    int          stop;          // 1 - threads must finish
+} conversion_stage;
+
+/*
+    Creates conversion stage and starts its threads.
+
+    threads_count - count of conversion threads
+    ring_capacity - size of queue of each thread
+    pool          - pool of converted blocks, its blocks
+                    define type of converted samples
+    device_hnd    - module handle for X502_ProcessData
+    converter     - native converter (NULL - use X502_ProcessData)
+
+    Returns pointer to stage or NULL if something was wrong.
+*/
+conversion_stage* create_conversion_stage(int threads_count,
+                                          int ring_capacity,
+                                          block_pool* pool,
+                                          t_x502_hnd device_hnd,
+                                          adc_converter* converter);
+
+/*
+    Converts all blocks left in queues, stops
+    threads and frees memory.
+*/
+void destroy_conversion_stage(conversion_stage** stage);
+
+/*
+    Passes block to next conversion thread. Stage takes
+    its own reference of block and releases it after
+    conversion.
+
+    Called only from thread which fills queue of
+    module (receiving thread or backlog thread).
+*/
+void convert_block_async(conversion_stage* stage,
+                         data_block* block,
+                         int size,
+                         int first_lch);
+
+/*
+    Waits until block is converted.
+*/
+void wait_block_converted(conversion_stage* stage, data_block* block);
+
+/*
+    Waits until all passed blocks are converted and
+    replaces module handle for X502_ProcessData. Old
+    handle can be freed after return. Blocks passed
+    while handle is NULL aren't converted and are
+    marked as lost.
+
+    Called only from receiving thread.
+*/
+void set_conversion_device(conversion_stage* stage, t_x502_hnd device_hnd);
+
+/*
+    Returns 1 if passed blocks can be converted now
+    (native converter is used or module is opened).
+*/
+int conversion_device_ready(conversion_stage* stage);
+
+#endif // CONVERSION_H
@@ -13,6 +13,8 @@
 #include "common.h"
 #include "logging.h"
 
+#include <string.h>
+
 uint32_t get_usb_devrec(t_x502_devrec **devrec_list)
 {
     // number of found devices
@@ -56,6 +58,20 @@ uint32_t get_usb_devrec(t_x502_devrec **devrec_list)
     return fnd_devcnt;
 }
 
+int find_device(t_x502_devrec *devrec_list, uint32_t device_count, const char *serial)
+{
+    if(device_count == 0){ return -1; }
+
+    if(serial[0] == '\0'){ return 0; }
+
+    for(uint32_t i = 0; i < device_count; i++)
+    {
+        if(strcmp(devrec_list[i].serial, serial) == 0){ return (int)i; }
+    }
+
+    return -1;
+}
+
 t_x502_hnd open_device( t_x502_devrec *devrec_list,
                         uint32_t device_id )
 {
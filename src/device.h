@@ -45,6 +45,18 @@ uint32_t get_usb_devrec(t_x502_devrec **devrec_list);
 */
 t_x502_hnd open_device(t_x502_devrec *devrec_list, uint32_t device_id);
 
+/*
+    Finds module by serial number.
+
+    devrec_list  - list of available devices
+    device_count - count of devices in list
+    serial       - serial number ("" - first module)
+
+    Returns index of module in list or -1
+    if module wasn't found.
+*/
+int find_device(t_x502_devrec *devrec_list, uint32_t device_count, const char *serial);
+
 /* 
     Print info about module 
 
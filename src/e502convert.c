@@ -0,0 +1,449 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "e502convert.c" contains offline converter of raw
+    files (capture_mode = "raw") in WAV files. Raw files
+    are converted in parallel threads, each file gives the
+    same WAV and .prop files as recording in "wav" mode:
+    causes and times of gaps are taken from headers of
+    blocks, quality of clock - from header of file (files
+    which weren't closed by e502monitor have no clock_*
+    fields).
+    Distribution of channels by files and formats of samples
+    are taken from configuration file of e502monitor (options
+    of module from "devices" list with serial number stored
+    in raw file), table of channels and calibration - from
+    raw file. Without -o files are written in bin_dir of module.
+
+    Usage: e502convert [-j threads] [-o output_dir] file.raw ...
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "raw_capture.h"
+#include "adc_convert.h"
+#include "route.h"
+#include "files.h"
+#include "config.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    int    thread_index;
+    char** file_names;
+    int    files_count;
+    int*   next_file;   // index of next file for converting
+    int*   errors;      // count of not converted files
+    char*  output_dir;  // NULL - bin_dir of module
+} convert_thread_arg;
+
+static e502monitor_config* g_config = NULL;          // common options
+static e502monitor_config** g_device_configs = NULL; // options of modules from "devices" list
+static int g_device_configs_count = 0;
+
+static pthread_mutex_t g_print_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+    Converts one raw file in WAV files.
+
+    Returns error index.
+*/
+static int convert_raw_file(const char* raw_name, int thread_index, char* output_dir);
+
+static void* convert_thread(void* arg);
+
+static void destroy_configs()
+{
+    for(int i = 0; i < g_device_configs_count; i++)
+    {
+        if( g_device_configs[i] != NULL ){ destroy_config(&g_device_configs[i]); }
+    }
+
+    free(g_device_configs);
+
+    if( g_config != NULL ){ destroy_config(&g_config); }
+}
+
+int main(int argc, char** argv)
+{
+    int threads_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char* output_dir = NULL;
+    int opt;
+
+    while( (opt = getopt(argc, argv, "j:o:")) != -1 )
+    {
+        switch(opt)
+        {
+            case 'j': threads_count = atoi(optarg); break;
+            case 'o': output_dir = optarg; break;
+            default:
+                printf("Использование: e502convert [-j потоков] [-o директория] файл.raw ...\n");
+                return E502M_EXIT_FAILURE;
+        }
+    }
+
+    if(optind >= argc)
+    {
+        printf("Использование: e502convert [-j потоков] [-o директория] файл.raw ...\n");
+        return E502M_EXIT_FAILURE;
+    }
+
+    if(threads_count < 1){ threads_count = 1; }
+
+    g_config = create_config();
+
+    if( g_config == NULL || init_config(&g_config) != E502M_ERR_OK )
+    {
+        printf("Ошибка конфигурационного файла. Завершение.\n");
+
+        if( g_config != NULL ){ destroy_config(&g_config); }
+
+        return E502M_EXIT_FAILURE;
+    }
+
+    // options of module are chosen by serial number from raw file
+    g_device_configs_count = g_config->devices_count;
+    g_device_configs = (e502monitor_config**)calloc(g_device_configs_count + 1,
+                                                     sizeof(e502monitor_config*));
+
+    for(int i = 0; i < g_device_configs_count; i++)
+    {
+        g_device_configs[i] = create_config();
+
+        if( g_device_configs[i] == NULL || init_device_config(&g_device_configs[i], i) != E502M_ERR_OK )
+        {
+            printf("Ошибка конфигурационного файла. Завершение.\n");
+
+            destroy_configs();
+
+            return E502M_EXIT_FAILURE;
+        }
+    }
+
+    if(output_dir != NULL){ mkdir(output_dir, 0755); }
+
+    int files_count = argc - optind;
+    int next_file = 0;
+    int errors = 0;
+
+    if(threads_count > files_count){ threads_count = files_count; }
+
+    printf("Файлов: %d, потоков: %d\n", files_count, threads_count);
+
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * threads_count);
+    convert_thread_arg* args = (convert_thread_arg*)malloc(sizeof(convert_thread_arg) * threads_count);
+
+    for(int t = 0; t < threads_count; t++)
+    {
+        args[t].thread_index = t;
+        args[t].file_names = argv + optind;
+        args[t].files_count = files_count;
+        args[t].next_file = &next_file;
+        args[t].errors = &errors;
+        args[t].output_dir = output_dir;
+
+        pthread_create(&threads[t], NULL, convert_thread, &args[t]);
+    }
+
+    for(int t = 0; t < threads_count; t++){ pthread_join(threads[t], NULL); }
+
+    printf("Преобразовано файлов: %d, ошибок: %d\n", files_count - errors, errors);
+
+    free(threads);
+    free(args);
+    destroy_configs();
+
+    return errors == 0 ? 0 : E502M_EXIT_FAILURE;
+}
+
+static void* convert_thread(void* arg)
+{
+    convert_thread_arg* a = (convert_thread_arg*)arg;
+
+    while(1)
+    {
+        int index = __atomic_fetch_add(a->next_file, 1, __ATOMIC_RELAXED);
+
+        if(index >= a->files_count){ break; }
+
+        if( convert_raw_file(a->file_names[index], a->thread_index, a->output_dir) != E502M_ERR_OK )
+        {
+            __atomic_fetch_add(a->errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+// Time of file is taken from modification time
+// if raw file wasn't closed by e502monitor
+static void fill_missing_time(const char* raw_name, header* hdr)
+{
+    struct stat st;
+
+    if(hdr->start_year != 0 || stat(raw_name, &st) != 0){ return; }
+
+    struct tm ts;
+
+    // files are converted in several threads
+    gmtime_r(&st.st_mtime, &ts);
+
+    hdr->start_year = hdr->finish_year = 1900 + ts.tm_year;
+    hdr->start_month = hdr->finish_month = ts.tm_mon + 1;
+    hdr->start_day = hdr->finish_day = ts.tm_mday;
+    hdr->start_hour = hdr->finish_hour = ts.tm_hour;
+    hdr->start_minut = hdr->finish_minut = ts.tm_min;
+    hdr->start_second = hdr->finish_second = ts.tm_sec;
+    hdr->start_usecond = hdr->finish_usecond = 0;
+}
+
+// Options of module which recorded file,
+// common options if it isn't in "devices" list
+static e502monitor_config* find_file_config(const char* raw_name, raw_file_header* fh)
+{
+    for(int i = 0; i < g_device_configs_count; i++)
+    {
+        if( strcmp(g_device_configs[i]->serial, fh->serial) == 0 ){ return g_device_configs[i]; }
+    }
+
+    if(g_device_configs_count > 0)
+    {
+        pthread_mutex_lock(&g_print_mutex);
+        printf("%s: модуль %s не найден в списке devices, используются общие параметры\n",
+               raw_name, fh->serial);
+        pthread_mutex_unlock(&g_print_mutex);
+    }
+
+    return g_config;
+}
+
+static int convert_raw_file(const char* raw_name, int thread_index, char* output_dir)
+{
+    raw_file_header fh;
+
+    int fd = open_raw_file(raw_name, &fh);
+
+    if(fd < 0)
+    {
+        pthread_mutex_lock(&g_print_mutex);
+        printf("%s: не является raw-файлом e502monitor\n", raw_name);
+        pthread_mutex_unlock(&g_print_mutex);
+
+        return E502M_ERR;
+    }
+
+    fill_missing_time(raw_name, &fh.hdr);
+
+    // table of channels of recording instead of current configuration
+    int channel_numbers[MAX_CHANNELS];
+    int channel_modes[MAX_CHANNELS];
+    int channel_ranges[MAX_CHANNELS];
+
+    for(int i = 0; i < fh.channel_count; i++)
+    {
+        channel_numbers[i] = fh.channel_numbers[i];
+        channel_modes[i] = fh.channel_modes[i];
+        channel_ranges[i] = fh.channel_ranges[i];
+    }
+
+    e502monitor_config config = *find_file_config(raw_name, &fh);
+
+    if(output_dir == NULL)
+    {
+        output_dir = config.bin_dir;
+        mkdir(output_dir, 0755);
+    }
+
+    config.channel_count = fh.channel_count;
+    config.adc_freq = fh.adc_freq;
+    config.read_block_size = fh.block_size;
+    config.channel_numbers = channel_numbers;
+    config.channel_modes = channel_modes;
+    config.channel_ranges = channel_ranges;
+
+    int files_count = config.files_count;
+    int block_size = fh.block_size > 0 ? fh.block_size : 1;
+
+    adc_converter converter;
+    routing_plan* plan = NULL;
+    uint32_t* words = NULL;
+    double* samples = NULL;
+    int samples_capacity = 0;
+    int words_capacity = 0;
+
+    audio_file** files = (audio_file**)calloc(files_count, sizeof(audio_file*));
+    char** names = (char**)calloc(files_count, sizeof(char*));
+    long long* file_sizes = (long long*)calloc(files_count, sizeof(long long));
+
+    gap_info gaps[MAX_SEGMENT_GAPS];
+    int gaps_count = 0;
+    int err = E502M_ERR_OK;
+
+    if( init_adc_converter(&converter, &config, fh.software_calibration ? &fh.cbr : NULL) != E502M_ERR_OK ||
+        (plan = create_routing_plan(&config, block_size / config.channel_count + 2)) == NULL ||
+        files == NULL || names == NULL || file_sizes == NULL )
+    {
+        err = E502M_ERR;
+        goto cleanup;
+    }
+
+    for(int i = 0; i < files_count; i++)
+    {
+        names[i] = (char*)malloc(RAW_NAME_SIZE);
+
+        snprintf(names[i], RAW_NAME_SIZE, "%s/.convert_%d_%d.wav", output_dir, thread_index, i);
+    }
+
+    if( open_wav_files(files,
+                       names,
+                       files_count,
+                       config.channel_counts_in_files,
+                       config.sample_formats,
+                       config.adc_freq,
+                       config.wav_writer) != E502M_ERR_OK )
+    {
+        err = E502M_ERR;
+        goto cleanup;
+    }
+
+    long long expected_sample_index = -1;
+    long long file_first_sample = -1;
+
+    raw_block_header block;
+    int size;
+
+    while( (size = read_raw_block(fd, &block, &words, &words_capacity)) > 0 )
+    {
+        if(size > samples_capacity)
+        {
+            free(samples);
+            samples = (double*)malloc(sizeof(double) * size);
+            samples_capacity = size;
+
+            // demux buffers must hold frames of the largest block
+            if(size / config.channel_count + 2 > plan->buffers[0].capacity)
+            {
+                destroy_routing_plan(&plan);
+                plan = create_routing_plan(&config, size / config.channel_count + 2);
+            }
+
+            if(samples == NULL || plan == NULL)
+            {
+                err = E502M_ERR;
+                break;
+            }
+        }
+
+        if(file_first_sample < 0){ file_first_sample = block.sample_index; }
+
+        // blocks were dropped while recording
+        if(expected_sample_index >= 0 && block.sample_index > expected_sample_index)
+        {
+            // the same gap as in wav mode: cause and times
+            // are stored by e502monitor in header of block
+            if(gaps_count < MAX_SEGMENT_GAPS)
+            {
+                gaps[gaps_count].position = (expected_sample_index - file_first_sample) /
+                                            config.channel_count;
+                // incomplete frame around gap is dropped too
+                gaps[gaps_count].length = (block.sample_index - expected_sample_index +
+                                           config.channel_count - 1) / config.channel_count;
+                gaps[gaps_count].cause = block.gap_cause != 0 ? block.gap_cause : GAP_OVERFLOW;
+                gaps[gaps_count].time_us = block.gap_time_us;
+                gaps[gaps_count].duration_us = block.gap_duration_us;
+
+                gaps_count++;
+            }
+
+            reset_frames(plan);
+        }
+
+        expected_sample_index = block.sample_index + size;
+
+        int count = adc_convert_double(&converter, words, size, block.first_lch, samples, NULL);
+
+        demux_block(plan, samples, count, block.first_lch);
+
+        for(int i = 0; i < files_count; i++)
+        {
+            demux_buffer* buffer = &plan->buffers[i];
+
+            if(buffer->frames_count == 0){ continue; }
+
+            write_audio_frames(files[i], buffer->frames, buffer->frames_count);
+
+            file_sizes[i] += buffer->frames_count;
+
+            consume_frames(plan, i);
+        }
+    }
+
+    if(err != E502M_ERR_OK){ goto cleanup; }
+
+    if(size < 0)
+    {
+        pthread_mutex_lock(&g_print_mutex);
+        printf("%s: файл поврежден, преобразована только начальная часть\n", raw_name);
+        pthread_mutex_unlock(&g_print_mutex);
+    }
+
+    close_flac_files(files,
+                     output_dir,
+                     names,
+                     files_count,
+                     file_sizes,
+                     gaps,
+                     gaps_count,
+                     fh.clock_valid ? &fh.clock : NULL,
+                     &fh.hdr,
+                     &config);
+
+    pthread_mutex_lock(&g_print_mutex);
+    printf("%s: готово\n", raw_name);
+    pthread_mutex_unlock(&g_print_mutex);
+
+cleanup:
+    if(err != E502M_ERR_OK)
+    {
+        pthread_mutex_lock(&g_print_mutex);
+        printf("%s: ошибка преобразования\n", raw_name);
+        pthread_mutex_unlock(&g_print_mutex);
+    }
+
+    // files are left open only on errors
+    if(files != NULL)
+    {
+        for(int i = 0; i < files_count; i++)
+        {
+            if(files[i] == NULL){ continue; }
+
+            close_audio_file(&files[i]);
+            remove(names[i]);
+        }
+    }
+
+    if(names != NULL)
+    {
+        for(int i = 0; i < files_count; i++){ free(names[i]); }
+    }
+
+    if(plan != NULL){ destroy_routing_plan(&plan); }
+
+    free(files);
+    free(names);
+    free(file_sizes);
+    free(words);
+    free(samples);
+
+    close(fd);
+
+    return err;
+}
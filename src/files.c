@@ -10,8 +10,10 @@
 */
 
 #include "files.h"
+#include "segment.h"
 #include "common.h"
 #include "logging.h"
+#include "adc_convert.h"
 
 #include <sys/stat.h>
 #include <dirent.h>
@@ -141,14 +143,43 @@ int create_files(FILE **files,
     return E502M_ERR_OK;
 }
 
-int create_flac_files(SNDFILE **files,
+int open_wav_files(audio_file **files,
+                   char** file_names,
+                   int files_count,
+                   int* channel_counts_in_files,
+                   int* sample_formats,
+                   double adc_freq,
+                   int wav_writer)
+{
+    for( int i = 0; i < files_count; i++ )
+    {
+        files[i] = open_audio_file(file_names[i],
+                                   channel_counts_in_files[i],
+                                   sample_formats[i],
+                                   adc_freq,
+                                   wav_writer);
+
+        if( files[i] == NULL )
+        {
+            printf("ERROR: Не могу создат wav-файл!\n");
+
+            return E502M_ERR;
+        }
+    }
+
+    return E502M_ERR_OK;
+}
+
+int create_flac_files(audio_file **files,
                       int files_count,
                       struct timeval* start_time,
                       char* path,
                       int* channel_numbers,
                       char** stored_file_names,
                       int* channel_counts_in_files,
-                      double adc_freq)
+                      int* sample_formats,
+                      double adc_freq,
+                      int wav_writer)
 {
     printf("Начинаю создавать flac-файлы.\n");
     struct tm *ts; // time of start recording
@@ -185,22 +216,17 @@ int create_flac_files(SNDFILE **files,
                 i);
 
         strcpy(stored_file_names[i], file_name);
+    }
 
-        SF_INFO sfinfo;
-
-        sfinfo.channels = channel_counts_in_files[i];
-        // sfinfo.frames = 0;
-        // sfinfo.sections = 0;
-        // sfinfo.seekable = 0;
-        sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_DOUBLE;
-        sfinfo.samplerate = adc_freq;
-
-        if( !(files[i] = sf_open(file_name, SFM_WRITE, &sfinfo)) )
-        {
-            printf("ERROR: Не могу создат wav-файл!\n");
-
-            return E502M_ERR;
-        }
+    if( open_wav_files(files,
+                       stored_file_names,
+                       files_count,
+                       channel_counts_in_files,
+                       sample_formats,
+                       adc_freq,
+                       wav_writer) != E502M_ERR_OK )
+    {
+        return E502M_ERR;
     }
 
     printf("Файлы успешно созданы\n");
@@ -275,32 +301,36 @@ void close_files(FILE **files,
 
 }
 
-void close_flac_files(SNDFILE **files,
+void close_flac_files(audio_file **files,
                       char* dir_name,
                       char** file_names,
                       int files_count,
-                      int* file_sizes,
+                      long long* file_sizes,
+                      gap_info* gaps,
+                      int gaps_count,
+                      clock_quality* clock,
                       header *hdr,
                       e502monitor_config *cfg)
 {
     logg("Заканчиваю запись файлов");
 
-    char new_file_name[500] = "";
-    char path_to_file[500] = "";
+    char new_file_name[SEGMENT_NAME_SIZE] = "";
+    char path_to_file[SEGMENT_NAME_SIZE] = "";
 
-    sprintf(path_to_file,
-            "%s/%d_%02d_%02d",
-            dir_name,
-            hdr->start_year,
-            hdr->start_month,
-            hdr->start_day);
+    // files could be opened before start of segment,
+    // so directory of day is checked here
+    struct tm start_day = {0};
+
+    start_day.tm_year = hdr->start_year - 1900;
+    start_day.tm_mon = hdr->start_month - 1;
+    start_day.tm_mday = hdr->start_day;
+
+    prepare_output_directory(dir_name, &start_day, path_to_file);
 
     for(int i = 0; i < files_count; ++i)
     {   
-        sf_close(files[i]);
-
         // set NULL as marker
-        files[i] = NULL;
+        close_audio_file(&files[i]);
 
         // rename files (for correcting start time)
 
@@ -325,7 +355,7 @@ void close_flac_files(SNDFILE **files,
 
         rename(file_names[i], new_file_name);
 
-        create_prop_file(file_names[i], i, file_sizes[i], hdr, cfg);
+        create_prop_file(new_file_name, i, file_sizes[i], gaps, gaps_count, clock, hdr, cfg);
     }
 }
 
@@ -477,18 +507,24 @@ int remove_days( char *path, char *current_day, int count )
 
 void create_prop_file(char* file_name,
                       int    file_id,
-                      int    samples_count,
+                      long long samples_count,
+                      gap_info* gaps,
+                      int    gaps_count,
+                      clock_quality* clock,
                       header* hdr, 
                       e502monitor_config *config)
 {
-    char prop_file_name[256];
+    char prop_file_name[SEGMENT_NAME_SIZE + sizeof(".prop")];
 
-    strcpy(prop_file_name, file_name);
-    // strcpy(&prop_file_name, "/");
-    // strcpy(&prop_file_name, config->bin_dir);
-    strcat(prop_file_name, ".prop");
+    snprintf(prop_file_name, sizeof(prop_file_name), "%s.prop", file_name);
     printf("%s\n", prop_file_name);
     FILE* prop_file = fopen(prop_file_name, "w");
+
+    if( prop_file == NULL )
+    {
+        logg("Ошибка создания файла свойств");
+        return;
+    }
     
     fprintf(prop_file, "start_time=%d.%02d.%02d %02d:%02d:%02d:%d\n", 
             hdr->start_year, 
@@ -510,10 +546,95 @@ void create_prop_file(char* file_name,
             hdr->finish_second,
             hdr->finish_usecond);
 
-    fprintf(prop_file, "samples_count=%d\n", samples_count);
+    fprintf(prop_file, "samples_count=%lld\n", samples_count);
     fprintf(prop_file, "channel_names=%s\n", config->channel_distribution_str[file_id]);
 
+    fprintf(prop_file, "sample_format=%s\n", sample_format_name(config->sample_formats[file_id]));
+
+    // multiplier of stored samples for conversion to volts,
+    // PCM codes are normalized by 2^(bits - 1)
+    fprintf(prop_file, "channel_scales=");
+
+    for(int j = 0; j < config->channel_counts_in_files[file_id]; j++)
+    {
+        double scale = 1.;
+
+        for(int k = 0; k < config->channel_count; k++)
+        {
+            if( config->channel_numbers[k] == config->channel_distribution[file_id][j] &&
+                ( config->sample_formats[file_id] == SAMPLE_PCM16 ||
+                  config->sample_formats[file_id] == SAMPLE_PCM24 ) )
+            {
+                scale = adc_full_scale_volts(config->channel_ranges[k]);
+            }
+        }
+
+        fprintf(prop_file, j == 0 ? "%.12g" : ",%.12g", scale);
+    }
+
+    fprintf(prop_file, "\n");
+
+    print_prop_gaps(prop_file, gaps, gaps_count);
+
+    // times of samples are defined by clock model of module
+    if(clock != NULL)
+    {
+        fprintf(prop_file, "clock_rate=%.6f\n", clock->rate);
+        fprintf(prop_file, "clock_drift_ppm=%.3f\n", clock->drift_ppm);
+        fprintf(prop_file, "clock_residual_us=%.1f\n", clock->residual_us);
+        fprintf(prop_file, "clock_residual_max_us=%.1f\n", clock->residual_max_us);
+        fprintf(prop_file, "clock_outliers=%lld\n", clock->outliers);
+        fprintf(prop_file, "clock_wall_offset_us=%lld\n", clock->wall_offset_us);
+    }
 
 
     fclose(prop_file);
-}
\ No newline at end of file
+}
+
+void print_prop_time(FILE* file, const char* name, long long time_us)
+{
+    struct tm ts;
+    time_t seconds = time_us / 1000000;
+
+    gmtime_r(&seconds, &ts);
+
+    fprintf(file, "%s=%d.%02d.%02d %02d:%02d:%02d:%d\n",
+            name,
+            1900 + ts.tm_year,
+            ts.tm_mon + 1,
+            ts.tm_mday,
+            ts.tm_hour,
+            ts.tm_min,
+            ts.tm_sec,
+            (int)(time_us % 1000000));
+}
+
+void print_prop_gaps(FILE* file, gap_info* gaps, int gaps_count)
+{
+    fprintf(file, "gaps_count=%d\n", gaps_count);
+
+    // gap=<frame after which data is lost>:<count of lost frames>:<cause>:
+    //     <wall time of start of loss in us>:<duration of loss in us>
+    for(int i = 0; i < gaps_count; i++)
+    {
+        fprintf(file, "gap=%lld:%lld:%s:%lld:%lld\n",
+                gaps[i].position,
+                gaps[i].length,
+                gap_cause_name(gaps[i].cause),
+                gaps[i].time_us,
+                gaps[i].duration_us);
+    }
+}
+
+const char* gap_cause_name(int cause)
+{
+    switch(cause)
+    {
+        case GAP_OVERFLOW:  return "overflow";
+        case GAP_RECONNECT: return "reconnect";
+        case GAP_OVERRUN:   return "overrun";
+        case GAP_MISALIGN:  return "misalign";
+        case GAP_MERGE:     return "merge";
+        default:            return "unknown";
+    }
+}
@@ -14,6 +14,7 @@
 
 #include "header.h"
 #include "config.h"
+#include "wav_writer.h"
 
 #include <stdio.h>
 #include <time.h>
@@ -21,9 +22,38 @@
 
 #include <sndfile.h>
 
+#define MAX_SEGMENT_GAPS 256 // max count of gaps stored for one file
+
+#define GAP_OVERFLOW  1 // data was dropped on queue overflow
+#define GAP_RECONNECT 2 // data was lost while module was reconnected
+#define GAP_OVERRUN   3 // buffer of module overflowed
+#define GAP_MISALIGN  4 // samples of some channels are missing in stream
+#define GAP_MERGE     5 // frames of module left ring of merged output before merging
+
+// Interval of lost data in output file
+typedef struct
+{
+    long long position; // index of frame after which data is lost
+    long long length;   // count of lost frames
+    int       cause;    // reason of loss
+    long long time_us;  // wall time of start of loss (0 - unknown)
+    long long duration_us; // wall time of loss
+} gap_info;
+
+// Quality of clock model of module during file
+typedef struct
+{
+    double    rate;            // estimated frames per second
+    double    drift_ppm;       // deviation of rate from nominal
+    double    residual_us;     // rms difference of time stamps of blocks and model
+    double    residual_max_us; // max difference of accepted time stamps
+    long long outliers;        // count of rejected time stamps
+    long long wall_offset_us;  // wall time minus monotonic time used for times of file
+} clock_quality;
+
 typedef struct 
 {   
-    int samples_count;
+    long long samples_count;
     char** channel_names; 
     double freq_diviation; // in % 
 } file_prop;
@@ -64,6 +94,27 @@ void close_files(FILE **files,
                  header *hdr,
                  e502monitor_config *cfg);
 
+/*
+    Opens WAV files with given names.
+
+    files                   - array for file descriptors.
+    file_names              - names of files.
+    files_count             - count of files.
+    channel_counts_in_files - count of channels in each file.
+    sample_formats          - format of samples in each file.
+    adc_freq                - sample rate of files.
+    wav_writer              - library for writing of files.
+
+    Return error index.
+*/
+int open_wav_files(audio_file **files,
+                   char** file_names,
+                   int files_count,
+                   int* channel_counts_in_files,
+                   int* sample_formats,
+                   double adc_freq,
+                   int wav_writer);
+
 /*
     Create multichannel flac-files instead of binary files
 
@@ -73,23 +124,44 @@ void close_files(FILE **files,
     path              - directory for writing data.
     channel_numbers   - numbers of using channels 
     stored_file_names - array for stored file names 
+    sample_formats    - format of samples in each file
+    wav_writer        - library for writing of files
 
     Retutn error index. 
  */
-int create_flac_files(SNDFILE **files,
+int create_flac_files(audio_file **files,
                       int files_count,
                       struct timeval* start_time,
                       char* path,
                       int* channel_numbers,
                       char** stored_file_names,
                       int* channel_counts_in_files,
-                      double adc_freq);
+                      int* sample_formats,
+                      double adc_freq,
+                      int wav_writer);
 
-void close_flac_files(SNDFILE **files,
+/*
+    Finish writing of flac-files and create prop-files for them.
+
+    files       - array of file descriptors.
+    dir_name    - output data directory name.
+    file_names  - names of close files.
+    files_count - count of file descriptors.
+    file_sizes  - count of frames in each file.
+    gaps        - intervals of lost data.
+    gaps_count  - count of intervals of lost data.
+    clock       - quality of time of samples (NULL - unknown)
+    hdr         - special header with information.
+    cfg         - configuration info
+*/
+void close_flac_files(audio_file **files,
                       char* dir_name,
                       char** file_names,
                       int files_count,
-                      int* file_sizes,
+                      long long* file_sizes,
+                      gap_info* gaps,
+                      int gaps_count,
+                      clock_quality* clock,
                       header *hdr,
                       e502monitor_config *cfg);
 
@@ -138,8 +210,35 @@ int remove_days( char *path, char *current_day, int count );
 
 void create_prop_file(char* file_name,
                       int   file_id,
-                      int   samples_count,
+                      long long samples_count,
+                      gap_info* gaps,
+                      int   gaps_count,
+                      clock_quality* clock,
                       header* hdr,
                       e502monitor_config *config);
 
+/*
+    Writes wall time in .prop file as "name=YYYY.MM.DD hh:mm:ss:us".
+
+    file    - .prop file
+    name    - name of field
+    time_us - wall time (us from epoch)
+*/
+void print_prop_time(FILE* file, const char* name, long long time_us);
+
+/*
+    Writes gaps in .prop file as "gaps_count" and
+    "gap=" lines.
+
+    file       - .prop file
+    gaps       - lost data in file
+    gaps_count - count of gaps
+*/
+void print_prop_gaps(FILE* file, gap_info* gaps, int gaps_count);
+
+/*
+    Returns name of cause of gap as in .prop files.
+*/
+const char* gap_cause_name(int cause);
+
 #endif // FILES_H
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "hugemem.c" contains realization of allocation of
+    large sample buffers.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#define _GNU_SOURCE
+
+#include "hugemem.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static size_t round_up(size_t bytes, size_t page)
+{
+    return (bytes + page - 1) / page * page;
+}
+
+// Maps region aligned to huge page, so whole
+// region can be backed by transparent huge pages
+static void* map_aligned(size_t bytes)
+{
+    char* region = (char*)mmap(NULL, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(region == MAP_FAILED){ return NULL; }
+
+    char* start = (char*)round_up((uintptr_t)region, HUGE_PAGE_SIZE);
+    size_t head = start - region;
+    size_t tail = HUGE_PAGE_SIZE - head;
+
+    if(head > 0){ munmap(region, head); }
+    if(tail > 0){ munmap(start + bytes, tail); }
+
+    return start;
+}
+
+void* alloc_sample_memory(sample_memory* mem, size_t bytes, int huge_pages)
+{
+    char log_msg[300] = "";
+
+    mem->memory = NULL;
+    mem->bytes = 0;
+    mem->pages = HUGE_PAGES_OFF;
+
+    if(bytes == 0){ bytes = 1; }
+
+    if(huge_pages == HUGE_PAGES_EXPLICIT)
+    {
+        size_t length = round_up(bytes, HUGE_PAGE_SIZE);
+        void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if(memory != MAP_FAILED)
+        {
+            mem->memory = memory;
+            mem->bytes = length;
+            mem->pages = HUGE_PAGES_EXPLICIT;
+
+            return memory;
+        }
+
+        // pool of huge pages is empty (vm.nr_hugepages)
+        sprintf(log_msg, "Нет свободных huge pages для буфера %zu байт (%s), используются THP",
+                bytes, strerror(errno));
+        logg(log_msg);
+
+        huge_pages = HUGE_PAGES_THP;
+    }
+
+    if(huge_pages == HUGE_PAGES_THP)
+    {
+        size_t length = round_up(bytes, HUGE_PAGE_SIZE);
+        void* memory = map_aligned(length);
+
+        if(memory == NULL){ return NULL; }
+
+        mem->memory = memory;
+        mem->bytes = length;
+
+        if(madvise(memory, length, MADV_HUGEPAGE) == 0)
+        {
+            mem->pages = HUGE_PAGES_THP;
+        } else {
+            sprintf(log_msg, "THP недоступны для буфера %zu байт (%s), используются обычные страницы",
+                    bytes, strerror(errno));
+            logg(log_msg);
+        }
+
+        return memory;
+    }
+
+    size_t length = round_up(bytes, sysconf(_SC_PAGESIZE));
+    void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(memory == MAP_FAILED){ return NULL; }
+
+    mem->memory = memory;
+    mem->bytes = length;
+
+    return memory;
+}
+
+void free_sample_memory(sample_memory* mem)
+{
+    if(mem->memory == NULL){ return; }
+
+    munmap(mem->memory, mem->bytes);
+
+    mem->memory = NULL;
+    mem->bytes = 0;
+}
+
+const char* huge_pages_name(int huge_pages)
+{
+    switch(huge_pages)
+    {
+        case HUGE_PAGES_THP:      return "thp";
+        case HUGE_PAGES_EXPLICIT: return "explicit";
+        default:                  return "off";
+    }
+}
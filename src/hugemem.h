@@ -0,0 +1,52 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "hugemem.h" contains declaration of allocation of
+    large sample buffers. Buffers can be placed in huge
+    pages, so passes over samples take fewer TLB misses.
+    If huge pages aren't available ordinary pages are used.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef HUGEMEM_H
+#define HUGEMEM_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+    void*  memory;   // start of buffer (NULL - not allocated)
+    size_t bytes;    // length of mapping
+    int    pages;    // HUGE_PAGES_* which are really used
+} sample_memory;
+
+/*
+    Allocates zeroed buffer.
+
+    mem        - description of buffer
+    bytes      - size of buffer
+    huge_pages - HUGE_PAGES_OFF, HUGE_PAGES_THP or HUGE_PAGES_EXPLICIT.
+                 Explicit huge pages fall back to transparent
+                 huge pages, those fall back to ordinary pages.
+
+    Returns pointer to buffer or NULL if memory wasn't allocated.
+*/
+void* alloc_sample_memory(sample_memory* mem, size_t bytes, int huge_pages);
+
+/*
+    Frees buffer. Buffer which wasn't allocated is ignored.
+*/
+void free_sample_memory(sample_memory* mem);
+
+/*
+    Returns name of kind of pages as in config file.
+*/
+const char* huge_pages_name(int huge_pages);
+
+#endif // HUGEMEM_H
@@ -8,37 +8,31 @@
     Email: gm16493@gmail.com
 */
 
-#include "pdouble_queue.h"
+#include "acquisition.h"
+#include "stats.h"
 #include "config.h"
 #include "common.h"
 #include "files.h"
-#include "header.h"
 #include "device.h"
 #include "logging.h"
-#include "frame.h"
+#include "realtime.h"
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
-#include <pthread.h>
-#include <errno.h>
+#include <unistd.h>
 #include <string.h>
 
 static int            g_stop = 0; // if equal 1 - stop working
+static int            g_snapshot = 0; // 1 - snapshot of pre-roll is requested
 static struct timeval g_time_start; // time of start writing file
-static struct timeval g_time_end;   // time of finish writing file
-static struct timeval g_prev_time_start; // time start of previuos file
 
-// static FILE**      g_bin_files = NULL; // binary files for stored data
-static SNDFILE**   g_audio_files = NULL; // audio files for stored data
-static header   g_header; // header with information 
-static e502monitor_config*  g_config = NULL; // structure for configure
-static pdouble_queue* g_data_queue = NULL; // queue for stored data
-
-// static char **g_old_bin_file_names = NULL; // array of old file names
-static char **g_old_audio_file_names = NULL; // array of old file names
+static e502monitor_config*  g_config = NULL; // common configuration
+static acquisition**  g_acquisitions = NULL; // data collection from each module
+static int            g_acquisitions_count = 0;
+static merge_stage*   g_merge = NULL; // merged output of modules
 
 /*
     Creates stop event heandler for
@@ -52,10 +46,9 @@ void create_stop_event_handler();
 void abort_handler(int sig);
 
 /*
-    Function for running in another thread.
-    Writes data on disk.
+    Signal of request of snapshot (SIGUSR1)
 */
-void* write_data(void *arg);
+void snapshot_handler(int sig);
 
 /*
     Returns current day as string.
@@ -81,17 +74,15 @@ void clear_dir();
 void print_program_info();
 
 /*
-    Find file by channel index
-*/
-int find_flac_file_index(int channel_index);
+    Checks that all modules from configuration
+    are connected.
 
-// /*
-//     Reconects to device.
+    devrec_list  - list of available devices
+    device_count - count of devices in list
 
-//     attempts_nmbr - the number of attempts to establish a connection
-//     time_out - waiting time for another attempt 
-// */
-// void reconect_to_device(int time_out, int attempts_nmbr);
+    Returns 1 if all modules are found, 0 otherwise.
+*/
+int all_devices_found(t_x502_devrec *devrec_list, uint32_t device_count);
 
 int main(int argc, char** argv)
 {
@@ -102,9 +93,6 @@ int main(int argc, char** argv)
     logg("Создаю обработчик для события завершения сбора данных");
     create_stop_event_handler();
 
-    logg("Создаю очередь для хранения данных");
-    g_data_queue = create_pdouble_queue();
-
     logg("Создаю структуру для конфигурирования");
     g_config = create_config();
 
@@ -131,337 +119,200 @@ int main(int argc, char** argv)
         return E502M_EXIT_FAILURE;
     }
 
-    print_config(g_config);
-
-    uint32_t fnd_devcnt = 0;
-    t_x502_devrec *devrec_list = NULL;
+    // without "devices" list first found module is used
+    g_acquisitions_count = g_config->devices_count > 0 ? g_config->devices_count : 1;
+    g_acquisitions = (acquisition**)calloc(g_acquisitions_count, sizeof(acquisition*));
 
-    // try to connect
-    int point_counter = 0;
-    printf("Поиск устройств...\n");
-    while(fnd_devcnt == 0  && !g_stop){
-        fnd_devcnt = get_usb_devrec(&devrec_list);
-        usleep(1000000);
-    }
-    
-    if (fnd_devcnt == 0) 
+    for(int i = 0; i < g_acquisitions_count; i++)
     {
-        printf("Не найдено ни одного модуля. Завершение.\n");
-        logg("Не найдено ни одного модуля. Завершение");
-        free_global_memory();
+        e502monitor_config* config = create_config();
 
-        return E502M_EXIT_FAILURE;
-    }
+        if( config == NULL ||
+            (g_config->devices_count > 0 ? init_device_config(&config, i) :
+                                           init_config(&config)) != E502M_ERR_OK )
+        {
+            printf("Ошибка конфигурационного файла. Заверешние.\n");
+            logg("Ошибка конфигурационного файла. Заверешние");
 
-    print_available_devices(devrec_list, fnd_devcnt);
+            if( config != NULL ){ destroy_config(&config); }
 
-    //------------------------------- choose lcard device for working--------------------------
-    printf("Введите номер модуля, с которым хотите работать (от 0 до %d)\n", fnd_devcnt-1);
-    fflush(stdout);
+            free_global_memory();
 
-    uint32_t device_id = -1;
+            return E502M_EXIT_FAILURE;
+        }
 
-    // scanf("%d", &device_id);
-    
-    // HACK: choose device 0 by default
-    device_id = 0;
+        // temporary files of modules must not be mixed
+        for(int j = 0; j < i; j++)
+        {
+            if( check_device_dirs(config, g_acquisitions[j]->config) != E502M_ERR_OK )
+            {
+                logg("Модули используют одну директорию. Заверешние");
 
-    if( device_id < 0 || device_id >= fnd_devcnt)
-    {
-        printf("\nНеверный номер модуля! Завершение.\n");
-        logg("Указан неверный номер модуля! Завершение");
+                destroy_config(&config);
+                free_global_memory();
 
-        X502_FreeDevRecordList(devrec_list, fnd_devcnt);
-        free(devrec_list);
+                return E502M_EXIT_FAILURE;
+            }
+        }
 
-        free_global_memory();
+        print_config(config);
 
-        return E502M_EXIT_FAILURE;
-    }
-    //----------------------------------------------------------------------------------------
+        g_acquisitions[i] = create_acquisition(config, &g_stop);
 
-    t_x502_hnd device_hnd = open_device(devrec_list, device_id);
+        if( g_acquisitions[i] == NULL )
+        {
+            printf("Ошибка подготовки сбора данных. Завершение.\n");
+            logg("Ошибка подготовки сбора данных. Завершение");
 
-    if(device_hnd == NULL)
-    {
-        printf("Ошибка установления связи с модулем. Завершение.\n");
-        logg("Ошибка установления связи с модулем. Завершение");
-        
-        X502_FreeDevRecordList(devrec_list, fnd_devcnt);
-        free(devrec_list);
+            free_global_memory();
 
-        free_global_memory();
-        
-        return E502M_EXIT_FAILURE;
+            return E502M_EXIT_FAILURE;
+        }
     }
 
-    X502_FreeDevRecordList(devrec_list, fnd_devcnt);
-    free(devrec_list);
-
-    print_info_about_device(device_hnd);
+    if( g_config->merge_mode != MERGE_OFF )
+    {
+        e502monitor_config** configs = (e502monitor_config**)malloc(sizeof(e502monitor_config*) *
+                                                                    g_acquisitions_count);
 
-    logg("Настраиваю устройство...");
-    configure_device(device_hnd, g_config);
-    logg("Устройство настроено...");
+        for(int i = 0; i < g_acquisitions_count; i++){ configs[i] = g_acquisitions[i]->config; }
 
-    // initialize some header fields
-    g_header.adc_freq = g_config->adc_freq / g_config->channel_count;
-    strcpy(g_header.module_name, g_config->module_name);
-    strcpy(g_header.place, g_config->place);
+        g_merge = create_merge_stage(g_config, configs, g_acquisitions_count);
 
-    uint32_t adc_size = sizeof(double)*g_config->read_block_size;
-    int32_t  rcv_size;
-    uint32_t first_lch;
-    uint32_t* rcv_buf  = (uint32_t*)malloc(sizeof(uint32_t)*g_config->read_block_size);
-    int total_file_sizes = g_config->file_size * g_config->adc_freq * g_config->channel_count;
-    int current_file_sizes = 0;
-    double* data;
+        free(configs);
 
-    // allocate memory for old files array
-    // g_old_bin_file_names = (char**)malloc(sizeof(char*) * g_config->channel_count);
-    
-    // for(int i = 0; i < g_config->channel_count; i++)
-    // {
-    //     g_old_bin_file_names[i] = (char*)malloc(sizeof(char) * 101);
-    // }
+        if( g_merge == NULL || start_merge_stage(g_merge) != E502M_ERR_OK )
+        {
+            printf("Ошибка подготовки объединения файлов модулей. Завершение.\n");
+            logg("Ошибка подготовки объединения файлов модулей. Завершение");
 
-    g_old_audio_file_names = (char**)malloc(sizeof(char*) * g_config->channel_count);
-    
-    for(int i = 0; i < g_config->channel_count; i++)
-    {
-        g_old_audio_file_names[i] = (char*)malloc(sizeof(char) * 101);
-    }
+            free_global_memory();
 
-    logg("Создаю файлы");
+            return E502M_EXIT_FAILURE;
+        }
 
-    gettimeofday(&g_time_start, NULL);
-    
-    // TODO: fix this function
-    // clear_dir();
+        set_thread_cpus(g_merge->thread, g_config->finisher_cpus, "объединения файлов");
 
-    // g_bin_files = (FILE*)malloc(sizeof(FILE*)*g_config->channel_count);
-    g_audio_files = (SNDFILE*)malloc(sizeof(SNDFILE*)*g_config->channel_count);
+        for(int i = 0; i < g_acquisitions_count; i++)
+        {
+            g_acquisitions[i]->merge = g_merge;
+            g_acquisitions[i]->merge_input = i;
+        }
+    }
 
-    logg("Создаю отдельный поток для записи данных");
+    uint32_t fnd_devcnt = 0;
+    t_x502_devrec *devrec_list = NULL;
 
-    uint32_t  err = X502_StreamsStart(device_hnd);
-    if(err != X502_ERR_OK)
+    // try to connect
+    printf("Поиск устройств...\n");
+    while( !g_stop )
     {
-        fprintf(stderr,
-                "Ошибка запуска сбора данных: %s!\n",
-                X502_GetErrorString(err)
-                );
-        logg("Ошибка запуска сбора данных");
-
-        free_global_memory();
-
-        return E502M_EXIT_FAILURE;
-    }
-
-    printf("Сбор данных запущен. Для остановки нажмите Ctrl+C\n");
-    fflush(stdout);
+        fnd_devcnt = get_usb_devrec(&devrec_list);
 
-    int current_file_block_add = g_config->read_block_size; // / g_config->channel_count;
+        if( all_devices_found(devrec_list, fnd_devcnt) ){ break; }
 
-    // current_file_size = total_file_size;
+        if(fnd_devcnt > 0)
+        {
+            X502_FreeDevRecordList(devrec_list, fnd_devcnt);
+            free(devrec_list);
 
-    int read_block_size = g_config->read_block_size;
-    int read_timeout = g_config->read_timeout; 
-    int real_file_sizes = 0;
+            devrec_list = NULL;
+            fnd_devcnt = 0;
+        }
 
-    gettimeofday(&g_time_start, NULL);
+        usleep(1000000);
+    }
     
-    // err = create_files(g_bin_files,
-    //                    g_config->channel_count,
-    //                    &g_time_start,
-    //                    g_config->bin_dir,
-    //                    g_config->channel_numbers,
-    //                    g_old_bin_file_names);
-
-    err = create_flac_files(g_audio_files,
-                            g_config->files_count,
-                            &g_time_start,
-                            g_config->bin_dir,
-                            g_config->channel_numbers,
-                            g_old_audio_file_names,
-                            g_config->channel_counts_in_files,
-                            g_config->adc_freq);
-
-    if( err != E502M_ERR_OK )
+    if (fnd_devcnt == 0) 
     {
-        logg("Ошибка создания описателей выходных файлов");
-
-        X502_Close(device_hnd);
-        X502_Free(device_hnd);
-
+        printf("Не найдено ни одного модуля. Завершение.\n");
+        logg("Не найдено ни одного модуля. Завершение");
         free_global_memory();
 
         return E502M_EXIT_FAILURE;
     }
 
-    // main loop for receiving data
-
-    gettimeofday(&g_prev_time_start, NULL);
-
-    int is_need_restart = 0; // 0 - not, 1 - yes
+    print_available_devices(devrec_list, fnd_devcnt);
 
-    pthread_t thread;
-    pthread_create(&thread, NULL, write_data, NULL);
-    pthread_detach(thread);
+    gettimeofday(&g_time_start, NULL);
+    
+    // TODO: fix this function
+    // clear_dir();
 
-    while(!g_stop)
+    for(int i = 0; i < g_acquisitions_count; i++)
     {
-        data = (double*)malloc(sizeof(double) * read_block_size);
-        
-        // if need create new files store moment of
-        // reading new block data
-        // current_file_size += g_config->read_block_size / g_config->channel_count;
-        // current_file_sizes += current_file_block_add;
-        // current_file_size += read_block_size;
-
-        // if( current_file_sizes >= total_file_sizes )
-        if(real_file_sizes + read_block_size >= total_file_sizes)
-        {
-            read_block_size = total_file_sizes - real_file_sizes;
-
-#ifdef DBG
-            printf("\nСчитано сэмплов: %d\n", real_file_sizes);
-            printf("До эталонного количества сэмплов необходимо прочесть сэмплов: %d\n",
-                 read_block_size);
-#endif
-            real_file_sizes = 0;
-            // current_file_sizes = 0;
-            
-            // gettimeofday(&g_time_start, NULL);
-            rcv_size = X502_Recv(device_hnd,
-                                 rcv_buf,
-                                 read_block_size,
-                                 read_timeout);
-
-            if(rcv_size < 0) // some errors
-            {
-                logg("Ошибка получения данных");
-
-                g_stop = 1; 
-                is_need_restart = 1;
-                break; // exit from receiving data loop 
-            }
-
-
-            gettimeofday(&g_time_start, NULL);
-            gettimeofday(&g_time_end, NULL);
-
-            // initialize time fields in header ---------------------
-            struct tm *ts;
-            
-            // ts = gmtime(&g_time_start.tv_sec);
-            ts = gmtime(&g_prev_time_start.tv_sec);
+        int device_id = find_device(devrec_list, fnd_devcnt, g_acquisitions[i]->config->serial);
 
-            g_header.start_year         = 1900 + ts->tm_year;
-            g_header.start_month        = ts->tm_mon + 1;
-            g_header.start_day          = ts->tm_mday;
-            g_header.start_hour         = ts->tm_hour;
-            g_header.start_minut        = ts->tm_min;
-            g_header.start_second       = ts->tm_sec;
-            g_header.start_usecond      = (int)g_time_start.tv_usec;
-            
-            ts = gmtime(&g_time_end.tv_sec);
-            
-            g_header.finish_year        = 1900 + ts->tm_year;
-            g_header.finish_month       = ts->tm_mon + 1;
-            g_header.finish_day         = ts->tm_mday;
-            g_header.finish_hour        = ts->tm_hour;
-            g_header.finish_minut       = ts->tm_min;
-            g_header.finish_second      = ts->tm_sec;
-            g_header.finish_usecond     = (int)g_time_start.tv_usec;
-            // ------------------------------------------------------
-
-            g_prev_time_start = g_time_start;
-
-            // last_buffer_index = NOT_LAST_BUFFER;
-            // read_block_size = g_config->read_block_size;
-#ifdef DBG
-            printf("Последний буфер прочитан %d\n", rcv_size);
-            logg("Последний буфер прочитан");
-#endif
-
-
-            X502_GetNextExpectedLchNum(device_hnd, &first_lch);
-
-            adc_size = sizeof(double) * read_block_size;
-
-            err = X502_ProcessData(device_hnd, rcv_buf, rcv_size, X502_PROC_FLAGS_VOLT,
-                                       data, &adc_size, NULL, NULL);
-            
-            push_to_pdqueue(g_data_queue, &data, rcv_size, first_lch, LAST_BUFFER);
-
-            read_block_size = g_config->read_block_size;
-        } else {
-
-
-            rcv_size = X502_Recv(device_hnd,
-                                 rcv_buf,
-                                 read_block_size,
-                                 read_timeout);
-            
-            // printf("RCV_Size = %d\n", rcv_size);
-
-
-            if(rcv_size < 0) // some errors
-            {
-                logg("Ошибка получения данных");
-                g_stop = 1; 
-                is_need_restart = 1;
-                break; // exit from receiving data loop 
-            }
+        if( start_acquisition(g_acquisitions[i], &devrec_list[device_id], &g_time_start) != E502M_ERR_OK )
+        {
+            printf("Ошибка запуска сбора данных. Завершение.\n");
+            logg("Ошибка запуска сбора данных. Завершение");
 
-            X502_GetNextExpectedLchNum(device_hnd, &first_lch);
+            g_stop = 1;
+            break;
+        }
+    }
 
-            adc_size = sizeof(double) * read_block_size;
+    X502_FreeDevRecordList(devrec_list, fnd_devcnt);
+    free(devrec_list);
 
-            err = X502_ProcessData(device_hnd, rcv_buf, rcv_size, X502_PROC_FLAGS_VOLT,
-                                   data, &adc_size, NULL, NULL);
-            
-            real_file_sizes += rcv_size;
+    // all buffers are allocated, program works without
+    // locking if there are no privileges
+    if( !g_stop && g_config->lock_memory && lock_process_memory() == E502M_ERR_OK )
+    {
+        stats_set(&g_stats.memory_locked, 1);
+    }
 
-            if(real_file_sizes == total_file_sizes)
-            {
-                real_file_sizes = 0;
-                push_to_pdqueue(g_data_queue, &data, rcv_size, first_lch, LAST_BUFFER);
-            }
+    if( !g_stop )
+    {
+        printf("Сбор данных запущен. Для остановки нажмите Ctrl+C\n");
+        fflush(stdout);
+    }
 
-            push_to_pdqueue(g_data_queue, &data, rcv_size, first_lch, NOT_LAST_BUFFER);
+    // modules are read by own threads
+    while( !g_stop )
+    {
+        if( __atomic_exchange_n(&g_snapshot, 0, __ATOMIC_RELAXED) )
+        {
+            logg("Запрошен снимок предзаписи");
 
+            for(int i = 0; i < g_acquisitions_count; i++){ request_snapshot(g_acquisitions[i]); }
         }
+
+        usleep(100000);
     }
 
-    while(pthread_kill(thread, 0) != ESRCH){
-#ifdef DBG
-    printf("Ожидаю заверешения потока записи данных...\n");
-    logg("Ожидаю заверешения потока записи данных");
-#endif
-        usleep(10);
+    for(int i = 0; i < g_acquisitions_count; i++)
+    {
+        wait_acquisition(g_acquisitions[i]);
     }
 
-    X502_Close(device_hnd);
-    X502_Free(device_hnd);
+    // all data of modules is passed to merging thread
+    if( g_merge != NULL ){ stop_merge_stage(g_merge); }
 
     free_global_memory();
 
-    if(is_need_restart)
+    return 0;
+}
+
+int all_devices_found(t_x502_devrec *devrec_list, uint32_t device_count)
+{
+    for(int i = 0; i < g_acquisitions_count; i++)
     {
-        printf("Пытаюсь перезапуститься...\n");
-        logg("Перезапуск");
-        system("./e502monitor");
+        if( find_device(devrec_list, device_count, g_acquisitions[i]->config->serial) < 0 )
+        {
+            return 0;
+        }
     }
 
-    return 0;
+    return 1;
 }
 
 
-
 void abort_handler(int sig){ g_stop = 1; }
 
+void snapshot_handler(int sig){ g_snapshot = 1; }
+
 void create_stop_event_handler()
 {
     struct sigaction sa;
@@ -470,221 +321,9 @@ void create_stop_event_handler()
     sigaction(SIGTERM, &sa, NULL);
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGABRT, &sa, NULL);
-}
-
-void* write_data(void *arg)
-{
-    int* real_file_sizes = (int*)malloc(sizeof(int) * g_config->files_count);
-    for(int i = 0; i < g_config->files_count; i++)
-    {
-        real_file_sizes[i] = 0;
-    }
-
-    int* file_sizes = (int*)malloc(sizeof(int) * g_config->channel_count);
-    int* fill_index_files = (int*)malloc(sizeof(int) * g_config->channel_count);
-    
-    for(int i = 0; i < g_config->channel_count; i++) 
-    { 
-        file_sizes[i] = 0;
-        fill_index_files[i] = 0;    
-    }
-
-    double** rest_buffers = (double**)malloc(sizeof(double*)*g_config->channel_count);
-    int *rest_buffer_sizes = (int*)malloc(sizeof(int) * g_config->channel_count );
-
-    for(int i = 0; i < g_config->channel_count; i++) 
-    { 
-        rest_buffers[i] = (double*)malloc(sizeof(double)* g_config->read_block_size);
-        rest_buffer_sizes[i] = 0;
-    }
-
-    int ch_cntr, data_cntr; // counters
-    int size;
-
-    int total_file_size = g_config->file_size * g_config->adc_freq; //* g_config->channel_count;
-
-#ifdef DBG
-    printf("Эталонное количество сэмплов во всех файлах: %d\n", total_file_size);
-#endif
-
-    int buffer_state;
-
-    double *data = NULL;
-
-    int sleep_time = g_config->read_timeout / 2; 
-    int last_buffer_index = NOT_LAST_BUFFER;
-
-    int flac_files_index = 0;
-
-    data_frame** frames = (data_frame**)malloc(sizeof(data_frame*) * g_config->files_count);
-
-    for(int i = 0; i < g_config->files_count; i++)
-    {
-        frames[i] = create_frame(g_config->channel_counts_in_files[i], 
-                                 g_config->channel_distribution[i]);
-    }
-
-    while(!g_stop || !empty(g_data_queue))
-    {
-        pop_from_pdqueue(g_data_queue, &data, &size, &ch_cntr, &last_buffer_index);
-
-        if(data != NULL)
-        {   
-        
-            for(data_cntr = 0; data_cntr < size; data_cntr++, ch_cntr++)
-            {                               
-                if(ch_cntr == g_config->channel_count){ ch_cntr = 0; } 
-
-                if(fill_index_files[ch_cntr] == 1)
-                { 
-                    
-                    rest_buffers[ch_cntr][rest_buffer_sizes[ch_cntr]] = data[data_cntr];
-                    rest_buffer_sizes[ch_cntr] ++;
-
-                } else {
-                    
-                    flac_files_index = find_flac_file_index(ch_cntr);
-
-                    add_data_in_frame(frames[flac_files_index], 
-                                      data[data_cntr],
-                                      g_config->channel_numbers[ch_cntr]);
-                    
-                    if(is_frame_full(frames[flac_files_index]) == FRAME_FULL)
-                    {
-                        real_file_sizes[flac_files_index] ++;
-
-                        sf_writef_float(g_audio_files[flac_files_index],
-                                        frames[flac_files_index]->data,
-                                        1);
-
-                        clear_frame(frames[flac_files_index]);
-                    }
-                    
-                }
-                
-
-            }                
-
-            if(last_buffer_index == LAST_BUFFER)
-            {
-
-                // close_files(g_bin_files,
-                //             g_config->bin_dir,
-                //             g_old_bin_file_names,
-                //             g_config->channel_count,
-                //             &g_header,
-                //             g_config);
-                close_flac_files(g_audio_files,
-                                g_config->bin_dir,
-                                g_old_audio_file_names,
-                                g_config->files_count,
-                                real_file_sizes,
-                                &g_header,
-                                g_config);
-
-                printf("Запись файлов завершена\n");
-                // TODO: fix this function
-                // clear_dir();
-
-                // create_files(g_bin_files,
-                //              g_config->channel_count,
-                //              &g_time_start,
-                //              g_config->bin_dir,
-                //              g_config->channel_numbers,
-                //              g_old_bin_file_names);
-
-                create_flac_files(g_audio_files,
-                                  g_config->files_count,
-                                  &g_time_start,
-                                  g_config->bin_dir,
-                                  g_config->channel_numbers,
-                                  g_old_audio_file_names,
-                                  g_config->channel_counts_in_files,
-                                  g_config->adc_freq);
-                printf("Новые файлы созданы\n");
-
-                for(int i = 0; i < g_config->files_count; i++)
-                {
-                    real_file_sizes[i] = 0;
-                }
-            }
-            
-            free(data);   
-        } else { 
-            usleep(sleep_time); // sleep to save process time
-        }
-    }    
-
-    // initialize time in header
-
-    gettimeofday(&g_time_start, NULL);
-    gettimeofday(&g_time_end, NULL);
-
-    // initialize time fields in header ---------------------
-    struct tm *ts;
-            
-    // ts = gmtime(&g_time_start.tv_sec);
-    ts = gmtime(&g_prev_time_start.tv_sec);
-
-    g_header.start_year         = 1900 + ts->tm_year;
-    g_header.start_month        = ts->tm_mon + 1;
-    g_header.start_day          = ts->tm_mday;
-    g_header.start_hour         = ts->tm_hour;
-    g_header.start_minut        = ts->tm_min;
-    g_header.start_second       = ts->tm_sec;
-    g_header.start_usecond      = (int)g_time_start.tv_usec;
-            
-    ts = gmtime(&g_time_end.tv_sec);
-
-    g_header.finish_year         = 1900 + ts->tm_year;
-    g_header.finish_month        = ts->tm_mon + 1;
-    g_header.finish_day          = ts->tm_mday;
-    g_header.finish_hour        = ts->tm_hour;
-    g_header.finish_minut       = ts->tm_min;
-    g_header.finish_second      = ts->tm_sec;
-    g_header.finish_usecond     = (int)g_time_start.tv_usec;
-    // ------------------------------------------------------
-
-    // close files
-    // close_files(g_bin_files,
-    //             g_config->bin_dir,
-    //             g_old_bin_file_names,
-    //             g_config->channel_count,
-    //             &g_header,
-    //             g_config);
-
-    close_flac_files(g_audio_files,
-                    g_config->bin_dir,
-                    g_old_audio_file_names,
-                    g_config->files_count,
-                    real_file_sizes,
-                    &g_header,
-                    g_config);
-
-
-    free(file_sizes);
-    free(real_file_sizes);
-    free(fill_index_files);
-    free(rest_buffer_sizes);
-
-    for(int i = 0; i < g_config->channel_count; i++)
-    {
-        free(rest_buffers[i]);
-    }
-
-
-    free(rest_buffers);
-
-    for( int i = 0; i < g_config->files_count; i++)
-    {
-        destroy_frame(frames[i]);
-    }
-
-
-
-    
-    free(frames);
 
+    sa.sa_handler = snapshot_handler;
+    sigaction(SIGUSR1, &sa, NULL);
 }
 
 void get_current_day_as_string(char **current_day)
@@ -729,70 +368,27 @@ void clear_dir()
 
 void free_global_memory()
 {
-    // if( g_bin_files != NULL )
-    // {
-
-    //     logg("Особождаю память от заголовков файлов");
-
-    //     free(g_bin_files);
-
-    //     logg("Память от заголовков файлов освобождена");
-         
-    // }  
-        if( g_audio_files != NULL )
-    {
-
-        logg("Особождаю память от заголовков файлов");
-
-        free(g_audio_files);
-
-        logg("Память от заголовков файлов освобождена");
-         
-    }  
-
-    if( g_data_queue != NULL)
-    { 
-
-        logg("Разрушаю потокобезопасную очередь");
-
-        destroy_pdouble_queue(&g_data_queue); 
-
-        logg("Потокобезопасная очередь разрушена");        
-    }
-    
-    // if( g_old_bin_file_names != NULL )
-    // {
-
-    //     logg("Особождаю память от массива старых имен файлов");
-        
-    //     for(int i = 0; i < g_config->channel_count; i++)
-    //     {
-    //         free(g_old_bin_file_names[i]);
-    //     }
-
-    //     free(g_old_bin_file_names);
-
-    //     logg("Память от массива старых имен файлов освобождена.\n");
-
-
-    // } 
-
-    if( g_old_audio_file_names != NULL )
+    if( g_acquisitions != NULL )
     {
+        logg("Освобождаю память модулей");
 
-        logg("Особождаю память от массива старых имен файлов");
-        
-        for(int i = 0; i < g_config->channel_count; i++)
+        for(int i = 0; i < g_acquisitions_count; i++)
         {
-            free(g_old_audio_file_names[i]);
+            if( g_acquisitions[i] != NULL ){ destroy_acquisition(&g_acquisitions[i]); }
         }
 
-        free(g_old_audio_file_names);
+        free(g_acquisitions);
+        g_acquisitions = NULL;
 
-        logg("Память от массива старых имен файлов освобождена.\n");
+        logg("Память модулей освобождена");
+    }
 
+    if( g_merge != NULL )
+    {
+        logg("Освобождаю память объединения файлов модулей");
 
-    } 
+        destroy_merge_stage(&g_merge);
+    }
 
     if ( g_config != NULL )
     {
@@ -821,21 +417,3 @@ void print_program_info()
     printf("Email: gm16493@gmail.com\n\n");
 
 }
-
-int find_flac_file_index(int channel_index)
-{
-    channel_index = g_config->channel_numbers[channel_index];
-
-    for(int i = 0; i < g_config->files_count; i++)
-    {
-        for(int j = 0; j < g_config->channel_counts_in_files[i]; j++)
-        {
-            if( g_config->channel_distribution[i][j] == channel_index )
-            {
-                return i;
-            }
-        }
-    }
-
-    return E502M_ERR;
-}
\ No newline at end of file
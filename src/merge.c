@@ -0,0 +1,898 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "merge.c" contains realization of merged output
+    of several modules.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "merge.h"
+#include "files.h"
+#include "logging.h"
+#include "realtime.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/*
+    Function for running in merging thread.
+    Computes frames on common timeline and writes
+    merged files.
+*/
+static void* merge_data(void* arg);
+
+/*
+    Returns count of merged frames which can be computed
+    from frames of all modules, starting from frame first.
+    Chooses start of timeline when all modules have data.
+    Called under mutex.
+
+    stage   - merge stage
+    base_us - start of timeline (-1 - not chosen yet)
+    first   - index of first merged frame
+*/
+static int available_frames(merge_stage* stage, long long* base_us, long long first);
+
+/*
+    Copies frames of modules and their clock models which
+    are needed for batch of merged frames. Called under mutex.
+
+    stage   - merge stage
+    base_us - start of timeline
+    first   - index of first merged frame
+    count   - count of frames
+*/
+static void copy_windows(merge_stage* stage, long long base_us, long long first, int count);
+
+/*
+    Computes merged frames from copied windows of
+    modules and adds zero frames to gaps of file.
+    Called without mutex.
+
+    stage      - merge stage
+    base_us    - start of timeline
+    first      - index of first merged frame
+    count      - count of frames
+    file_first - index of first frame of merged file
+*/
+static void fill_frames(merge_stage* stage,
+                        long long base_us,
+                        long long first,
+                        int count,
+                        long long file_first);
+
+/*
+    Closes merged file, renames it by start time and
+    writes .prop file with alignment of modules.
+
+    stage         - merge stage
+    file          - pointer to pointer to file
+    start_us      - wall time of first frame
+    frames_count  - count of frames in file
+    reports       - alignment of modules in file
+*/
+static void finish_merged_file(merge_stage* stage,
+                               audio_file** file,
+                               long long start_us,
+                               long long frames_count,
+                               merge_input* reports);
+
+static void push_sample(merge_input* input, float sample, int cause)
+{
+    input->partial[input->partial_count++] = sample;
+
+    if(cause != 0){ input->partial_cause = cause; }
+
+    if(input->partial_count < input->channel_count){ return; }
+
+    long long slot = input->frames_count % input->capacity;
+
+    memcpy(input->frames + slot * input->channel_count,
+           input->partial,
+           sizeof(float) * input->channel_count);
+
+    input->lost[slot] = (unsigned char)input->partial_cause;
+
+    input->frames_count++;
+    input->partial_count = 0;
+    input->partial_cause = 0;
+}
+
+// Time of frame of module, model of module counts samples of all channels
+static double frame_time(clock_model* clock, int channel_count, double frame, long long base_us)
+{
+    return clock_model_time(clock, frame * channel_count, base_us);
+}
+
+// Fractional frame of module at time base_us + offset_us
+static double frame_index(clock_model* clock, int channel_count, long long base_us, double offset_us)
+{
+    return clock_model_index(clock, base_us, offset_us) / channel_count;
+}
+
+// Frame of module from window or zeros if it isn't there
+static const float* window_frame(merge_stage* stage, merge_input* input, long long index, int* cause)
+{
+    long long offset = index - input->window_first;
+
+    if(offset < 0 || offset >= input->window_frames)
+    {
+        *cause = GAP_MERGE;
+        return stage->zero_frame;
+    }
+
+    *cause = input->window_lost[offset];
+
+    return input->window + offset * input->channel_count;
+}
+
+merge_stage* create_merge_stage(e502monitor_config* config,
+                                e502monitor_config** modules,
+                                int modules_count)
+{
+    for(int i = 0; i < modules_count; i++)
+    {
+        if( modules[i]->capture_mode != CAPTURE_WAV )
+        {
+            printf("Объединение файлов модулей невозможно в режиме raw.\n");
+            logg("Объединение файлов модулей невозможно в режиме raw");
+
+            return NULL;
+        }
+
+        if( modules[i]->adc_freq != modules[0]->adc_freq )
+        {
+            printf("Для объединения файлов модулей частоты должны совпадать.\n");
+            logg("Для объединения файлов модулей частоты должны совпадать");
+
+            return NULL;
+        }
+    }
+
+    merge_stage* stage = (merge_stage*)calloc(1, sizeof(merge_stage));
+
+    if(stage == NULL){ return NULL; }
+
+    stage->mode = config->merge_mode;
+    strcpy(stage->merge_dir, config->merge_dir);
+    stage->file_size = config->file_size;
+    stage->wav_writer = config->wav_writer;
+    stage->rate = modules[0]->adc_freq;
+    stage->inputs_count = modules_count;
+
+    pthread_mutex_init(&stage->mutex, NULL);
+    pthread_cond_init(&stage->cond, NULL);
+
+    stage->inputs = (merge_input*)calloc(modules_count, sizeof(merge_input));
+
+    if(stage->inputs == NULL)
+    {
+        destroy_merge_stage(&stage);
+        return NULL;
+    }
+
+    strcpy(stage->channel_names, "[\t");
+
+    for(int i = 0; i < modules_count; i++)
+    {
+        merge_input* input = &stage->inputs[i];
+
+        strcpy(input->serial, modules[i]->serial);
+        input->channel_count = modules[i]->channel_count;
+        input->capacity = (long long)(MERGE_BUFFER_SEC * stage->rate);
+        input->next_sample = -1;
+
+        if(input->capacity < MERGE_BATCH_FRAMES){ input->capacity = MERGE_BATCH_FRAMES; }
+
+        input->frames = (float*)calloc(input->capacity * input->channel_count, sizeof(float));
+        input->lost = (unsigned char*)calloc(input->capacity, 1);
+        input->window = (float*)calloc((MERGE_BATCH_FRAMES + MERGE_WINDOW_MARGIN) * input->channel_count,
+                                       sizeof(float));
+        input->window_lost = (unsigned char*)calloc(MERGE_BATCH_FRAMES + MERGE_WINDOW_MARGIN, 1);
+
+        if(input->frames == NULL || input->lost == NULL || input->window == NULL || input->window_lost == NULL)
+        {
+            printf("Не удалось выделить память для объединения файлов модулей.\n");
+            logg("Не удалось выделить память для объединения файлов модулей");
+
+            destroy_merge_stage(&stage);
+            return NULL;
+        }
+
+        if( config->prefault_buffers )
+        {
+            prefault_memory(input->frames, sizeof(float) * input->capacity * input->channel_count);
+            prefault_memory(input->lost, input->capacity);
+        }
+
+        init_clock_model(&input->clock, stage->rate * input->channel_count);
+
+        // <serial>:<channel>:<name> of each channel of merged file
+        for(int j = 0; j < input->channel_count; j++)
+        {
+            size_t length = strlen(stage->channel_names);
+
+            snprintf(stage->channel_names + length, sizeof(stage->channel_names) - length,
+                     "%s:%d:%s\t",
+                     modules[i]->serial,
+                     modules[i]->channel_numbers[j],
+                     modules[i]->channel_names[j]);
+        }
+
+        stage->channels += input->channel_count;
+    }
+
+    strncat(stage->channel_names, "]", sizeof(stage->channel_names) - strlen(stage->channel_names) - 1);
+
+    stage->frames = (float*)malloc(sizeof(float) * MERGE_BATCH_FRAMES * stage->channels);
+
+    if(stage->frames == NULL)
+    {
+        destroy_merge_stage(&stage);
+        return NULL;
+    }
+
+    mkdir(stage->merge_dir, 0755);
+
+    return stage;
+}
+
+int start_merge_stage(merge_stage* stage)
+{
+    if( pthread_create(&stage->thread, NULL, merge_data, stage) != 0 )
+    {
+        logg("Ошибка запуска потока объединения файлов модулей");
+
+        return E502M_ERR;
+    }
+
+    stage->started = 1;
+
+    return E502M_ERR_OK;
+}
+
+// Body of push for both types of samples, inlined with
+// constant sample_float
+static inline __attribute__((always_inline))
+void push_samples(merge_stage* stage,
+                  int input_index,
+                  const void* data,
+                  int sample_float,
+                  int size,
+                  long long sample_index,
+                  const clock_model* clock,
+                  long long time_us,
+                  int gap_cause)
+{
+    const double* samples = (const double*)data;
+    const float* fsamples = (const float*)data;
+
+    merge_input* input = &stage->inputs[input_index];
+    int channel_count = input->channel_count;
+
+    pthread_mutex_lock(&stage->mutex);
+
+    if(input->next_sample < 0)
+    {
+        // frames start from first logical channel
+        input->first_frame = sample_index / channel_count;
+        input->frames_count = input->first_frame;
+        input->next_sample = input->first_frame * channel_count;
+    }
+
+    // samples were written before
+    if(sample_index < input->next_sample)
+    {
+        long long skip = input->next_sample - sample_index;
+
+        if(skip >= size)
+        {
+            pthread_mutex_unlock(&stage->mutex);
+            return;
+        }
+
+        samples += skip;
+        fsamples += skip;
+        size -= (int)skip;
+        sample_index = input->next_sample;
+    }
+
+    // lost samples are zeros in merged file, they are marked
+    // by cause of gap to be listed in .prop of merged file
+    long long lost = sample_index - input->next_sample;
+    int cause = gap_cause != 0 ? gap_cause : GAP_OVERFLOW;
+
+    while(lost > 0 && input->partial_count != 0){ push_sample(input, 0, cause); lost--; }
+
+    long long lost_frames = lost / channel_count;
+
+    if(lost_frames >= input->capacity)
+    {
+        memset(input->frames, 0, sizeof(float) * input->capacity * channel_count);
+        memset(input->lost, cause, input->capacity);
+    } else {
+        for(long long i = 0; i < lost_frames; i++)
+        {
+            long long slot = (input->frames_count + i) % input->capacity;
+
+            memset(input->frames + slot * channel_count, 0, sizeof(float) * channel_count);
+            input->lost[slot] = (unsigned char)cause;
+        }
+    }
+
+    input->frames_count += lost_frames;
+    lost -= lost_frames * channel_count;
+
+    while(lost-- > 0){ push_sample(input, 0, cause); }
+
+    int i = 0;
+
+    while(i < size && input->partial_count != 0)
+    {
+        push_sample(input, sample_float ? fsamples[i] : (float)samples[i], 0);
+        i++;
+    }
+
+    // whole frames are copied directly in ring
+    for(; i + channel_count <= size; i += channel_count)
+    {
+        long long slot = input->frames_count % input->capacity;
+        float* frame = input->frames + slot * channel_count;
+
+        if(sample_float)
+        {
+            memcpy(frame, fsamples + i, sizeof(float) * channel_count);
+        } else {
+            for(int j = 0; j < channel_count; j++){ frame[j] = (float)samples[i + j]; }
+        }
+
+        input->lost[slot] = 0;
+        input->frames_count++;
+    }
+
+    for(; i < size; i++){ push_sample(input, sample_float ? fsamples[i] : (float)samples[i], 0); }
+
+    input->next_sample = sample_index + size;
+
+    // model of module is taken as is, timeline of merged
+    // files is in monotonic time as well
+    input->clock = *clock;
+
+    // model isn't precise during warmup
+    input->residual_valid = clock->count > CLOCK_WARMUP && !clock->rejected;
+
+    if(input->residual_valid)
+    {
+        input->residual = -clock_model_time(&input->clock, (double)input->next_sample, time_us);
+    }
+
+    // timestamps of all modules are taken by the same host clock, so
+    // difference of residuals is error of position of module relative
+    // to reference module besides jitter of timestamps
+    merge_input* reference = &stage->inputs[0];
+
+    if(input_index > 0 && input->residual_valid && reference->residual_valid)
+    {
+        double align = input->residual - reference->residual;
+
+        input->align_sum += align;
+        input->align_sum2 += align * align;
+        input->align_count++;
+
+        if(fabs(align) > input->align_max){ input->align_max = fabs(align); }
+    }
+
+    pthread_cond_signal(&stage->cond);
+    pthread_mutex_unlock(&stage->mutex);
+}
+
+void push_merge_samples(merge_stage* stage,
+                        int input_index,
+                        const double* samples,
+                        int size,
+                        long long sample_index,
+                        const clock_model* clock,
+                        long long time_us,
+                        int gap_cause)
+{
+    push_samples(stage, input_index, samples, 0, size, sample_index, clock, time_us, gap_cause);
+}
+
+void push_merge_samples_float(merge_stage* stage,
+                              int input_index,
+                              const float* samples,
+                              int size,
+                              long long sample_index,
+                              const clock_model* clock,
+                              long long time_us,
+                              int gap_cause)
+{
+    push_samples(stage, input_index, samples, 1, size, sample_index, clock, time_us, gap_cause);
+}
+
+void stop_merge_stage(merge_stage* stage)
+{
+    if(!stage->started){ return; }
+
+    pthread_mutex_lock(&stage->mutex);
+    stage->stop = 1;
+    pthread_cond_signal(&stage->cond);
+    pthread_mutex_unlock(&stage->mutex);
+
+    pthread_join(stage->thread, NULL);
+
+    stage->started = 0;
+}
+
+void destroy_merge_stage(merge_stage** stage)
+{
+    merge_stage* s = *stage;
+
+    stop_merge_stage(s);
+
+    if(s->inputs != NULL)
+    {
+        for(int i = 0; i < s->inputs_count; i++)
+        {
+            free(s->inputs[i].frames);
+            free(s->inputs[i].lost);
+            free(s->inputs[i].window);
+            free(s->inputs[i].window_lost);
+        }
+
+        free(s->inputs);
+    }
+
+    free(s->frames);
+
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->cond);
+
+    free(s);
+    *stage = NULL;
+}
+
+static void* merge_data(void* arg)
+{
+    merge_stage* stage = (merge_stage*)arg;
+
+    long long segment_frames = (long long)(stage->file_size * stage->rate);
+    double frame_us = 1000000. / stage->rate;
+
+    long long base_us = -1;         // monotonic time of first merged frame
+    long long next_frame = 0;       // index of next merged frame
+    long long segment_first = 0;    // index of first frame of current file
+    audio_file* file = NULL;
+    char file_name[MERGE_NAME_SIZE] = "";
+
+    merge_input* reports = (merge_input*)malloc(sizeof(merge_input) * stage->inputs_count);
+
+    snprintf(file_name, MERGE_NAME_SIZE, "%s/" MERGE_NEXT_NAME, stage->merge_dir);
+
+    pthread_mutex_lock(&stage->mutex);
+
+    while(1)
+    {
+        int count = available_frames(stage, &base_us, next_frame);
+
+        if(count == 0)
+        {
+            if(stage->stop){ break; }
+
+            struct timeval now;
+            struct timespec deadline;
+
+            gettimeofday(&now, NULL);
+
+            long long wake_us = (long long)now.tv_sec * 1000000 + now.tv_usec +
+                                MERGE_WAIT_MS * 1000;
+
+            deadline.tv_sec = wake_us / 1000000;
+            deadline.tv_nsec = (wake_us % 1000000) * 1000;
+
+            pthread_cond_timedwait(&stage->cond, &stage->mutex, &deadline);
+            continue;
+        }
+
+        if(file == NULL)
+        {
+            file = open_audio_file(file_name, stage->channels, SAMPLE_FLOAT32,
+                                   (int)stage->rate, stage->wav_writer);
+
+            if(file == NULL)
+            {
+                logg("Ошибка создания объединенного файла");
+                break;
+            }
+
+            segment_first = next_frame;
+
+            // times of file are converted to wall time by
+            // offset which modules measured last
+            stage->wall_offset_us = wall_clock_offset();
+
+            stage->gaps_count = 0;
+            stage->gap_next = -1;
+
+            for(int i = 0; i < stage->inputs_count; i++)
+            {
+                merge_input* input = &stage->inputs[i];
+
+                input->segment_position = frame_index(&input->clock, input->channel_count,
+                                                      base_us, next_frame * frame_us);
+
+                // alignment is counted for each file
+                input->align_sum = 0;
+                input->align_sum2 = 0;
+                input->align_max = 0;
+                input->align_count = 0;
+            }
+        }
+
+        // merged file ends exactly after file_size seconds
+        if(next_frame + count > segment_first + segment_frames)
+        {
+            count = (int)(segment_first + segment_frames - next_frame);
+        }
+
+        copy_windows(stage, base_us, next_frame, count);
+
+        pthread_mutex_unlock(&stage->mutex);
+
+        // writing threads of modules don't wait for interpolation
+        fill_frames(stage, base_us, next_frame, count, segment_first);
+
+        write_audio_frames(file, stage->frames, count);
+
+        pthread_mutex_lock(&stage->mutex);
+
+        next_frame += count;
+
+        if(next_frame == segment_first + segment_frames)
+        {
+            memcpy(reports, stage->inputs, sizeof(merge_input) * stage->inputs_count);
+
+            pthread_mutex_unlock(&stage->mutex);
+
+            finish_merged_file(stage, &file,
+                               stage->wall_offset_us + base_us + (long long)(segment_first * frame_us),
+                               segment_frames, reports);
+
+            pthread_mutex_lock(&stage->mutex);
+        }
+    }
+
+    memcpy(reports, stage->inputs, sizeof(merge_input) * stage->inputs_count);
+
+    pthread_mutex_unlock(&stage->mutex);
+
+    if(file != NULL)
+    {
+        finish_merged_file(stage, &file,
+                           stage->wall_offset_us + base_us + (long long)(segment_first * frame_us),
+                           next_frame - segment_first, reports);
+    }
+
+    free(reports);
+
+    return NULL;
+}
+
+static int available_frames(merge_stage* stage, long long* base_us, long long first)
+{
+    for(int i = 0; i < stage->inputs_count; i++)
+    {
+        // rate of module is unknown until second block
+        if(stage->inputs[i].clock.count < 2){ return 0; }
+    }
+
+    if(*base_us < 0)
+    {
+        // timeline starts when all modules are recording
+        long long start_us = 0;
+
+        for(int i = 0; i < stage->inputs_count; i++)
+        {
+            merge_input* input = &stage->inputs[i];
+            long long input_start = input->clock.y0 +
+                                    (long long)frame_time(&input->clock, input->channel_count,
+                                                          input->first_frame, input->clock.y0) + 1;
+
+            if(i == 0 || input_start > start_us){ start_us = input_start; }
+        }
+
+        *base_us = start_us;
+
+        char log_msg[200] = "";
+        sprintf(log_msg, "Объединение файлов модулей: начало общей шкалы времени %lld мкс", start_us);
+        logg(log_msg);
+    }
+
+    double frame_us = 1000000. / stage->rate;
+    double first_us = first * frame_us;
+    double last_us = 0;
+
+    for(int i = 0; i < stage->inputs_count; i++)
+    {
+        merge_input* input = &stage->inputs[i];
+
+        // interpolation uses two frames after position
+        double input_last = frame_time(&input->clock, input->channel_count,
+                                       input->frames_count - 3, *base_us);
+
+        if(i == 0 || input_last < last_us){ last_us = input_last; }
+    }
+
+    if(last_us < first_us){ return 0; }
+
+    long long count = (long long)((last_us - first_us) / frame_us) + 1;
+
+    return count > MERGE_BATCH_FRAMES ? MERGE_BATCH_FRAMES : (int)count;
+}
+
+static void copy_windows(merge_stage* stage, long long base_us, long long first, int count)
+{
+    double frame_us = 1000000. / stage->rate;
+
+    for(int i = 0; i < stage->inputs_count; i++)
+    {
+        merge_input* input = &stage->inputs[i];
+        int channel_count = input->channel_count;
+
+        input->window_clock = input->clock;
+
+        // interpolation uses frame before position and two frames after it
+        double first_position = frame_index(&input->clock, channel_count, base_us, first * frame_us);
+        double last_position = frame_index(&input->clock, channel_count, base_us,
+                                           (first + count - 1) * frame_us);
+
+        long long window_first = (long long)floor(first_position) - 1;
+        long long window_frames = (long long)floor(last_position) + 3 - window_first;
+
+        if(window_frames > MERGE_BATCH_FRAMES + MERGE_WINDOW_MARGIN)
+        {
+            window_frames = MERGE_BATCH_FRAMES + MERGE_WINDOW_MARGIN;
+        }
+
+        input->window_first = window_first;
+        input->window_frames = (int)window_frames;
+
+        for(long long j = 0; j < window_frames; j++)
+        {
+            long long index = window_first + j;
+            float* frame = input->window + j * channel_count;
+
+            // module wasn't recording yet
+            if(index < input->first_frame)
+            {
+                memset(frame, 0, sizeof(float) * channel_count);
+                input->window_lost[j] = 0;
+            }
+            // frame is overwritten by new frames or isn't received
+            else if(index >= input->frames_count || index < input->frames_count - input->capacity)
+            {
+                memset(frame, 0, sizeof(float) * channel_count);
+                input->window_lost[j] = GAP_MERGE;
+            }
+            else
+            {
+                long long slot = index % input->capacity;
+
+                memcpy(frame, input->frames + slot * channel_count, sizeof(float) * channel_count);
+                input->window_lost[j] = input->lost[slot];
+            }
+        }
+    }
+}
+
+// Adds merged frame with zeros of some module to gaps of file
+static void add_merge_gap(merge_stage* stage, long long frame, long long file_first,
+                          long long base_us, int cause)
+{
+    double frame_us = 1000000. / stage->rate;
+
+    // frame continues previous gap
+    if(frame == stage->gap_next && cause == stage->gap_cause)
+    {
+        if(stage->gap_stored)
+        {
+            gap_info* gap = &stage->gaps[stage->gaps_count - 1];
+
+            gap->length++;
+            gap->duration_us = (long long)(gap->length * frame_us);
+        }
+    }
+    else
+    {
+        stats_add(&g_stats.merge_gaps, 1);
+
+        stage->gap_cause = cause;
+        stage->gap_stored = stage->gaps_count < MAX_SEGMENT_GAPS;
+
+        if(stage->gap_stored)
+        {
+            gap_info* gap = &stage->gaps[stage->gaps_count++];
+
+            gap->position = frame - file_first;
+            gap->length = 1;
+            gap->cause = cause;
+            gap->time_us = stage->wall_offset_us + base_us + (long long)(frame * frame_us);
+            gap->duration_us = (long long)frame_us;
+        }
+    }
+
+    stage->gap_next = frame + 1;
+}
+
+static void fill_frames(merge_stage* stage,
+                        long long base_us,
+                        long long first,
+                        int count,
+                        long long file_first)
+{
+    double frame_us = 1000000. / stage->rate;
+    int offset = 0;
+
+    memset(stage->frames_lost, 0, count);
+
+    for(int i = 0; i < stage->inputs_count; i++)
+    {
+        merge_input* input = &stage->inputs[i];
+        int channel_count = input->channel_count;
+
+        for(int j = 0; j < count; j++)
+        {
+            double position = frame_index(&input->window_clock, channel_count, base_us, (first + j) * frame_us);
+            float* out = stage->frames + (long long)j * stage->channels + offset;
+            int cause, cause2, edge_cause;
+
+            long long index = (long long)position;
+
+            if(position < index){ index--; }
+
+            double t = position - index;
+
+            if(stage->mode == MERGE_NEAREST)
+            {
+                const float* frame = window_frame(stage, input, t < 0.5 ? index : index + 1, &cause);
+
+                memcpy(out, frame, sizeof(float) * channel_count);
+
+                if(cause != 0){ stage->frames_lost[j] = (unsigned char)cause; }
+
+                continue;
+            }
+
+            // fractional delay by cubic Lagrange interpolation
+            const float* f0 = window_frame(stage, input, index - 1, &edge_cause);
+            const float* f1 = window_frame(stage, input, index, &cause);
+            const float* f2 = window_frame(stage, input, index + 1, &cause2);
+            const float* f3 = window_frame(stage, input, index + 2, &edge_cause);
+
+            double c0 = -t * (t - 1) * (t - 2) / 6;
+            double c1 = (t + 1) * (t - 1) * (t - 2) / 2;
+            double c2 = -(t + 1) * t * (t - 2) / 2;
+            double c3 = (t + 1) * t * (t - 1) / 6;
+
+            for(int k = 0; k < channel_count; k++)
+            {
+                out[k] = (float)(c0 * f0[k] + c1 * f1[k] + c2 * f2[k] + c3 * f3[k]);
+            }
+
+            // frame is lost if frames around position are lost
+            if(cause == 0){ cause = cause2; }
+
+            if(cause != 0){ stage->frames_lost[j] = (unsigned char)cause; }
+        }
+
+        offset += channel_count;
+    }
+
+    long long lost_frames = 0;
+
+    for(int j = 0; j < count; j++)
+    {
+        if(stage->frames_lost[j] == 0){ continue; }
+
+        add_merge_gap(stage, first + j, file_first, base_us, stage->frames_lost[j]);
+        lost_frames++;
+    }
+
+    if(lost_frames > 0){ stats_add(&g_stats.merge_lost_frames, lost_frames); }
+}
+
+static void finish_merged_file(merge_stage* stage,
+                               audio_file** file,
+                               long long start_us,
+                               long long frames_count,
+                               merge_input* reports)
+{
+    close_audio_file(file);
+
+    struct tm start_day;
+    time_t seconds = start_us / 1000000;
+
+    gmtime_r(&seconds, &start_day);
+
+    char path_to_file[MERGE_NAME_SIZE] = "";
+    char file_name[MERGE_NAME_SIZE] = "";
+    char new_file_name[MERGE_NAME_SIZE] = "";
+
+    prepare_output_directory(stage->merge_dir, &start_day, path_to_file);
+
+    snprintf(file_name, MERGE_NAME_SIZE, "%s/" MERGE_NEXT_NAME, stage->merge_dir);
+    snprintf(new_file_name, MERGE_NAME_SIZE,
+             "%s/%d_%02d_%02d_%02d-%02d-%02d-%06d_merged.wav",
+             path_to_file,
+             1900 + start_day.tm_year,
+             start_day.tm_mon + 1,
+             start_day.tm_mday,
+             start_day.tm_hour,
+             start_day.tm_min,
+             start_day.tm_sec,
+             (int)(start_us % 1000000));
+
+    char log_msg[2 * MERGE_NAME_SIZE] = "";
+    sprintf(log_msg, "Переименовываю файл <%s> на <%s>", file_name, new_file_name);
+    logg(log_msg);
+
+    rename(file_name, new_file_name);
+
+    strncat(new_file_name, ".prop", MERGE_NAME_SIZE - strlen(new_file_name) - 1);
+
+    FILE* prop_file = fopen(new_file_name, "w");
+
+    if(prop_file == NULL)
+    {
+        logg("Ошибка создания .prop-файла объединенного файла");
+        return;
+    }
+
+    long long finish_us = start_us + (long long)(frames_count * 1000000. / stage->rate);
+
+    print_prop_time(prop_file, "start_time", start_us);
+    print_prop_time(prop_file, "finish_time", finish_us);
+
+    fprintf(prop_file, "samples_count=%lld\n", frames_count);
+    fprintf(prop_file, "channel_names=%s\n", stage->channel_names);
+    fprintf(prop_file, "sample_format=float32\n");
+    fprintf(prop_file, "alignment=%s\n", stage->mode == MERGE_RESAMPLE ? "resample" : "nearest");
+    fprintf(prop_file, "devices_count=%d\n", stage->inputs_count);
+    fprintf(prop_file, "clock_wall_offset_us=%lld\n", stage->wall_offset_us);
+
+    // device=<serial>:<frame of module at start of file>:<estimated frames per second>:
+    //        <mean, rms and max residual of module minus residual of reference module in us>
+    // first module is reference, its fields of alignment are zeros
+    fprintf(prop_file, "reference_device=%s\n", reports[0].serial);
+    fprintf(prop_file, "device_fields=serial:first_frame:rate:align_mean_us:align_rms_us:align_max_us\n");
+
+    for(int i = 0; i < stage->inputs_count; i++)
+    {
+        merge_input* report = &reports[i];
+
+        double mean = report->align_count > 0 ? report->align_sum / report->align_count : 0;
+        double rms = report->align_count > 0 ? sqrt(report->align_sum2 / report->align_count) : 0;
+
+        fprintf(prop_file, "device=%s:%.3f:%.6f:%.1f:%.1f:%.1f\n",
+                report->serial,
+                report->segment_position,
+                clock_model_rate(&report->clock) / report->channel_count,
+                mean,
+                rms,
+                report->align_max);
+    }
+
+    // zero frames of modules
+    print_prop_gaps(prop_file, stage->gaps, stage->gaps_count);
+
+    fclose(prop_file);
+}
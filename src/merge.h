@@ -0,0 +1,174 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "merge.h" contains declaration of merged output of
+    several modules. Each module starts at own instant and
+    its clock drifts, so time of each module is given by
+    clock model which acquisition of module fits by
+    timestamps of blocks and counts of samples. Merged files contain channels of all modules on
+    common timeline, samples of modules are taken at nearest
+    position or interpolated at fractional position. Frames
+    of modules which were lost or overwritten before merging
+    are zeros and are listed as gaps in .prop of merged file.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include "config.h"
+#include "clock_model.h"
+#include "wav_writer.h"
+#include "files.h"
+#include "common.h"
+
+#include <pthread.h>
+
+#define MERGE_BUFFER_SEC   4        // seconds of frames of each module kept for alignment
+#define MERGE_BATCH_FRAMES 4096     // frames of merged file computed at once
+#define MERGE_WINDOW_MARGIN 8       // frames of module besides batch for interpolation and drift
+#define MERGE_WAIT_MS      100      // max waiting for data of modules
+#define MERGE_NEXT_NAME    ".next_merged.wav" // name of file before renaming
+#define MERGE_NAME_SIZE    500
+
+typedef struct {
+    char        serial[33];
+    int         channel_count;
+    float*      frames;          // ring of last frames of module
+    unsigned char* lost;         // cause of gap of each frame of ring (0 - received frame)
+    long long   capacity;        // frames in ring
+    long long   first_frame;     // index of first pushed frame
+    long long   frames_count;    // index of frame after last pushed frame
+    float       partial[MAX_CHANNELS]; // samples of incomplete frame
+    int         partial_count;
+    int         partial_cause;   // cause of lost samples in incomplete frame
+    long long   next_sample;     // index of next expected sample (-1 - nothing pushed)
+    clock_model clock;           // copy of model of module, index of sample
+                                 //  of all channels -> monotonic time
+
+    // frames for current batch of merged frames, copied under
+    // mutex and used by merging thread without it
+    float*      window;
+    unsigned char* window_lost;  // cause of gap of each frame of window
+    long long   window_first;    // index of first frame of window
+    int         window_frames;
+    clock_model window_clock;
+
+    double      segment_position;// position of module at start of merged file
+
+    double      residual;        // time of last block minus time by model (us)
+    int         residual_valid;  // 1 - model is fitted and last block isn't outlier
+    double      align_sum;       // residuals of module minus residual of
+    double      align_sum2;      //  reference (first) module in merged file (us),
+    double      align_max;       //  they show offset between modules
+    long long   align_count;
+} merge_input;
+
+typedef struct {
+    int             mode;            // MERGE_NEAREST or MERGE_RESAMPLE
+    char            merge_dir[101];
+    int             file_size;       // seconds of merged file
+    int             wav_writer;
+    double          rate;            // frames per second of modules and merged files
+
+    int             inputs_count;
+    merge_input*    inputs;
+    int             channels;        // channels of all modules
+    char            channel_names[MERGE_NAME_SIZE * 4];
+
+    float*          frames;          // computed frames of merged file
+    unsigned char   frames_lost[MERGE_BATCH_FRAMES]; // cause of gap of each computed frame
+    float           zero_frame[MAX_CHANNELS]; // samples outside of rings
+
+    gap_info        gaps[MAX_SEGMENT_GAPS]; // zero frames in current merged file,
+    int             gaps_count;             //  used only by merging thread
+    long long       gap_next;        // merged frame after last gap (-1 - none)
+    int             gap_cause;       // cause of last gap
+    int             gap_stored;      // 1 - last gap is in gaps
+    long long       wall_offset_us;  // wall time minus monotonic time for times of
+                                     //  current merged file, used only by merging thread
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       thread;
+    int             started;
+    int             stop;
+} merge_stage;
+
+/*
+    Creates buffers of modules for merged output.
+
+    config        - common configuration
+    modules       - configurations of modules
+    modules_count - count of modules
+
+    Returns pointer to stage or NULL if something was wrong
+    (modules have different frequencies, raw capture mode).
+*/
+merge_stage* create_merge_stage(e502monitor_config* config,
+                                e502monitor_config** modules,
+                                int modules_count);
+
+/*
+    Starts thread which writes merged files.
+
+    Returns error index.
+*/
+int start_merge_stage(merge_stage* stage);
+
+/*
+    Passes converted samples of block of module. Called
+    from writing thread of module. Lost samples before
+    block are replaced by zeros.
+
+    stage        - merge stage
+    input_index  - index of module
+    samples      - converted samples
+    size         - count of samples
+    sample_index - index of first sample in stream of module
+    clock        - clock model of module with time of block,
+                   index of sample of all channels -> monotonic
+                   time, stage keeps its copy
+    time_us      - monotonic time of last sample of block (us)
+    gap_cause    - cause of lost samples before block (0 - unknown)
+*/
+void push_merge_samples(merge_stage* stage,
+                        int input_index,
+                        const double* samples,
+                        int size,
+                        long long sample_index,
+                        const clock_model* clock,
+                        long long time_us,
+                        int gap_cause);
+
+/*
+    The same as push_merge_samples, but passes float
+    samples (float32 path).
+*/
+void push_merge_samples_float(merge_stage* stage,
+                              int input_index,
+                              const float* samples,
+                              int size,
+                              long long sample_index,
+                              const clock_model* clock,
+                              long long time_us,
+                              int gap_cause);
+
+/*
+    Writes frames which are available for all modules
+    and stops thread. Called after writing threads of
+    modules are finished.
+*/
+void stop_merge_stage(merge_stage* stage);
+
+/*
+    Frees memory.
+
+    stage - pointer to pointer to stage
+*/
+void destroy_merge_stage(merge_stage** stage);
+
+#endif // MERGE_H
@@ -15,30 +15,47 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-pdouble_queue* create_pdouble_queue()
+pdouble_queue* create_pdouble_queue(int reserve)
 {
     pdouble_queue* pd_queue = (pdouble_queue*)malloc(sizeof(pdouble_queue));
     
     pd_queue->head = NULL;
     pd_queue->tail = NULL;
+    pd_queue->spare = NULL;
     pd_queue->size = 0;
 
+    for(int i = 0; i < reserve; i++)
+    {
+        pdq_node* pdn = (pdq_node*)malloc(sizeof(pdq_node));
+
+        pdn->next = pd_queue->spare;
+        pd_queue->spare = pdn;
+    }
+
     pthread_mutex_init(&(pd_queue->mutex), NULL);
 
     return pd_queue;
 }
 
 void push_to_pdqueue(pdouble_queue *pd_queue,
-                     double** data,
+                     data_block* block,
                      int size,
                      int first_lch,
                      int last_buffer_index)
 {
     pthread_mutex_lock(&(pd_queue->mutex));
-    pdq_node* pdn = (pdq_node*)malloc(sizeof(pdq_node));
+    pdq_node* pdn;
+
+    if(pd_queue->spare != NULL)
+    {
+        pdn = pd_queue->spare;
+        pd_queue->spare = pdn->next;
+    } else {
+        pdn = (pdq_node*)malloc(sizeof(pdq_node));
+    }
 
     pdn->next = NULL;
-    pdn->data = *data;
+    pdn->block = block;
     pdn->size = size;
     pdn->first_lch = first_lch;
     pdn->last_buffer_index = last_buffer_index;
@@ -61,7 +78,7 @@ void push_to_pdqueue(pdouble_queue *pd_queue,
 }
 
 void pop_from_pdqueue(pdouble_queue *pd_queue,
-                      double **data,
+                      data_block **block,
                       int *size,
                       int *first_lch,
                       int *last_buffer_index)
@@ -69,13 +86,13 @@ void pop_from_pdqueue(pdouble_queue *pd_queue,
     pthread_mutex_lock(&(pd_queue->mutex));
     
     if(pd_queue->head == NULL){
-        *data = NULL;
+        *block = NULL;
         *size = -1;
     } else { 
         pdq_node* pop_node = pd_queue->head;
         pd_queue->head = pd_queue->head->next; 
 
-        *data = pop_node->data;
+        *block = pop_node->block;
         (*size) = pop_node->size;
 
         *first_lch = pop_node->first_lch;
@@ -83,7 +100,9 @@ void pop_from_pdqueue(pdouble_queue *pd_queue,
         
         pd_queue->size--;
 
-        free(pop_node);
+        // keep node for next push
+        pop_node->next = pd_queue->spare;
+        pd_queue->spare = pop_node;
     }
 
     pthread_mutex_unlock(&(pd_queue->mutex));
@@ -98,13 +117,21 @@ void destroy_pdouble_queue(pdouble_queue **pd_queue)
 
         (*pd_queue)->head = (*pd_queue)->head->next; 
 
-        free( pop_node->data );
-
+        // blocks are owned by pool, so free only node
         (*pd_queue)->size--;
 
         free(pop_node);
     }
 
+    while((*pd_queue)->spare != NULL)
+    {
+        pdq_node* spare_node = (*pd_queue)->spare;
+
+        (*pd_queue)->spare = spare_node->next;
+
+        free(spare_node);
+    }
+
     pthread_mutex_destroy(&((*pd_queue)->mutex));
     free( (*pd_queue) );
 }
@@ -13,13 +13,15 @@
 #ifndef PDOUBLE_QUEUE_H
 #define PDOUBLE_QUEUE_H
 
+#include "block_pool.h"
+
 #include <pthread.h>
 
 #define LAST_BUFFER 1
 #define NOT_LAST_BUFFER 2
 
-typedef struct {
-    double* data;
+typedef struct pdq_node {
+    data_block* block; // block with converted data
     int size;
 
     int first_lch; // number of logical channel
@@ -37,21 +39,30 @@ typedef struct{
     pdq_node* head;
     pdq_node* tail;
 
+    pdq_node* spare; // list of nodes ready for reuse
+
     int size;
 
     pthread_mutex_t mutex;
 }pdouble_queue;
 
-pdouble_queue* create_pdouble_queue();
+/*
+    Creates queue.
+
+    reserve - count of nodes allocated at once. If there
+              are never more than reserve blocks in queue
+              push doesn't allocate memory.
+*/
+pdouble_queue* create_pdouble_queue(int reserve);
 
 void push_to_pdqueue(pdouble_queue *pd_queue,
-                     double** data,
+                     data_block* block,
                      int size,
                      int first_lch,
                      int last_buffer_index);
 
 void pop_from_pdqueue(pdouble_queue *pd_queue,
-                      double** data,
+                      data_block** block,
                       int *size,
                       int *first_lch,
                       int *last_buffer_index);
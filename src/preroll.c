@@ -0,0 +1,497 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "preroll.c" contains realization of pre-roll ring
+    and snapshots on demand.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "preroll.h"
+#include "logging.h"
+#include "stats.h"
+#include "realtime.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void* snapshot_thread(void* arg);
+
+/*
+    Writes snapshot in WAV file and .prop file.
+*/
+static void write_snapshot(preroll_ring* ring, preroll_snapshot* snapshot);
+
+preroll_ring* create_preroll_ring(e502monitor_config* config)
+{
+    preroll_ring* ring = (preroll_ring*)calloc(1, sizeof(preroll_ring));
+
+    if(ring == NULL){ return NULL; }
+
+    int channel_count = config->channel_count;
+
+    strcpy(ring->serial, config->serial);
+    strcpy(ring->dir, config->preroll_dir);
+    ring->channel_count = channel_count;
+    ring->rate = config->adc_freq;
+    ring->wav_writer = config->wav_writer;
+    ring->first_sample = -1;
+
+    long long frames = (long long)(config->preroll_seconds * config->adc_freq);
+    long long margin = (long long)(PREROLL_MARGIN_SEC * config->adc_freq);
+
+    ring->snapshot_samples = frames * channel_count;
+    ring->capacity = (frames + margin) * channel_count;
+
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+
+    ring->samples = (float*)alloc_sample_memory(&ring->memory,
+                                                sizeof(float) * ring->capacity,
+                                                config->huge_pages);
+    ring->chunk = (float*)malloc(sizeof(float) * PREROLL_CHUNK_FRAMES * channel_count);
+
+    if(ring->samples == NULL || ring->chunk == NULL)
+    {
+        printf("Не удалось выделить память для предзаписи.\n");
+        logg("Не удалось выделить память для предзаписи");
+
+        destroy_preroll_ring(&ring);
+        return NULL;
+    }
+
+    if( config->prefault_buffers ){ prefault_memory(ring->samples, ring->memory.bytes); }
+
+    // [\t<channel>:<name>\t...] as channel_names of module files
+    strcpy(ring->channel_names, "[\t");
+
+    for(int i = 0; i < channel_count; i++)
+    {
+        size_t length = strlen(ring->channel_names);
+
+        snprintf(ring->channel_names + length, sizeof(ring->channel_names) - length,
+                 "%d:%s\t", config->channel_numbers[i], config->channel_names[i]);
+    }
+
+    strncat(ring->channel_names, "]", sizeof(ring->channel_names) - strlen(ring->channel_names) - 1);
+
+    char log_msg[300] = "";
+    sprintf(log_msg, "Предзапись: %d с, память %.1f МБ (%s)",
+            config->preroll_seconds,
+            ring->memory.bytes / (1024. * 1024.),
+            huge_pages_name(ring->memory.pages));
+    logg(log_msg);
+
+    stats_add(&g_stats.preroll_memory_bytes, (long long)ring->memory.bytes);
+
+    mkdir(ring->dir, 0755);
+
+    if( pthread_create(&ring->thread, NULL, snapshot_thread, ring) != 0 )
+    {
+        logg("Ошибка запуска потока снимков предзаписи");
+
+        destroy_preroll_ring(&ring);
+        return NULL;
+    }
+
+    ring->started = 1;
+
+    return ring;
+}
+
+void destroy_preroll_ring(preroll_ring** ring)
+{
+    preroll_ring* r = *ring;
+
+    if(r->started)
+    {
+        pthread_mutex_lock(&r->mutex);
+        r->stop = 1;
+        pthread_cond_signal(&r->cond);
+        pthread_mutex_unlock(&r->mutex);
+
+        pthread_join(r->thread, NULL);
+    }
+
+    free_sample_memory(&r->memory);
+    free(r->chunk);
+
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->cond);
+
+    free(r);
+    *ring = NULL;
+}
+
+// Writes count samples from index of stream in ring,
+// NULL samples are zeros
+static void store_samples(preroll_ring* ring,
+                          long long index,
+                          const void* samples,
+                          int sample_float,
+                          long long count)
+{
+    const double* dsamples = (const double*)samples;
+    const float* fsamples = (const float*)samples;
+
+    while(count > 0)
+    {
+        long long position = index % ring->capacity;
+        long long part = ring->capacity - position;
+
+        if(part > count){ part = count; }
+
+        float* out = ring->samples + position;
+
+        if(samples == NULL)
+        {
+            memset(out, 0, sizeof(float) * part);
+        } else if(sample_float) {
+            memcpy(out, fsamples, sizeof(float) * part);
+            fsamples += part;
+        } else {
+            for(long long i = 0; i < part; i++){ out[i] = (float)dsamples[i]; }
+            dsamples += part;
+        }
+
+        index += part;
+        count -= part;
+    }
+}
+
+void push_preroll_samples(preroll_ring* ring,
+                          const void* samples,
+                          int sample_float,
+                          int size,
+                          long long sample_index)
+{
+    int sample_bytes = sample_float ? sizeof(float) : sizeof(double);
+
+    if(ring->first_sample < 0)
+    {
+        ring->first_sample = sample_index;
+        ring->end_sample = sample_index;
+    }
+
+    // samples were pushed before
+    if(sample_index < ring->end_sample)
+    {
+        long long skip = ring->end_sample - sample_index;
+
+        if(skip >= size){ return; }
+
+        samples = (const char*)samples + skip * sample_bytes;
+        size -= (int)skip;
+        sample_index = ring->end_sample;
+    }
+
+    long long end_sample = sample_index + size;
+
+    // snapshot thread doesn't use samples which are changed from now
+    __atomic_store_n(&ring->write_limit, end_sample, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // lost samples
+    if(sample_index > ring->end_sample)
+    {
+        long long from = ring->end_sample;
+
+        if(sample_index - from > ring->capacity){ from = sample_index - ring->capacity; }
+
+        store_samples(ring, from, NULL, 0, sample_index - from);
+    }
+
+    if(size > ring->capacity)
+    {
+        long long skip = size - ring->capacity;
+
+        samples = (const char*)samples + skip * sample_bytes;
+        sample_index += skip;
+        size = (int)ring->capacity;
+    }
+
+    store_samples(ring, sample_index, samples, sample_float, size);
+
+    __atomic_store_n(&ring->end_sample, end_sample, __ATOMIC_RELEASE);
+}
+
+void add_preroll_gap(preroll_ring* ring, gap_info* gap)
+{
+    ring->gaps[ring->gaps_next] = *gap;
+    ring->gaps_next = (ring->gaps_next + 1) % PREROLL_MAX_GAPS;
+
+    if(ring->gaps_count < PREROLL_MAX_GAPS){ ring->gaps_count++; }
+}
+
+void request_preroll_snapshot(preroll_ring* ring)
+{
+    __atomic_store_n(&ring->requested, 1, __ATOMIC_RELAXED);
+}
+
+int preroll_snapshot_requested(preroll_ring* ring)
+{
+    return __atomic_load_n(&ring->requested, __ATOMIC_RELAXED);
+}
+
+void get_preroll_range(preroll_ring* ring, long long* first_sample, long long* end_sample)
+{
+    int channel_count = ring->channel_count;
+
+    if(ring->first_sample < 0)
+    {
+        *first_sample = *end_sample = 0;
+        return;
+    }
+
+    long long first = ring->end_sample - ring->snapshot_samples;
+
+    if(first < ring->first_sample){ first = ring->first_sample; }
+
+    // sample of first logical channel has index multiple of channel_count
+    *first_sample = (first + channel_count - 1) / channel_count * channel_count;
+    *end_sample = ring->end_sample / channel_count * channel_count;
+
+    if(*end_sample < *first_sample){ *end_sample = *first_sample; }
+}
+
+void take_preroll_snapshot(preroll_ring* ring,
+                           long long first_sample,
+                           long long end_sample,
+                           long long start_us,
+                           long long finish_us)
+{
+    __atomic_store_n(&ring->requested, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&ring->mutex);
+
+    if(ring->busy)
+    {
+        pthread_mutex_unlock(&ring->mutex);
+
+        logg("Предыдущий снимок предзаписи еще записывается, запрос пропущен");
+        return;
+    }
+
+    preroll_snapshot* snapshot = &ring->snapshot;
+    int channel_count = ring->channel_count;
+
+    snapshot->first_sample = first_sample;
+    snapshot->end_sample = end_sample;
+    snapshot->start_us = start_us;
+    snapshot->finish_us = finish_us;
+    snapshot->gaps_count = 0;
+
+    // frames of snapshot which contain zeros instead of lost samples
+    for(int i = 0; i < ring->gaps_count; i++)
+    {
+        gap_info* gap = &ring->gaps[(ring->gaps_next - ring->gaps_count + i + PREROLL_MAX_GAPS) %
+                                    PREROLL_MAX_GAPS];
+
+        long long from = gap->position;
+        long long to = gap->position + gap->length;
+
+        if(to <= first_sample || from >= end_sample){ continue; }
+
+        if(from < first_sample){ from = first_sample; }
+        if(to > end_sample){ to = end_sample; }
+
+        gap_info* zeros = &snapshot->gaps[snapshot->gaps_count++];
+
+        *zeros = *gap;
+        zeros->position = (from - first_sample) / channel_count;
+        zeros->length = (to - 1 - first_sample) / channel_count - zeros->position + 1;
+    }
+
+    ring->busy = 1;
+
+    pthread_cond_signal(&ring->cond);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+// Copies samples from ring. Returns 0 if writer
+// could overwrite them during copying.
+static int copy_samples(preroll_ring* ring, long long index, long long count, float* out)
+{
+    long long from = index;
+
+    while(count > 0)
+    {
+        long long position = index % ring->capacity;
+        long long part = ring->capacity - position;
+
+        if(part > count){ part = count; }
+
+        memcpy(out, ring->samples + position, sizeof(float) * part);
+
+        out += part;
+        index += part;
+        count -= part;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // sample i is placed over sample i - capacity
+    return __atomic_load_n(&ring->write_limit, __ATOMIC_RELAXED) - ring->capacity <= from;
+}
+
+static void* snapshot_thread(void* arg)
+{
+    preroll_ring* ring = (preroll_ring*)arg;
+
+    pthread_mutex_lock(&ring->mutex);
+
+    while(1)
+    {
+        while( !ring->busy && !ring->stop ){ pthread_cond_wait(&ring->cond, &ring->mutex); }
+
+        if( !ring->busy ){ break; }
+
+        preroll_snapshot snapshot = ring->snapshot;
+
+        pthread_mutex_unlock(&ring->mutex);
+
+        write_snapshot(ring, &snapshot);
+
+        pthread_mutex_lock(&ring->mutex);
+
+        ring->busy = 0;
+    }
+
+    pthread_mutex_unlock(&ring->mutex);
+
+    return NULL;
+}
+
+static void write_snapshot(preroll_ring* ring, preroll_snapshot* snapshot)
+{
+    int channel_count = ring->channel_count;
+    long long frames_count = (snapshot->end_sample - snapshot->first_sample) / channel_count;
+
+    if(frames_count <= 0)
+    {
+        logg("Нет данных для снимка предзаписи");
+        return;
+    }
+
+    struct tm start_day;
+    time_t seconds = snapshot->start_us / 1000000;
+
+    gmtime_r(&seconds, &start_day);
+
+    char path_to_file[PREROLL_NAME_SIZE] = "";
+    char file_name[PREROLL_NAME_SIZE] = "";
+
+    if( prepare_output_directory(ring->dir, &start_day, path_to_file) != E502M_ERR_OK ){ return; }
+
+    snprintf(file_name, PREROLL_NAME_SIZE,
+             "%s/%d_%02d_%02d_%02d-%02d-%02d-%06d_preroll.wav",
+             path_to_file,
+             1900 + start_day.tm_year,
+             start_day.tm_mon + 1,
+             start_day.tm_mday,
+             start_day.tm_hour,
+             start_day.tm_min,
+             start_day.tm_sec,
+             (int)(snapshot->start_us % 1000000));
+
+    char log_msg[2 * PREROLL_NAME_SIZE] = "";
+
+    audio_file* file = open_audio_file(file_name, channel_count, SAMPLE_FLOAT32,
+                                       (int)ring->rate, ring->wav_writer);
+
+    if(file == NULL)
+    {
+        sprintf(log_msg, "Ошибка создания файла снимка предзаписи <%s>", file_name);
+        logg(log_msg);
+
+        stats_add(&g_stats.preroll_snapshot_failures, 1);
+        return;
+    }
+
+    long long index = snapshot->first_sample;
+    int overwritten = 0;
+
+    while(index < snapshot->end_sample)
+    {
+        long long count = snapshot->end_sample - index;
+
+        if(count > (long long)PREROLL_CHUNK_FRAMES * channel_count)
+        {
+            count = (long long)PREROLL_CHUNK_FRAMES * channel_count;
+        }
+
+        if( !copy_samples(ring, index, count, ring->chunk) )
+        {
+            overwritten = 1;
+            break;
+        }
+
+        write_audio_frames(file, ring->chunk, (int)(count / channel_count));
+
+        index += count;
+    }
+
+    close_audio_file(&file);
+
+    if(overwritten)
+    {
+        // writing of file was slower than margin of ring
+        sprintf(log_msg, "Снимок предзаписи <%s> перезаписан новыми данными до сохранения, "
+                         "файл удален", file_name);
+        logg(log_msg);
+
+        unlink(file_name);
+
+        stats_add(&g_stats.preroll_snapshot_failures, 1);
+        return;
+    }
+
+    char prop_file_name[PREROLL_NAME_SIZE + 10] = "";
+    snprintf(prop_file_name, sizeof(prop_file_name), "%s.prop", file_name);
+
+    FILE* prop_file = fopen(prop_file_name, "w");
+
+    if(prop_file == NULL)
+    {
+        logg("Ошибка создания .prop-файла снимка предзаписи");
+    } else {
+        print_prop_time(prop_file, "start_time", snapshot->start_us);
+        print_prop_time(prop_file, "finish_time", snapshot->finish_us);
+
+        fprintf(prop_file, "samples_count=%lld\n", frames_count);
+        // frames of stream of module: [first_frame, first_frame + samples_count)
+        fprintf(prop_file, "first_frame=%lld\n", snapshot->first_sample / channel_count);
+        fprintf(prop_file, "serial=%s\n", ring->serial);
+        fprintf(prop_file, "channel_names=%s\n", ring->channel_names);
+        fprintf(prop_file, "sample_format=float32\n");
+        fprintf(prop_file, "gaps_count=%d\n", snapshot->gaps_count);
+
+        // gap=<first zero frame>:<count of zero frames>:<cause>:
+        //     <wall time of start of loss in us>:<duration of loss in us>,
+        // lost samples are replaced by zeros unlike files of segments
+        for(int i = 0; i < snapshot->gaps_count; i++)
+        {
+            fprintf(prop_file, "gap=%lld:%lld:%s:%lld:%lld\n",
+                    snapshot->gaps[i].position,
+                    snapshot->gaps[i].length,
+                    gap_cause_name(snapshot->gaps[i].cause),
+                    snapshot->gaps[i].time_us,
+                    snapshot->gaps[i].duration_us);
+        }
+
+        fclose(prop_file);
+    }
+
+    sprintf(log_msg, "Снимок предзаписи сохранен: <%s>, кадров %lld с %lld",
+            file_name, frames_count, snapshot->first_sample / channel_count);
+    logg(log_msg);
+
+    stats_add(&g_stats.preroll_snapshots, 1);
+}
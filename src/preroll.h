@@ -0,0 +1,159 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "preroll.h" contains declaration of pre-roll ring.
+    Ring keeps converted samples of all channels of the
+    last seconds of module in RAM. On request the samples
+    are written in separate WAV file by own thread, so
+    operator gets the last seconds at full rate without
+    waiting for end of current files.
+
+    Writing thread of module only copies samples in ring.
+    Snapshot thread reads ring while it is overwritten, so
+    ring is PREROLL_MARGIN_SEC longer than snapshot and each
+    copied part is checked against position of writer.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef PREROLL_H
+#define PREROLL_H
+
+#include "config.h"
+#include "files.h"
+#include "hugemem.h"
+
+#include <pthread.h>
+
+#define PREROLL_MARGIN_SEC   5     // seconds of ring which may be overwritten while
+                                   //  snapshot is written
+#define PREROLL_CHUNK_FRAMES 16384 // frames copied from ring and written at once
+#define PREROLL_MAX_GAPS     MAX_SEGMENT_GAPS
+#define PREROLL_NAME_SIZE    500
+
+// Part of stream chosen for writing
+typedef struct {
+    long long first_sample; // index of first sample (first logical channel)
+    long long end_sample;   // index of sample after last frame
+    long long start_us;     // wall time of first sample
+    long long finish_us;    // wall time of end of last frame
+    gap_info  gaps[PREROLL_MAX_GAPS]; // zero frames of snapshot
+    int       gaps_count;
+} preroll_snapshot;
+
+typedef struct {
+    char          serial[33];
+    char          dir[101];         // directory of snapshots
+    int           channel_count;
+    double        rate;             // frames per second
+    int           wav_writer;
+    char          channel_names[PREROLL_NAME_SIZE];
+
+    sample_memory memory;           // ring of samples of all channels
+    float*        samples;
+    long long     capacity;         // samples in ring (whole frames)
+    long long     snapshot_samples; // samples of preroll_seconds
+    long long     first_sample;     // index of first pushed sample (-1 - nothing)
+    long long     end_sample;       // index of sample after last pushed one
+    long long     write_limit;      // samples below it may be changed by writer
+
+    gap_info      gaps[PREROLL_MAX_GAPS]; // last gaps, position and length in samples
+    int           gaps_next;        // place of next gap
+    int           gaps_count;
+
+    float*        chunk;            // frames copied from ring for writing
+
+    int           requested;        // 1 - snapshot is requested
+    int           busy;             // 1 - snapshot is being written
+    preroll_snapshot snapshot;
+
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             started;        // 1 - thread is running
+    int             stop;           // 1 - thread must exit after snapshot
+} preroll_ring;
+
+/*
+    Allocates ring and starts snapshot thread.
+
+    config - configuration of module
+
+    Returns pointer to ring or NULL if something was wrong.
+*/
+preroll_ring* create_preroll_ring(e502monitor_config* config);
+
+/*
+    Waits for snapshot which is being written, stops
+    thread and frees memory.
+
+    ring - pointer to pointer to ring
+*/
+void destroy_preroll_ring(preroll_ring** ring);
+
+/*
+    Copies converted samples of block in ring. Called
+    from writing thread of module. Lost samples before
+    block are replaced by zeros.
+
+    ring         - ring
+    samples      - samples (double or float)
+    sample_float - 1 - samples are float
+    size         - count of samples
+    sample_index - index of first sample in stream of module
+*/
+void push_preroll_samples(preroll_ring* ring,
+                          const void* samples,
+                          int sample_float,
+                          int size,
+                          long long sample_index);
+
+/*
+    Remembers lost data, so snapshot describes its
+    zero frames.
+
+    ring - ring
+    gap  - gap with position and length in samples of stream
+*/
+void add_preroll_gap(preroll_ring* ring, gap_info* gap);
+
+/*
+    Asks for snapshot. Can be called from any thread,
+    snapshot is taken by writing thread after next block.
+*/
+void request_preroll_snapshot(preroll_ring* ring);
+
+/*
+    Returns 1 if snapshot is requested.
+*/
+int preroll_snapshot_requested(preroll_ring* ring);
+
+/*
+    Returns range of samples of snapshot: whole frames of
+    the last preroll_seconds which are in ring.
+
+    ring         - ring
+    first_sample - index of first sample
+    end_sample   - index of sample after last frame
+*/
+void get_preroll_range(preroll_ring* ring, long long* first_sample, long long* end_sample);
+
+/*
+    Passes range to snapshot thread. Request is dropped
+    if previous snapshot isn't written yet.
+
+    ring         - ring
+    first_sample - range from get_preroll_range
+    end_sample
+    start_us     - wall time of first sample
+    finish_us    - wall time of end sample
+*/
+void take_preroll_snapshot(preroll_ring* ring,
+                           long long first_sample,
+                           long long end_sample,
+                           long long start_us,
+                           long long finish_us);
+
+#endif // PREROLL_H
@@ -0,0 +1,255 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "raw_capture.c" contains realization of raw
+    segment files.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "raw_capture.h"
+#include "files.h"
+#include "logging.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+static int read_all(int fd, void* data, size_t size)
+{
+    char* ptr = (char*)data;
+    size_t done = 0;
+
+    while(done < size)
+    {
+        ssize_t count = read(fd, ptr + done, size - done);
+
+        if(count < 0 && errno == EINTR){ continue; }
+        if(count <= 0){ break; }
+
+        done += count;
+    }
+
+    return (int)(done == size);
+}
+
+raw_segment* create_raw_segment(e502monitor_config* config,
+                                const char* serial,
+                                t_x502_cbr* cbr,
+                                char* dir,
+                                raw_segment* current)
+{
+    raw_segment* segment = (raw_segment*)calloc(1, sizeof(raw_segment));
+
+    if(segment == NULL){ return NULL; }
+
+    raw_file_header* fh = &segment->file_header;
+
+    memcpy(fh->magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+    fh->version = RAW_VERSION;
+    snprintf(fh->serial, sizeof(fh->serial), "%s", serial);
+    fh->channel_count = config->channel_count;
+    fh->adc_freq = config->adc_freq;
+    fh->block_size = config->read_block_size;
+
+    for(int i = 0; i < config->channel_count; i++)
+    {
+        fh->channel_numbers[i] = config->channel_numbers[i];
+        fh->channel_modes[i] = config->channel_modes[i];
+        fh->channel_ranges[i] = config->channel_ranges[i];
+    }
+
+    fh->software_calibration = cbr != NULL && config->software_calibration;
+
+    if(cbr != NULL){ fh->cbr = *cbr; }
+
+    segment->slot = current != NULL ? 1 - current->slot : 0;
+
+    snprintf(segment->file_name, RAW_NAME_SIZE, "%s/" RAW_NEXT_NAME, dir, segment->slot);
+
+    segment->fd = open(segment->file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(segment->fd < 0)
+    {
+        free(segment);
+        return NULL;
+    }
+
+    if(write(segment->fd, fh, sizeof(*fh)) != sizeof(*fh))
+    {
+        close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+
+    return segment;
+}
+
+int write_raw_block(raw_segment* segment,
+                    const uint32_t* words,
+                    int size,
+                    int first_lch,
+                    long long sample_index,
+                    const gap_info* gap)
+{
+    // nothing was received before timeout
+    if(size == 0){ return E502M_ERR_OK; }
+
+    raw_block_header block;
+
+    memset(&block, 0, sizeof(block));
+
+    block.words = size;
+    block.first_lch = first_lch;
+    block.sample_index = sample_index;
+
+    if(gap != NULL)
+    {
+        block.gap_cause = gap->cause;
+        block.gap_time_us = gap->time_us;
+        block.gap_duration_us = gap->duration_us;
+    }
+
+    struct iovec parts[2];
+
+    parts[0].iov_base = &block;
+    parts[0].iov_len = sizeof(block);
+    parts[1].iov_base = (void*)words;
+    parts[1].iov_len = sizeof(uint32_t) * size;
+
+    size_t left = parts[0].iov_len + parts[1].iov_len;
+    int first = 0;
+
+    while(left > 0)
+    {
+        ssize_t written = writev(segment->fd, parts + first, 2 - first);
+
+        if(written < 0)
+        {
+            if(errno == EINTR){ continue; }
+
+            return E502M_ERR;
+        }
+
+        left -= written;
+
+        // skip written parts
+        while(first < 2 && (size_t)written >= parts[first].iov_len)
+        {
+            written -= parts[first].iov_len;
+            first++;
+        }
+
+        if(first < 2)
+        {
+            parts[first].iov_base = (char*)parts[first].iov_base + written;
+            parts[first].iov_len -= written;
+        }
+    }
+
+    segment->file_header.blocks_count++;
+    segment->file_header.words_count += size;
+
+    return E502M_ERR_OK;
+}
+
+void close_raw_segment(raw_segment** segment, char* dir, header* hdr, clock_quality* clock)
+{
+    raw_segment* s = *segment;
+
+    s->file_header.hdr = *hdr;
+    s->file_header.clock_valid = 1;
+    s->file_header.clock = *clock;
+
+    if(pwrite(s->fd, &s->file_header, sizeof(s->file_header), 0) != sizeof(s->file_header))
+    {
+        logg("Ошибка записи заголовка raw-файла");
+    }
+
+    close(s->fd);
+
+    struct tm start_day = {0};
+
+    start_day.tm_year = hdr->start_year - 1900;
+    start_day.tm_mon = hdr->start_month - 1;
+    start_day.tm_mday = hdr->start_day;
+
+    char path_to_file[RAW_NAME_SIZE] = "";
+    char new_file_name[RAW_NAME_SIZE] = "";
+
+    prepare_output_directory(dir, &start_day, path_to_file);
+
+    snprintf(new_file_name, RAW_NAME_SIZE,
+             "%s/%d_%02d_%02d_%02d-%02d-%02d-%06d.raw",
+             path_to_file,
+             hdr->start_year,
+             hdr->start_month,
+             hdr->start_day,
+             hdr->start_hour,
+             hdr->start_minut,
+             hdr->start_second,
+             (int)hdr->start_usecond);
+
+    char log_msg[2 * RAW_NAME_SIZE] = "";
+    sprintf(log_msg, "Переименовываю файл <%s> на <%s>", s->file_name, new_file_name);
+    logg(log_msg);
+
+    rename(s->file_name, new_file_name);
+
+    free(s);
+    *segment = NULL;
+}
+
+int open_raw_file(const char* file_name, raw_file_header* file_header)
+{
+    int fd = open(file_name, O_RDONLY);
+
+    if(fd < 0){ return -1; }
+
+    if( !read_all(fd, file_header, sizeof(*file_header)) ||
+        memcmp(file_header->magic, RAW_MAGIC, sizeof(RAW_MAGIC)) != 0 ||
+        file_header->version != RAW_VERSION ||
+        file_header->channel_count < 1 ||
+        file_header->channel_count > MAX_CHANNELS )
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int read_raw_block(int fd, raw_block_header* block, uint32_t** words, int* capacity)
+{
+    ssize_t count = read(fd, block, sizeof(*block));
+
+    if(count == 0){ return 0; }
+
+    if( count != sizeof(*block) && !(count > 0 &&
+        read_all(fd, (char*)block + count, sizeof(*block) - count)) )
+    {
+        return -1;
+    }
+
+    if(block->words <= 0){ return -1; }
+
+    if(block->words > *capacity)
+    {
+        uint32_t* larger = (uint32_t*)realloc(*words, sizeof(uint32_t) * block->words);
+
+        if(larger == NULL){ return -1; }
+
+        *words = larger;
+        *capacity = block->words;
+    }
+
+    if( !read_all(fd, *words, sizeof(uint32_t) * block->words) ){ return -1; }
+
+    return block->words;
+}
@@ -0,0 +1,144 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "raw_capture.h" contains declaration of raw segment
+    files. In raw capture mode words received from module
+    are written as is, without conversion and distribution
+    by files. Each file starts with description of channels
+    and calibration, each block of words has own header with
+    logical channel of first word and index of first sample.
+    Raw files are converted in WAV files by e502convert.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef RAW_CAPTURE_H
+#define RAW_CAPTURE_H
+
+#include "config.h"
+#include "common.h"
+#include "header.h"
+#include "files.h"
+#include "e502api.h"
+
+#include <stdint.h>
+
+#define RAW_MAGIC         "E502RAW"
+#define RAW_VERSION       4
+#define RAW_NEXT_NAME     ".next_%d.raw" // name of file before renaming, current
+                                         //  and next files have different ones
+#define RAW_NAME_SIZE     500
+
+// Header in the beginning of raw file
+typedef struct {
+    char       magic[8];
+    int32_t    version;
+    char       serial[33];           // serial number of module
+    int32_t    channel_count;
+    double     adc_freq;
+    int32_t    block_size;           // max count of words in block
+    int32_t    channel_numbers[MAX_CHANNELS];
+    int32_t    channel_modes[MAX_CHANNELS];
+    int32_t    channel_ranges[MAX_CHANNELS];
+    int32_t    software_calibration; // 1 - words must be corrected by cbr
+    t_x502_cbr cbr;                  // calibration coefficients of module
+    header     hdr;                  // time of segment (written at close)
+    int64_t    blocks_count;         // written at close
+    int64_t    words_count;
+    int32_t    clock_valid;          // 1 - clock is written at close
+    clock_quality clock;             // quality of time of samples of segment
+} raw_file_header;
+
+// Header of each block of words
+typedef struct {
+    int32_t words;        // count of words after header
+    int32_t first_lch;    // logical channel of first word
+    int64_t sample_index; // index of first word from start of data collection
+    int32_t gap_cause;    // cause of lost data before block (0 - none)
+    int32_t reserved;
+    int64_t gap_time_us;  // wall time of start of loss
+    int64_t gap_duration_us;
+} raw_block_header;
+
+typedef struct {
+    int             fd;
+    int             slot;     // index in temporary name
+    char            file_name[RAW_NAME_SIZE];
+    raw_file_header file_header;
+} raw_segment;
+
+/*
+    Creates raw file with temporary name and
+    writes description of channels.
+
+    config  - configuration
+    serial  - serial number of module, converter takes
+              options of module from "devices" list by it
+    cbr     - calibration coefficients of module
+    dir     - directory of output files
+    current - file which is still written (NULL - none),
+              next file gets other temporary name
+
+    Returns pointer to segment or NULL if something was wrong.
+*/
+raw_segment* create_raw_segment(e502monitor_config* config,
+                                const char* serial,
+                                t_x502_cbr* cbr,
+                                char* dir,
+                                raw_segment* current);
+
+/*
+    Writes block of words.
+
+    segment      - segment
+    words        - raw words
+    size         - count of words
+    first_lch    - logical channel of first word
+    sample_index - index of first word
+    gap          - lost data before block (NULL - none), its
+                   cause and times are stored in header of block
+
+    Returns error index.
+*/
+int write_raw_block(raw_segment* segment,
+                    const uint32_t* words,
+                    int size,
+                    int first_lch,
+                    long long sample_index,
+                    const gap_info* gap);
+
+/*
+    Writes time of segment in file header, closes
+    file and moves it to directory of day of start.
+
+    segment - pointer to pointer to segment
+    dir     - directory of output files
+    hdr     - header with time of segment
+    clock   - quality of time of samples of segment
+*/
+void close_raw_segment(raw_segment** segment, char* dir, header* hdr, clock_quality* clock);
+
+/*
+    Opens raw file for reading and reads file header.
+
+    Returns file descriptor or -1 if file isn't raw file.
+*/
+int open_raw_file(const char* file_name, raw_file_header* file_header);
+
+/*
+    Reads next block of words.
+
+    fd       - file descriptor
+    block    - header of block
+    words    - pointer to array for words, array
+               is reallocated for larger block
+    capacity - pointer to size of array
+
+    Returns count of words, 0 at end of file
+    or -1 if file is damaged.
+*/
+int read_raw_block(int fd, raw_block_header* block, uint32_t** words, int* capacity);
+
+#endif // RAW_CAPTURE_H
@@ -0,0 +1,146 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "realtime.c" contains realization of functions for
+    real-time scheduling, placement of threads and
+    locking of memory.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#define _GNU_SOURCE
+
+#include "realtime.h"
+#include "logging.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+int set_thread_cpus(pthread_t thread, long long cpu_mask, const char* name)
+{
+    if(cpu_mask == 0){ return E502M_ERR_OK; }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    for(int i = 0; i <= MAX_PINNED_CPU; i++)
+    {
+        if(cpu_mask & (1LL << i)){ CPU_SET(i, &cpus); }
+    }
+
+    int err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+
+    char log_msg[300] = "";
+
+    if(err != 0)
+    {
+        sprintf(log_msg, "Не удалось закрепить поток %s за ядрами 0x%llx: %s",
+                name, cpu_mask, strerror(err));
+        logg(log_msg);
+
+        return E502M_ERR;
+    }
+
+    sprintf(log_msg, "Поток %s закреплен за ядрами 0x%llx", name, cpu_mask);
+    logg(log_msg);
+
+    return E502M_ERR_OK;
+}
+
+int set_thread_priority(pthread_t thread, int priority, const char* name)
+{
+    if(priority <= 0){ return E502M_ERR_OK; }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    int err = pthread_setschedparam(thread, SCHED_FIFO, &param);
+
+    char log_msg[300] = "";
+
+    // without CAP_SYS_NICE or rtprio limit thread stays SCHED_OTHER
+    if(err != 0)
+    {
+        sprintf(log_msg, "Не удалось установить SCHED_FIFO %d для потока %s: %s",
+                priority, name, strerror(err));
+        logg(log_msg);
+
+        return E502M_ERR;
+    }
+
+    sprintf(log_msg, "Поток %s: SCHED_FIFO, приоритет %d", name, priority);
+    logg(log_msg);
+
+    return E502M_ERR_OK;
+}
+
+int lock_process_memory()
+{
+    struct rlimit limit;
+    int flags = MCL_CURRENT;
+
+    // with limited memlock later allocations fail when
+    // future memory is locked, buffers are allocated already
+    if( geteuid() == 0 ||
+        (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY) )
+    {
+        flags |= MCL_FUTURE;
+    }
+
+    if(mlockall(flags) != 0)
+    {
+        char log_msg[300] = "";
+        sprintf(log_msg, "Не удалось заблокировать память в ОЗУ: %s", strerror(errno));
+        logg(log_msg);
+
+        return E502M_ERR;
+    }
+
+    logg("Память программы заблокирована в ОЗУ");
+
+    return E502M_ERR_OK;
+}
+
+void prefault_memory(void* memory, long long bytes)
+{
+    if(memory == NULL){ return; }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile char* bytes_ptr = (volatile char*)memory;
+
+    // writing makes private copy of page, reading
+    // would map shared zero page
+    for(long long i = 0; i < bytes; i += page_size){ bytes_ptr[i] = bytes_ptr[i]; }
+}
+
+long long probe_sched_latency()
+{
+    struct timespec deadline, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    deadline.tv_nsec += SCHED_PROBE_SLEEP_US * 1000;
+
+    if(deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR){}
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((long long)(now.tv_sec - deadline.tv_sec) * 1000000000LL +
+            (now.tv_nsec - deadline.tv_nsec)) / 1000;
+}
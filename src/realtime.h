@@ -0,0 +1,69 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "realtime.h" contains declaration of functions for
+    real-time scheduling of threads, placement of threads
+    on cores and locking of memory. Without privileges
+    functions write warning in log and change nothing.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <pthread.h>
+
+#define SCHED_PROBE_INTERVAL_MS 1000 // how often latency of receiving thread is measured
+#define SCHED_PROBE_SLEEP_US    100  // sleep of measurement
+#define SCHED_PROBE_POLL_MS     100  // checks of stop between measurements
+
+/*
+    Allows thread to run only on cores from mask.
+
+    thread   - thread
+    cpu_mask - bit i is core i (0 - any core)
+    name     - name of thread for log
+
+    Returns error index.
+*/
+int set_thread_cpus(pthread_t thread, long long cpu_mask, const char* name);
+
+/*
+    Sets SCHED_FIFO policy with priority for thread.
+
+    thread   - thread
+    priority - priority 1..99 (0 - policy isn't changed)
+    name     - name of thread for log
+
+    Returns error index.
+*/
+int set_thread_priority(pthread_t thread, int priority, const char* name);
+
+/*
+    Locks memory of process in RAM. Future memory is
+    locked only if memlock limit allows it, so called
+    after buffers are allocated.
+
+    Returns error index.
+*/
+int lock_process_memory();
+
+/*
+    Touches each page of memory, so buffers don't
+    cause page faults during data collection.
+
+    memory - buffer
+    bytes  - size of buffer
+*/
+void prefault_memory(void* memory, long long bytes);
+
+/*
+    Sleeps until absolute deadline SCHED_PROBE_SLEEP_US
+    ahead and returns how late the thread woke up (us).
+*/
+long long probe_sched_latency();
+
+#endif // REALTIME_H
@@ -0,0 +1,415 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "route.c" contains realization of routing plan and
+    demultiplexer of converted samples.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "route.h"
+#include "adc_convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+routing_plan* create_routing_plan(e502monitor_config* config, int capacity_frames)
+{
+    routing_plan* plan = (routing_plan*)malloc(sizeof(routing_plan));
+
+    if(plan == NULL){ return NULL; }
+
+    plan->channel_count = config->channel_count;
+    plan->files_count = config->files_count;
+    plan->routes = (channel_route*)malloc(sizeof(channel_route) * config->channel_count);
+    plan->buffers = (demux_buffer*)calloc(config->files_count, sizeof(demux_buffer));
+    plan->frames_memory.memory = NULL;
+
+    if(plan->routes == NULL || plan->buffers == NULL)
+    {
+        destroy_routing_plan(&plan);
+        return NULL;
+    }
+
+    for(int lch = 0; lch < config->channel_count; lch++)
+    {
+        channel_route* route = &plan->routes[lch];
+
+        route->file = ROUTE_NO_FILE;
+        route->slot = 0;
+        route->last = 0;
+        route->scale = 1.;
+
+        for(int i = 0; i < config->files_count && route->file == ROUTE_NO_FILE; i++)
+        {
+            for(int j = 0; j < config->channel_counts_in_files[i]; j++)
+            {
+                if( config->channel_distribution[i][j] == config->channel_numbers[lch] )
+                {
+                    route->file = i;
+                    route->slot = j;
+
+                    // PCM samples are normalized to full scale of code
+                    if( config->sample_formats[i] == SAMPLE_PCM16 ||
+                        config->sample_formats[i] == SAMPLE_PCM24 )
+                    {
+                        route->scale = 1. / adc_full_scale_volts(config->channel_ranges[lch]);
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t total_floats = 0;
+
+    for(int i = 0; i < config->files_count; i++)
+    {
+        // one more frame for incomplete frame
+        total_floats += (size_t)(capacity_frames + 1) * config->channel_counts_in_files[i];
+    }
+
+    float* frames = (float*)alloc_sample_memory(&plan->frames_memory,
+                                                sizeof(float) * total_floats,
+                                                config->huge_pages);
+
+    if(frames == NULL)
+    {
+        destroy_routing_plan(&plan);
+        return NULL;
+    }
+
+    for(int i = 0; i < config->files_count; i++)
+    {
+        demux_buffer* buffer = &plan->buffers[i];
+
+        buffer->channels = config->channel_counts_in_files[i];
+        buffer->capacity = capacity_frames;
+        buffer->frames_count = 0;
+        buffer->filled = 0;
+        buffer->frames = frames;
+
+        frames += (size_t)(capacity_frames + 1) * buffer->channels;
+
+        // frame is complete after the last of its channels in block
+        for(int lch = config->channel_count - 1; lch >= 0; lch--)
+        {
+            if( plan->routes[lch].file == i )
+            {
+                plan->routes[lch].last = 1;
+                break;
+            }
+        }
+    }
+
+    plan->unscaled = 1;
+
+    for(int lch = 0; lch < config->channel_count; lch++)
+    {
+        if( plan->routes[lch].scale != 1. ){ plan->unscaled = 0; }
+    }
+
+    plan->kernel = choose_demux_kernel(plan);
+
+    return plan;
+}
+
+int choose_demux_kernel(routing_plan* plan)
+{
+    int channel_count = plan->channel_count;
+
+    // kernels write each frame whole, so all channels of
+    // each file must be recorded and each channel written
+    for(int i = 0; i < plan->files_count; i++)
+    {
+        int routed = 0;
+
+        for(int lch = 0; lch < channel_count; lch++)
+        {
+            if( plan->routes[lch].file == i ){ routed++; }
+        }
+
+        if( routed != plan->buffers[i].channels ){ return DEMUX_GENERIC; }
+    }
+
+    int contiguous = 1;
+
+    for(int lch = 0; lch < channel_count; lch++)
+    {
+        const channel_route* route = &plan->routes[lch];
+
+        if( route->file == ROUTE_NO_FILE ){ return DEMUX_GENERIC; }
+
+        // group of file starts after the last channel of previous group
+        if( lch == 0 || plan->routes[lch - 1].last )
+        {
+            if( route->slot != 0 ){ contiguous = 0; }
+        }
+        else if( route->file != plan->routes[lch - 1].file ||
+                 route->slot != plan->routes[lch - 1].slot + 1 )
+        {
+            contiguous = 0;
+        }
+    }
+
+    int fixed = channel_count == 1 || channel_count == 2 || channel_count == 4 ||
+                channel_count == 8 || channel_count == 16;
+
+    // frames of one file are copied as whole block, several
+    // short groups are faster in unrolled loop
+    if( contiguous && (plan->files_count == 1 || !fixed) ){ return DEMUX_CONTIGUOUS; }
+
+    if( fixed ){ return DEMUX_FIXED; }
+
+    return contiguous ? DEMUX_CONTIGUOUS : DEMUX_GENERIC;
+}
+
+const char* demux_kernel_name(routing_plan* plan)
+{
+    static const char* fixed_names[MAX_CHANNELS + 1] = {
+        [1] = "fixed1", [2] = "fixed2", [4] = "fixed4", [8] = "fixed8", [16] = "fixed16"
+    };
+
+    switch(plan->kernel)
+    {
+        case DEMUX_CONTIGUOUS: return "contiguous";
+        case DEMUX_FIXED:      return fixed_names[plan->channel_count];
+        default:               return "generic";
+    }
+}
+
+void destroy_routing_plan(routing_plan** plan)
+{
+    free_sample_memory(&(*plan)->frames_memory);
+
+    free((*plan)->buffers);
+    free((*plan)->routes);
+    free(*plan);
+
+    *plan = NULL;
+}
+
+// Body of generic demux for both types of samples. It is inlined
+// with constant sample_float, so each type gets its own loop
+static inline __attribute__((always_inline))
+int demux_generic(routing_plan* plan, const void* data, int sample_float, int size, int first_lch)
+{
+    const channel_route* routes = plan->routes;
+    demux_buffer* buffers = plan->buffers;
+
+    int lch = first_lch;
+
+    for(int i = 0; i < size; i++)
+    {
+        const channel_route* route = &routes[lch];
+
+        if(++lch == plan->channel_count){ lch = 0; }
+
+        if(route->file == ROUTE_NO_FILE){ continue; }
+
+        demux_buffer* buffer = &buffers[route->file];
+
+        double sample = sample_float ? ((const float*)data)[i] : ((const double*)data)[i];
+
+        buffer->frames[buffer->frames_count * buffer->channels + route->slot] =
+            (float)(sample * route->scale);
+        buffer->filled++;
+
+        if(route->last)
+        {
+            // frame is written only if all its channels were received
+            if(buffer->filled == buffer->channels){ buffer->frames_count++; }
+
+            buffer->filled = 0;
+        }
+    }
+
+    return lch;
+}
+
+// Whole frames with constant count of channels. Places of
+// channels are found once per block, inner loop is unrolled
+static inline __attribute__((always_inline))
+void demux_fixed(routing_plan* plan, const void* data, int sample_float, int frames, int channel_count)
+{
+    const double* samples = (const double*)data;
+    const float* fsamples = (const float*)data;
+
+    float* out[MAX_CHANNELS];
+    int stride[MAX_CHANNELS];
+    double scale[MAX_CHANNELS];
+
+    for(int lch = 0; lch < channel_count; lch++)
+    {
+        const channel_route* route = &plan->routes[lch];
+        demux_buffer* buffer = &plan->buffers[route->file];
+
+        out[lch] = buffer->frames + (size_t)buffer->frames_count * buffer->channels + route->slot;
+        stride[lch] = buffer->channels;
+        scale[lch] = route->scale;
+    }
+
+    for(int f = 0; f < frames; f++)
+    {
+        size_t offset = (size_t)f * channel_count;
+
+        for(int lch = 0; lch < channel_count; lch++)
+        {
+            double sample = sample_float ? fsamples[offset + lch] : samples[offset + lch];
+
+            out[lch][(size_t)f * stride[lch]] = (float)(sample * scale[lch]);
+        }
+    }
+}
+
+// Whole frames of files which are groups of consecutive
+// logical channels: each frame of file is a copy of part
+// of frame of block
+static inline __attribute__((always_inline))
+void demux_contiguous(routing_plan* plan, const void* data, int sample_float, int frames)
+{
+    const double* samples = (const double*)data;
+    const float* fsamples = (const float*)data;
+
+    int channel_count = plan->channel_count;
+
+    for(int base = 0; base < channel_count; )
+    {
+        const channel_route* routes = &plan->routes[base];
+        demux_buffer* buffer = &plan->buffers[routes->file];
+
+        int channels = buffer->channels;
+        float* out = buffer->frames + (size_t)buffer->frames_count * channels;
+
+        if(channels == channel_count && plan->unscaled)
+        {
+            // frames of file are frames of block
+            size_t count = (size_t)frames * channel_count;
+
+            for(size_t k = 0; k < count; k++)
+            {
+                out[k] = sample_float ? fsamples[k] : (float)samples[k];
+            }
+        } else {
+            for(int f = 0; f < frames; f++)
+            {
+                size_t offset = (size_t)f * channel_count + base;
+
+                for(int j = 0; j < channels; j++)
+                {
+                    double sample = sample_float ? fsamples[offset + j] : samples[offset + j];
+
+                    out[(size_t)f * channels + j] = (float)(sample * routes[j].scale);
+                }
+            }
+        }
+
+        base += channels;
+    }
+}
+
+// Distributes block: incomplete frames at edges by generic
+// loop, whole frames by kernel of plan
+static inline __attribute__((always_inline))
+int demux_samples(routing_plan* plan, const void* data, int sample_float, int size, int first_lch)
+{
+    int channel_count = plan->channel_count;
+
+    if(plan->kernel == DEMUX_GENERIC){ return demux_generic(plan, data, sample_float, size, first_lch); }
+
+    int sample_bytes = sample_float ? sizeof(float) : sizeof(double);
+    const char* samples = (const char*)data;
+
+    int head = (channel_count - first_lch) % channel_count;
+
+    if(head > size){ head = size; }
+
+    int lch = demux_generic(plan, samples, sample_float, head, first_lch);
+
+    samples += (size_t)head * sample_bytes;
+    size -= head;
+
+    int frames = size / channel_count;
+
+    // frames left after gap are completed by generic loop
+    for(int i = 0; i < plan->files_count; i++)
+    {
+        if(plan->buffers[i].filled != 0){ frames = 0; }
+    }
+
+    if(lch == 0 && frames > 0)
+    {
+        if(plan->kernel == DEMUX_CONTIGUOUS)
+        {
+            demux_contiguous(plan, samples, sample_float, frames);
+        } else {
+            switch(channel_count)
+            {
+                case 1:  demux_fixed(plan, samples, sample_float, frames, 1);  break;
+                case 2:  demux_fixed(plan, samples, sample_float, frames, 2);  break;
+                case 4:  demux_fixed(plan, samples, sample_float, frames, 4);  break;
+                case 8:  demux_fixed(plan, samples, sample_float, frames, 8);  break;
+                case 16: demux_fixed(plan, samples, sample_float, frames, 16); break;
+            }
+        }
+
+        for(int i = 0; i < plan->files_count; i++){ plan->buffers[i].frames_count += frames; }
+
+        samples += (size_t)frames * channel_count * sample_bytes;
+        size -= frames * channel_count;
+    }
+
+    return demux_generic(plan, samples, sample_float, size, lch);
+}
+
+int demux_block(routing_plan* plan, const double* data, int size, int first_lch)
+{
+    return demux_samples(plan, data, 0, size, first_lch);
+}
+
+int demux_block_float(routing_plan* plan, const float* data, int size, int first_lch)
+{
+    return demux_samples(plan, data, 1, size, first_lch);
+}
+
+void consume_frames(routing_plan* plan, int file)
+{
+    demux_buffer* buffer = &plan->buffers[file];
+
+    if(buffer->frames_count == 0){ return; }
+
+    if(buffer->filled != 0)
+    {
+        memmove(buffer->frames,
+                buffer->frames + (size_t)buffer->frames_count * buffer->channels,
+                sizeof(float) * buffer->channels);
+    }
+
+    buffer->frames_count = 0;
+}
+
+void replace_frames(routing_plan* plan, int file, float* frames)
+{
+    demux_buffer* buffer = &plan->buffers[file];
+
+    if(buffer->filled != 0)
+    {
+        memcpy(frames,
+               buffer->frames + (size_t)buffer->frames_count * buffer->channels,
+               sizeof(float) * buffer->channels);
+    }
+
+    buffer->frames = frames;
+    buffer->frames_count = 0;
+}
+
+void reset_frames(routing_plan* plan)
+{
+    for(int i = 0; i < plan->files_count; i++)
+    {
+        plan->buffers[i].filled = 0;
+    }
+}
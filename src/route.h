@@ -0,0 +1,125 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "route.h" contains declaration of routing plan and
+    demultiplexer of converted samples. Plan is built once
+    from configuration and tells for each logical channel
+    in which output file and in which place of frame its
+    samples are stored. Demultiplexer walks block once and
+    puts samples directly in interleaved frames of files.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "config.h"
+#include "hugemem.h"
+
+#define ROUTE_NO_FILE -1 // channel isn't written in any file
+
+// Kernels for whole frames of block, chosen once by layout
+// of channels. Incomplete frames at edges of block are always
+// distributed by generic loop.
+#define DEMUX_GENERIC    0 // sample by sample with route of each sample
+#define DEMUX_CONTIGUOUS 1 // each file is group of consecutive logical channels
+#define DEMUX_FIXED      2 // loop unrolled for 1, 2, 4, 8 or 16 logical channels
+
+typedef struct {
+    int file;  // index of output file
+    int slot;  // index of channel in frame of file
+    int last;  // 1 - channel is the last of file in block order,
+               //  so it completes frame
+    double scale; // multiplier of samples for format of file
+} channel_route;
+
+typedef struct {
+    float* frames;       // interleaved frames
+    int    channels;     // count of channels in frame
+    int    capacity;     // max count of frames
+    int    frames_count; // count of complete frames
+    int    filled;       // count of filled channels of current frame
+} demux_buffer;
+
+typedef struct {
+    int            channel_count;
+    int            files_count;
+    channel_route* routes;  // route of each logical channel
+    demux_buffer*  buffers; // frames of each file
+    sample_memory  frames_memory; // one buffer for frames of all files
+    int            kernel;  // DEMUX_* for whole frames
+    int            unscaled;// 1 - all samples are written without scaling
+} routing_plan;
+
+/*
+    Creates routing plan.
+
+    config          - configuration with channel distribution,
+                      buffers use its huge_pages
+    capacity_frames - count of frames in buffer of each file
+
+    Returns pointer to plan or NULL if something was wrong.
+*/
+routing_plan* create_routing_plan(e502monitor_config* config, int capacity_frames);
+
+/*
+    Returns kernel which suits layout of plan: DEMUX_GENERIC
+    if some file has channels which aren't recorded.
+*/
+int choose_demux_kernel(routing_plan* plan);
+
+/*
+    Returns name of kernel for log and benchmark.
+*/
+const char* demux_kernel_name(routing_plan* plan);
+
+/*
+    Frees memory of routing plan.
+*/
+void destroy_routing_plan(routing_plan** plan);
+
+/*
+    Puts samples of block in frames of files. Buffers must
+    have space for all frames of block.
+
+    plan      - routing plan
+    data      - converted samples
+    size      - count of samples
+    first_lch - logical channel of first sample
+
+    Returns logical channel of the next sample.
+*/
+int demux_block(routing_plan* plan, const double* data, int size, int first_lch);
+
+/*
+    The same as demux_block, but reads float samples.
+*/
+int demux_block_float(routing_plan* plan, const float* data, int size, int first_lch);
+
+/*
+    Removes complete frames of file from buffer. Incomplete
+    frame is moved to the beginning of buffer.
+*/
+void consume_frames(routing_plan* plan, int file);
+
+/*
+    Gives buffer of file with complete frames away and
+    continues in other buffer of the same size. Incomplete
+    frame is copied in new buffer.
+
+    plan   - routing plan
+    file   - index of file
+    frames - new buffer, (capacity + 1) frames of file
+*/
+void replace_frames(routing_plan* plan, int file, float* frames);
+
+/*
+    Drops incomplete frames of all files. It is used
+    when there is gap in data.
+*/
+void reset_frames(routing_plan* plan);
+
+#endif // ROUTE_H
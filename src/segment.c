@@ -0,0 +1,422 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "segment.c" contains realization of rotation
+    of output files.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "segment.h"
+#include "common.h"
+#include "stats.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static void free_segment(output_segment* segment, int files_count)
+{
+    if(segment->file_names != NULL)
+    {
+        for(int i = 0; i < files_count; i++){ free(segment->file_names[i]); }
+    }
+
+    free(segment->file_names);
+    free(segment->file_sizes);
+    free(segment->files);
+}
+
+static int alloc_segment(output_segment* segment, int files_count)
+{
+    segment->files = (audio_file**)calloc(files_count, sizeof(audio_file*));
+    segment->file_sizes = (long long*)calloc(files_count, sizeof(long long));
+    segment->file_names = (char**)calloc(files_count, sizeof(char*));
+    segment->gaps_count = 0;
+
+    if(segment->files == NULL || segment->file_sizes == NULL || segment->file_names == NULL)
+    {
+        return E502M_ERR;
+    }
+
+    for(int i = 0; i < files_count; i++)
+    {
+        segment->file_names[i] = (char*)malloc(sizeof(char) * SEGMENT_NAME_SIZE);
+
+        if(segment->file_names[i] == NULL){ return E502M_ERR; }
+    }
+
+    return E502M_ERR_OK;
+}
+
+// Opens files of segment with temporary names. They are
+// renamed by start time when segment is closed
+static int open_next_segment(segment_rotator* rotator, output_segment* segment)
+{
+    e502monitor_config* config = rotator->config;
+
+    int index = segment == &rotator->segments[0] ? 0 : 1;
+
+    for(int i = 0; i < config->files_count; i++)
+    {
+        snprintf(segment->file_names[i], SEGMENT_NAME_SIZE,
+                 "%s/" SEGMENT_NEXT_PREFIX "%d_%d.wav", config->bin_dir, index, i);
+    }
+
+    int err = open_wav_files(segment->files,
+                             segment->file_names,
+                             config->files_count,
+                             config->channel_counts_in_files,
+                             config->sample_formats,
+                             config->adc_freq,
+                             config->wav_writer);
+
+    if(err != E502M_ERR_OK)
+    {
+        // files which were opened are removed before next attempt
+        for(int i = 0; i < config->files_count; i++)
+        {
+            if(segment->files[i] == NULL){ continue; }
+
+            close_audio_file(&segment->files[i]);
+            remove(segment->file_names[i]);
+        }
+    }
+
+    return err;
+}
+
+// Files with temporary names are left only if program was
+// terminated. Empty files are removed, files with data get
+// names by time of their last change
+static void recover_next_files(e502monitor_config* config)
+{
+    struct dirent **namelist;
+
+    int n = scandir(config->bin_dir, &namelist, NULL, alphasort);
+
+    if(n < 0){ return; }
+
+    while( n -- )
+    {
+        const char* name = namelist[n]->d_name;
+        size_t length = strlen(name);
+
+        if( strncmp(name, SEGMENT_NEXT_PREFIX, strlen(SEGMENT_NEXT_PREFIX)) != 0 ||
+            length < 4 || strcmp(name + length - 4, ".wav") != 0 )
+        {
+            free(namelist[n]);
+            continue;
+        }
+
+        char file_name[SEGMENT_NAME_SIZE];
+        char new_file_name[SEGMENT_NAME_SIZE];
+        char log_msg[2 * SEGMENT_NAME_SIZE] = "";
+
+        snprintf(file_name, sizeof(file_name), "%s/%s", config->bin_dir, name);
+
+        struct stat st;
+
+        if( stat(file_name, &st) != 0 || st.st_size <= WAV_HEADER_SIZE )
+        {
+            remove(file_name);
+
+            snprintf(log_msg, sizeof(log_msg), "Удаляю пустой файл: %s", file_name);
+            logg(log_msg);
+
+            free(namelist[n]);
+            continue;
+        }
+
+        struct tm ts;
+        gmtime_r(&st.st_mtime, &ts);
+
+        // name without leading dot keeps index of file
+        snprintf(new_file_name, sizeof(new_file_name),
+                 "%s/recovered_%d_%02d_%02d_%02d-%02d-%02d_%s",
+                 config->bin_dir,
+                 1900 + ts.tm_year,
+                 ts.tm_mon + 1,
+                 ts.tm_mday,
+                 ts.tm_hour,
+                 ts.tm_min,
+                 ts.tm_sec,
+                 name + 1);
+
+        int repaired = repair_wav_file(file_name) == E502M_ERR_OK;
+
+        rename(file_name, new_file_name);
+
+        snprintf(log_msg, sizeof(log_msg), "Восстановлен незакрытый файл: %s%s",
+                 new_file_name, repaired ? "" : " (заголовок не исправлен)");
+        logg(log_msg);
+
+        free(namelist[n]);
+    }
+
+    free(namelist);
+}
+
+static void finish_segment(segment_rotator* rotator, output_segment* segment)
+{
+    close_flac_files(segment->files,
+                     rotator->config->bin_dir,
+                     segment->file_names,
+                     rotator->config->files_count,
+                     segment->file_sizes,
+                     segment->gaps,
+                     segment->gaps_count,
+                     &segment->clock,
+                     &segment->hdr,
+                     rotator->config);
+}
+
+static void* finishing_thread(void* arg)
+{
+    segment_rotator* rotator = (segment_rotator*)arg;
+
+    pthread_mutex_lock(&rotator->mutex);
+
+    while(1)
+    {
+        while( !rotator->stop && rotator->finished == NULL &&
+               (rotator->next == NULL || rotator->next_ready != 0) )
+        {
+            pthread_cond_wait(&rotator->changed, &rotator->mutex);
+        }
+
+        if(rotator->finished != NULL)
+        {
+            output_segment* segment = rotator->finished;
+
+            pthread_mutex_unlock(&rotator->mutex);
+            finish_segment(rotator, segment);
+            pthread_mutex_lock(&rotator->mutex);
+
+            // closed segment becomes the next one
+            rotator->finished = NULL;
+            rotator->next = segment;
+            rotator->next_ready = 0;
+
+            pthread_cond_broadcast(&rotator->changed);
+            continue;
+        }
+
+        if(rotator->next != NULL && rotator->next_ready == 0)
+        {
+            output_segment* segment = rotator->next;
+
+            pthread_mutex_unlock(&rotator->mutex);
+            int err = open_next_segment(rotator, segment);
+            pthread_mutex_lock(&rotator->mutex);
+
+            if(err != E502M_ERR_OK){ logg("Ошибка открытия файлов следующего сегмента"); }
+
+            rotator->next_ready = err == E502M_ERR_OK ? 1 : -1;
+
+            pthread_cond_broadcast(&rotator->changed);
+            continue;
+        }
+
+        if(rotator->stop){ break; }
+    }
+
+    pthread_mutex_unlock(&rotator->mutex);
+
+    return NULL;
+}
+
+segment_rotator* create_segment_rotator(e502monitor_config* config,
+                                        struct timeval* start_time)
+{
+    segment_rotator* rotator = (segment_rotator*)calloc(1, sizeof(segment_rotator));
+
+    if(rotator == NULL){ return NULL; }
+
+    rotator->config = config;
+
+    recover_next_files(config);
+
+    if( alloc_segment(&rotator->segments[0], config->files_count) != E502M_ERR_OK ||
+        alloc_segment(&rotator->segments[1], config->files_count) != E502M_ERR_OK )
+    {
+        free_segment(&rotator->segments[0], config->files_count);
+        free_segment(&rotator->segments[1], config->files_count);
+        free(rotator);
+
+        return NULL;
+    }
+
+    rotator->current = &rotator->segments[0];
+
+    int err = create_flac_files(rotator->current->files,
+                                config->files_count,
+                                start_time,
+                                config->bin_dir,
+                                config->channel_numbers,
+                                rotator->current->file_names,
+                                config->channel_counts_in_files,
+                                config->sample_formats,
+                                config->adc_freq,
+                                config->wav_writer);
+
+    if(err != E502M_ERR_OK)
+    {
+        free_segment(&rotator->segments[0], config->files_count);
+        free_segment(&rotator->segments[1], config->files_count);
+        free(rotator);
+
+        return NULL;
+    }
+
+    rotator->next = &rotator->segments[1];
+    rotator->next_ready = 0;
+    rotator->finished = NULL;
+    rotator->stop = 0;
+
+    pthread_mutex_init(&rotator->mutex, NULL);
+    pthread_cond_init(&rotator->changed, NULL);
+
+    pthread_create(&rotator->thread, NULL, finishing_thread, rotator);
+
+    return rotator;
+}
+
+void destroy_segment_rotator(segment_rotator** rotator)
+{
+    segment_rotator* r = *rotator;
+
+    pthread_mutex_lock(&r->mutex);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->mutex);
+
+    pthread_join(r->thread, NULL);
+
+    // current segment isn't closed only on errors
+    for(int i = 0; i < r->config->files_count; i++)
+    {
+        if(r->current->files[i] != NULL){ close_audio_file(&r->current->files[i]); }
+    }
+
+    // files opened beforehand don't contain data
+    if(r->next != NULL && r->next_ready == 1)
+    {
+        for(int i = 0; i < r->config->files_count; i++)
+        {
+            close_audio_file(&r->next->files[i]);
+            remove(r->next->file_names[i]);
+        }
+    }
+
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->changed);
+
+    free_segment(&r->segments[0], r->config->files_count);
+    free_segment(&r->segments[1], r->config->files_count);
+
+    free(r);
+    *rotator = NULL;
+}
+
+// Stores information about current segment before closing
+static void describe_segment(segment_rotator* rotator,
+                             header* hdr,
+                             long long* file_sizes,
+                             gap_info* gaps,
+                             int gaps_count,
+                             clock_quality* clock)
+{
+    output_segment* segment = rotator->current;
+
+    segment->hdr = *hdr;
+    segment->gaps_count = gaps_count;
+    segment->clock = *clock;
+
+    memcpy(segment->file_sizes, file_sizes, sizeof(long long) * rotator->config->files_count);
+    memcpy(segment->gaps, gaps, sizeof(gap_info) * gaps_count);
+}
+
+output_segment* rotate_segment(segment_rotator* rotator,
+                               header* hdr,
+                               long long* file_sizes,
+                               gap_info* gaps,
+                               int gaps_count,
+                               clock_quality* clock)
+{
+    long long start = monotonic_us();
+
+    describe_segment(rotator, hdr, file_sizes, gaps, gaps_count, clock);
+
+    pthread_mutex_lock(&rotator->mutex);
+
+    // files of next segment aren't opened yet: segments are
+    // shorter than time of closing and opening of files
+    while(rotator->next_ready == 0 || rotator->finished != NULL)
+    {
+        pthread_cond_wait(&rotator->changed, &rotator->mutex);
+    }
+
+    if(rotator->next_ready < 0)
+    {
+        // the last attempt in writing thread
+        if( open_next_segment(rotator, rotator->next) != E502M_ERR_OK )
+        {
+            pthread_mutex_unlock(&rotator->mutex);
+
+            // data stays in current files, next attempt is
+            // made at next boundary of segments
+            stats_add(&g_stats.rotation_failures, 1);
+            logg("Ошибка открытия файлов следующего сегмента. Запись продолжается в текущие файлы");
+
+            return NULL;
+        }
+    }
+
+    rotator->finished = rotator->current;
+    rotator->current = rotator->next;
+    rotator->next = NULL;
+    rotator->next_ready = 0;
+
+    pthread_cond_broadcast(&rotator->changed);
+    pthread_mutex_unlock(&rotator->mutex);
+
+    long long stall = monotonic_us() - start;
+
+    stats_add(&g_stats.rotations, 1);
+    stats_set(&g_stats.rotation_stall_us_last, stall);
+    stats_update_max(&g_stats.rotation_stall_us_max, stall);
+
+    char log_msg[100] = "";
+    sprintf(log_msg, "Смена файлов: задержка записи %lld мкс", stall);
+    logg(log_msg);
+
+    return rotator->current;
+}
+
+void close_current_segment(segment_rotator* rotator,
+                           header* hdr,
+                           long long* file_sizes,
+                           gap_info* gaps,
+                           int gaps_count,
+                           clock_quality* clock)
+{
+    pthread_mutex_lock(&rotator->mutex);
+
+    while(rotator->finished != NULL)
+    {
+        pthread_cond_wait(&rotator->changed, &rotator->mutex);
+    }
+
+    pthread_mutex_unlock(&rotator->mutex);
+
+    describe_segment(rotator, hdr, file_sizes, gaps, gaps_count, clock);
+
+    finish_segment(rotator, rotator->current);
+}
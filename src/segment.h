@@ -0,0 +1,113 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "segment.h" contains declaration of rotation of
+    output files. Files of the next segment are opened
+    beforehand by finishing thread, which also closes,
+    renames and describes files of finished segment.
+    So switching of segments in writing thread is only
+    exchange of pointers.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "files.h"
+#include "header.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#define SEGMENT_NEXT_PREFIX ".next_" // name of files opened beforehand
+#define SEGMENT_NAME_SIZE   500
+
+// Output files of one time interval
+typedef struct {
+    audio_file** files;
+    char**    file_names;    // current names of files
+    long long* file_sizes;   // count of frames in each file
+    gap_info  gaps[MAX_SEGMENT_GAPS];
+    int       gaps_count;
+    clock_quality clock;
+    header    hdr;
+} output_segment;
+
+typedef struct {
+    e502monitor_config* config;
+
+    output_segment  segments[2];
+    output_segment* current;   // segment for writing
+    output_segment* next;      // segment opened beforehand
+    output_segment* finished;  // segment for closing (NULL - nothing)
+
+    int next_ready;            // 1 - files of next segment are open
+    int stop;                  // 1 - finishing thread must exit
+
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  changed;   // signaled when state of segments changes
+} segment_rotator;
+
+/*
+    Opens files of first segment and starts finishing
+    thread, which opens files of next segment. Files with
+    temporary names left by terminated program are
+    renamed to recovered_<time of last change>_... or
+    removed if they have no data.
+
+    config     - configuration
+    start_time - time of start of first segment
+
+    Returns pointer to rotator or NULL if something was wrong.
+*/
+segment_rotator* create_segment_rotator(e502monitor_config* config,
+                                        struct timeval* start_time);
+
+/*
+    Waits for finishing thread, closes and removes
+    files opened beforehand and frees memory. Current
+    segment must be closed by close_current_segment,
+    otherwise its files are closed without renaming.
+*/
+void destroy_segment_rotator(segment_rotator** rotator);
+
+/*
+    Passes current segment to finishing thread and makes
+    next segment current. Waits if files of next segment
+    aren't opened yet. If they can't be opened, current
+    segment stays current and is continued.
+
+    rotator    - rotator
+    hdr        - header with time of finished segment
+    file_sizes - count of frames in each file
+    gaps       - lost data in finished segment
+    gaps_count - count of gaps
+    clock      - quality of time of samples of segment
+
+    Returns new current segment or NULL if files of next
+    segment weren't opened.
+*/
+output_segment* rotate_segment(segment_rotator* rotator,
+                               header* hdr,
+                               long long* file_sizes,
+                               gap_info* gaps,
+                               int gaps_count,
+                               clock_quality* clock);
+
+/*
+    Waits for finishing thread and closes current
+    segment in calling thread.
+*/
+void close_current_segment(segment_rotator* rotator,
+                           header* hdr,
+                           long long* file_sizes,
+                           gap_info* gaps,
+                           int gaps_count,
+                           clock_quality* clock);
+
+#endif // SEGMENT_H
@@ -0,0 +1,158 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "spill.c" contains realization of functions for
+    backlog file.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "spill.h"
+#include "common.h"
+#include "stats.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Header of each block in backlog file
+typedef struct {
+    long long sample_index;
+    long long mono_us;
+    int       gap_cause;
+    int       size;
+    int       first_lch;
+    int       last_buffer_index;
+} spill_record;
+
+static void reset_backlog(spill_backlog* backlog)
+{
+    backlog->read_offset = 0;
+    backlog->write_offset = 0;
+    backlog->blocks_count = 0;
+
+    ftruncate(backlog->fd, 0);
+
+    stats_set(&g_stats.backlog_bytes, 0);
+}
+
+spill_backlog* create_spill_backlog(char* dir)
+{
+    spill_backlog* backlog = (spill_backlog*)malloc(sizeof(spill_backlog));
+
+    if(backlog == NULL){ return NULL; }
+
+    sprintf(backlog->file_name, "%s/%s", dir, BACKLOG_FILE_NAME);
+
+    backlog->fd = open(backlog->file_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+    if(backlog->fd < 0)
+    {
+        char log_msg[500] = "";
+        sprintf(log_msg, "Не могу создать файл для буферизации: %s", backlog->file_name);
+        logg(log_msg);
+
+        free(backlog);
+        return NULL;
+    }
+
+    backlog->write_offset = 0;
+    backlog->read_offset = 0;
+    backlog->blocks_count = 0;
+
+    return backlog;
+}
+
+void destroy_spill_backlog(spill_backlog** backlog)
+{
+    close((*backlog)->fd);
+    unlink((*backlog)->file_name);
+
+    free(*backlog);
+    *backlog = NULL;
+}
+
+int spill_block(spill_backlog* backlog,
+                data_block* block,
+                int size,
+                int first_lch,
+                int last_buffer_index)
+{
+    spill_record record;
+
+    record.sample_index = block->sample_index;
+    record.mono_us = block->mono_us;
+    record.gap_cause = block->gap_cause;
+    record.size = size;
+    record.first_lch = first_lch;
+    record.last_buffer_index = last_buffer_index;
+
+    size_t data_size = sizeof(uint32_t) * size;
+
+    if( pwrite(backlog->fd, &record, sizeof(record), backlog->write_offset) != sizeof(record) ||
+        pwrite(backlog->fd, block->raw, data_size,
+               backlog->write_offset + sizeof(record)) != (ssize_t)data_size )
+    {
+        logg("Ошибка записи блока в файл буферизации");
+        return E502M_ERR;
+    }
+
+    backlog->write_offset += sizeof(record) + data_size;
+    backlog->blocks_count++;
+
+    stats_add(&g_stats.spilled_bytes, sizeof(record) + data_size);
+    stats_set(&g_stats.backlog_bytes, backlog->write_offset - backlog->read_offset);
+
+    return E502M_ERR_OK;
+}
+
+int unspill_block(spill_backlog* backlog,
+                  data_block* block,
+                  int* size,
+                  int* first_lch,
+                  int* last_buffer_index)
+{
+    spill_record record;
+
+    if( pread(backlog->fd, &record, sizeof(record), backlog->read_offset) != sizeof(record) ||
+        record.size > block->capacity ||
+        pread(backlog->fd, block->raw, sizeof(uint32_t) * record.size,
+              backlog->read_offset + sizeof(record)) != (ssize_t)(sizeof(uint32_t) * record.size) )
+    {
+        logg("Ошибка чтения блока из файла буферизации. Буферизованные данные потеряны");
+
+        // the rest of backlog can't be trusted
+        reset_backlog(backlog);
+
+        return E502M_ERR;
+    }
+
+    size_t data_size = sizeof(uint32_t) * record.size;
+
+    block->sample_index = record.sample_index;
+    block->mono_us = record.mono_us;
+    block->gap_cause = record.gap_cause;
+    *size = record.size;
+    *first_lch = record.first_lch;
+    *last_buffer_index = record.last_buffer_index;
+
+    backlog->read_offset += sizeof(record) + data_size;
+    backlog->blocks_count--;
+
+    // all blocks are read: start file from the beginning
+    if(backlog->blocks_count == 0){ reset_backlog(backlog); }
+
+    stats_set(&g_stats.backlog_bytes, backlog->write_offset - backlog->read_offset);
+
+    return E502M_ERR_OK;
+}
+
+int backlog_empty(spill_backlog* backlog)
+{
+    return backlog->blocks_count == 0 ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "spill.h" contains declaration of functions for
+    backlog file. When queue is full, raw words of blocks
+    are written in backlog file sequentially and later read back to
+    the queue, when writing thread catches up.
+
+    Backlog file is used only by own thread of module, so
+    receiving thread never waits for disk.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include "block_pool.h"
+
+#define BACKLOG_FILE_NAME "e502monitor.backlog"
+
+// max count of blocks moved from backlog to queue
+// between two checks of newly spilled blocks
+#define BACKLOG_DRAIN_BLOCKS 2
+
+#define SPILL_POOL_BLOCKS    4   // blocks for receiving while queue is full
+#define BACKLOG_POLL_MS      5   // period of attempts to move blocks in queue
+#define SPILL_POP_TIMEOUT    100 // ms, waiting for blocks when backlog is empty
+
+typedef struct {
+    char      file_name[256];
+    int       fd;
+    long long write_offset;  // position for next spilled block
+    long long read_offset;   // position of oldest spilled block
+    int       blocks_count;  // count of blocks in backlog
+} spill_backlog;
+
+/*
+    Creates empty backlog file.
+
+    dir - directory for backlog file
+
+    Returns pointer to backlog or NULL if file
+    can't be created.
+*/
+spill_backlog* create_spill_backlog(char* dir);
+
+/*
+    Closes and removes backlog file.
+*/
+void destroy_spill_backlog(spill_backlog** backlog);
+
+/*
+    Appends block to the end of backlog.
+
+    Returns error index.
+*/
+int spill_block(spill_backlog* backlog,
+                data_block* block,
+                int size,
+                int first_lch,
+                int last_buffer_index);
+
+/*
+    Reads the oldest block from backlog in
+    the given block. If block can't be read
+    the whole backlog is dropped.
+
+    Returns error index.
+*/
+int unspill_block(spill_backlog* backlog,
+                  data_block* block,
+                  int* size,
+                  int* first_lch,
+                  int* last_buffer_index);
+
+/*
+    Returns 1 if there are no blocks in backlog,
+    0 otherwise.
+*/
+int backlog_empty(spill_backlog* backlog);
+
+#endif // SPILL_H
@@ -0,0 +1,210 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "spsc_ring.c" contains realization of bounded
+    lock-free single producer single consumer ring.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+static void signal_event(int event)
+{
+    uint64_t value = 1;
+    write(event, &value, sizeof(value));
+}
+
+// Waits for event. Returns 0 on timeout
+static int wait_event(int event, int timeout_ms)
+{
+    struct pollfd pfd;
+
+    pfd.fd = event;
+    pfd.events = POLLIN;
+
+    if( poll(&pfd, 1, timeout_ms) <= 0 ){ return 0; }
+
+    uint64_t value;
+    read(event, &value, sizeof(value));
+
+    return 1;
+}
+
+// Takes item from head of ring. Head is moved by CAS, because
+// producer can drop oldest item too. Returns 0 if ring is empty
+static int take_oldest(spsc_ring* ring,
+                       void** data,
+                       int* size,
+                       int* first_lch,
+                       int* last_buffer_index)
+{
+    unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    while( __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head )
+    {
+        ring_item item = ring->items[head & ring->mask];
+
+        // if other side took this item, head is reloaded and copy is dropped
+        if( __atomic_compare_exchange_n(&ring->head, &head, head + 1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE) )
+        {
+            *data = item.data;
+            *size = item.size;
+            *first_lch = item.first_lch;
+            *last_buffer_index = item.last_buffer_index;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+spsc_ring* create_spsc_ring(int capacity)
+{
+    spsc_ring* ring = (spsc_ring*)aligned_alloc(RING_CACHE_LINE, sizeof(spsc_ring));
+
+    if(ring == NULL){ return NULL; }
+
+    ring->capacity = 1;
+    while(ring->capacity < (unsigned long long)capacity){ ring->capacity <<= 1; }
+
+    ring->mask = ring->capacity - 1;
+    ring->items = (ring_item*)malloc(sizeof(ring_item) * ring->capacity);
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->consumer_waiting = 0;
+    ring->producer_waiting = 0;
+
+    ring->data_event = eventfd(0, EFD_NONBLOCK);
+    ring->space_event = eventfd(0, EFD_NONBLOCK);
+
+    if(ring->items == NULL || ring->data_event < 0 || ring->space_event < 0)
+    {
+        if(ring->data_event >= 0){ close(ring->data_event); }
+        if(ring->space_event >= 0){ close(ring->space_event); }
+
+        free(ring->items);
+        free(ring);
+
+        return NULL;
+    }
+
+    return ring;
+}
+
+void destroy_spsc_ring(spsc_ring** ring)
+{
+    close((*ring)->data_event);
+    close((*ring)->space_event);
+
+    free((*ring)->items);
+    free(*ring);
+
+    *ring = NULL;
+}
+
+void push_to_ring(spsc_ring* ring,
+                  void* data,
+                  int size,
+                  int first_lch,
+                  int last_buffer_index)
+{
+    unsigned long long tail = ring->tail;
+
+    while( tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->capacity )
+    {
+        // ring is full: announce waiting and check again,
+        // so wakeup from consumer can't be lost
+        __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        if( tail - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->capacity )
+        {
+            wait_event(ring->space_event, -1);
+        }
+
+        __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    ring_item* item = &ring->items[tail & ring->mask];
+
+    item->data = data;
+    item->size = size;
+    item->first_lch = first_lch;
+    item->last_buffer_index = last_buffer_index;
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if( __atomic_load_n(&ring->consumer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST) )
+    {
+        signal_event(ring->data_event);
+    }
+}
+
+void pop_from_ring(spsc_ring* ring,
+                   void** data,
+                   int* size,
+                   int* first_lch,
+                   int* last_buffer_index,
+                   int timeout_ms)
+{
+    unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if( __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head && timeout_ms != 0 )
+    {
+        __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        if( __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head )
+        {
+            wait_event(ring->data_event, timeout_ms);
+        }
+
+        __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    if( take_oldest(ring, data, size, first_lch, last_buffer_index) != 1 )
+    {
+        *data = NULL;
+        *size = -1;
+
+        return;
+    }
+
+    if( __atomic_load_n(&ring->producer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&ring->producer_waiting, 0, __ATOMIC_SEQ_CST) )
+    {
+        signal_event(ring->space_event);
+    }
+}
+
+int drop_oldest_from_ring(spsc_ring* ring,
+                          void** data,
+                          int* size,
+                          int* first_lch,
+                          int* last_buffer_index)
+{
+    return take_oldest(ring, data, size, first_lch, last_buffer_index);
+}
+
+int ring_empty(spsc_ring* ring)
+{
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ? 1 : 0;
+}
+
+int ring_size(spsc_ring* ring)
+{
+    return (int)( __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) -
+                  __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) );
+}
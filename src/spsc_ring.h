@@ -0,0 +1,117 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "spsc_ring.h" contains declaration of bounded
+    lock-free ring for passing data blocks from one
+    thread (producer) to another (consumer).
+
+    Waiting threads sleep on eventfd and are woken
+    only when the other side changes the ring.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#define RING_CACHE_LINE 64
+
+#define LAST_BUFFER 1
+#define NOT_LAST_BUFFER 2
+
+// Descriptor of block passed through the ring
+typedef struct {
+    void* data;            // pointer to block with data
+    int   size;            // count of samples in block
+    int   first_lch;       // logical channel of first sample
+    int   last_buffer_index;
+} ring_item;
+
+typedef struct {
+    ring_item* items;
+    unsigned long long capacity; // count of items (power of two)
+    unsigned long long mask;
+
+    // index of next item for pop. Changed by consumer
+    // and by producer when it drops oldest item
+    unsigned long long head __attribute__((aligned(RING_CACHE_LINE)));
+    int consumer_waiting;        // 1 if consumer sleeps on data_event
+
+    // index of next item for push. Changed only by producer
+    unsigned long long tail __attribute__((aligned(RING_CACHE_LINE)));
+    int producer_waiting;        // 1 if producer sleeps on space_event
+
+    int data_event  __attribute__((aligned(RING_CACHE_LINE)));
+    int space_event;
+} spsc_ring;
+
+/*
+    Creates ring.
+
+    capacity - minimal count of items in ring. It is
+               rounded up to the power of two.
+
+    Returns pointer to ring or NULL if something was wrong.
+*/
+spsc_ring* create_spsc_ring(int capacity);
+
+/*
+    Frees memory of ring. Blocks stored in ring
+    aren't freed.
+*/
+void destroy_spsc_ring(spsc_ring** ring);
+
+/*
+    Puts block in ring. If ring is full waits until
+    consumer takes some block.
+
+    Called only from producer thread.
+*/
+void push_to_ring(spsc_ring* ring,
+                  void* data,
+                  int size,
+                  int first_lch,
+                  int last_buffer_index);
+
+/*
+    Takes block from ring. If ring is empty waits
+    for new block not longer than timeout.
+
+    Called only from consumer thread.
+
+    data       - NULL if there was no block
+    timeout_ms - waiting time in ms (0 - don't wait)
+*/
+void pop_from_ring(spsc_ring* ring,
+                   void** data,
+                   int* size,
+                   int* first_lch,
+                   int* last_buffer_index,
+                   int timeout_ms);
+
+/*
+    Takes the oldest block from ring on the producer
+    side. It is used to free memory when consumer
+    is too slow.
+
+    Returns 1 if block was taken, 0 if ring is empty.
+*/
+int drop_oldest_from_ring(spsc_ring* ring,
+                          void** data,
+                          int* size,
+                          int* first_lch,
+                          int* last_buffer_index);
+
+/*
+    Returns 1 if ring is empty, 0 otherwise.
+*/
+int ring_empty(spsc_ring* ring);
+
+/*
+    Returns count of blocks in ring.
+*/
+int ring_size(spsc_ring* ring);
+
+#endif // SPSC_RING_H
@@ -0,0 +1,256 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "stats.c" contains realization of runtime counters.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "stats.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+e502monitor_stats g_stats;
+
+// stats file is written by writing threads of all modules
+static pthread_mutex_t g_stats_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// counters of modules, protected by g_stats_file_mutex
+static module_stats* g_module_stats = NULL;
+
+void stats_add(long long* counter, long long value)
+{
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+void stats_set(long long* counter, long long value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+void stats_update_max(long long* counter, long long value)
+{
+    long long current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+    while( value > current &&
+           !__atomic_compare_exchange_n(counter, &current, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+void stats_update_min(long long* counter, long long value)
+{
+    long long current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+    while( value < current &&
+           !__atomic_compare_exchange_n(counter, &current, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+#define WALL_OFFSET_PROBES 5 // reads of clocks, the one with the narrowest bracket is taken
+
+static long long wall_offset_us; // wall time minus monotonic time
+
+static void measure_wall_offset()
+{
+    long long best_width = -1;
+    long long best_offset = 0;
+
+    // wall time is read between two reads of monotonic
+    // clock, preemption widens the bracket
+    for(int i = 0; i < WALL_OFFSET_PROBES; i++)
+    {
+        struct timeval now;
+
+        long long before = monotonic_us();
+        gettimeofday(&now, NULL);
+        long long after = monotonic_us();
+
+        if(best_width < 0 || after - before < best_width)
+        {
+            best_width = after - before;
+            best_offset = (long long)now.tv_sec * 1000000 + now.tv_usec - (before + after) / 2;
+        }
+    }
+
+    __atomic_store_n(&wall_offset_us, best_offset, __ATOMIC_RELAXED);
+}
+
+static pthread_once_t wall_offset_once = PTHREAD_ONCE_INIT;
+
+long long monotonic_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long long update_wall_offset()
+{
+    measure_wall_offset();
+
+    return __atomic_load_n(&wall_offset_us, __ATOMIC_RELAXED);
+}
+
+long long wall_clock_offset()
+{
+    pthread_once(&wall_offset_once, measure_wall_offset);
+
+    return __atomic_load_n(&wall_offset_us, __ATOMIC_RELAXED);
+}
+
+long long wall_from_monotonic(long long mono_us)
+{
+    return mono_us + wall_clock_offset();
+}
+
+static void write_counter(FILE* file, char* name, long long* counter)
+{
+    fprintf(file, "%s=%lld\n", name, __atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+static void write_average(FILE* file, char* name, long long* total, long long* count)
+{
+    long long n = __atomic_load_n(count, __ATOMIC_RELAXED);
+
+    fprintf(file, "%s=%lld\n", name, n > 0 ? __atomic_load_n(total, __ATOMIC_RELAXED) / n : 0);
+}
+
+static void write_module_counter(FILE* file, module_stats* stats, char* name, long long* counter)
+{
+    fprintf(file, "%s.%s=%lld\n", stats->serial[0] != '\0' ? stats->serial : "module",
+            name, __atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+static void write_module_stats(FILE* file, module_stats* m)
+{
+    long long latency_count = __atomic_load_n(&m->sched_latency_count, __ATOMIC_RELAXED);
+    long long latency_avg = latency_count > 0 ?
+                            __atomic_load_n(&m->sched_latency_us_total, __ATOMIC_RELAXED) / latency_count : 0;
+
+    write_module_counter(file, m, "read_block_size",   &m->read_block_size);
+    write_module_counter(file, m, "driver_buffer_size", &m->driver_buffer_size);
+    write_module_counter(file, m, "read_timeout_ms",   &m->read_timeout_ms);
+    write_module_counter(file, m, "pool_min_free",     &m->pool_min_free);
+    write_module_counter(file, m, "receive_priority",  &m->receive_priority);
+    write_module_counter(file, m, "sched_latency_us_last", &m->sched_latency_us_last);
+    write_module_counter(file, m, "sched_latency_us_avg", &latency_avg);
+    write_module_counter(file, m, "sched_latency_us_max", &m->sched_latency_us_max);
+    write_module_counter(file, m, "clock_residual_us", &m->clock_residual_us);
+    write_module_counter(file, m, "clock_residual_us_max", &m->clock_residual_us_max);
+    write_module_counter(file, m, "clock_drift_ppb",   &m->clock_drift_ppb);
+    write_module_counter(file, m, "clock_outliers",    &m->clock_outliers);
+    write_module_counter(file, m, "dropped_blocks",    &m->dropped_blocks);
+    write_module_counter(file, m, "dropped_samples",   &m->dropped_samples);
+    write_module_counter(file, m, "unconverted_blocks", &m->unconverted_blocks);
+    write_module_counter(file, m, "reconnects",        &m->reconnects);
+    write_module_counter(file, m, "reconnect_lost_samples", &m->reconnect_lost_samples);
+    write_module_counter(file, m, "reconnect_gap_us_last", &m->reconnect_gap_us_last);
+    write_module_counter(file, m, "reconnect_gap_us_max", &m->reconnect_gap_us_max);
+    write_module_counter(file, m, "short_reads",       &m->short_reads);
+    write_module_counter(file, m, "fifo_overruns",     &m->fifo_overruns);
+    write_module_counter(file, m, "overrun_lost_samples", &m->overrun_lost_samples);
+    write_module_counter(file, m, "channel_misalignments", &m->channel_misalignments);
+    write_module_counter(file, m, "misalign_lost_samples", &m->misalign_lost_samples);
+    write_module_counter(file, m, "unexpected_words",  &m->unexpected_words);
+    write_module_counter(file, m, "gaps",              &m->gaps);
+    write_module_counter(file, m, "gap_lost_samples",  &m->gap_lost_samples);
+}
+
+void register_module_stats(module_stats* stats, const char* serial)
+{
+    snprintf(stats->serial, sizeof(stats->serial), "%s", serial);
+    stats->next = NULL;
+
+    pthread_mutex_lock(&g_stats_file_mutex);
+
+    // modules are written in order of configuration
+    module_stats** last = &g_module_stats;
+
+    while(*last != NULL){ last = &(*last)->next; }
+
+    *last = stats;
+
+    pthread_mutex_unlock(&g_stats_file_mutex);
+}
+
+void unregister_module_stats(module_stats* stats)
+{
+    pthread_mutex_lock(&g_stats_file_mutex);
+
+    for(module_stats** m = &g_module_stats; *m != NULL; m = &(*m)->next)
+    {
+        if(*m == stats)
+        {
+            *m = stats->next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_stats_file_mutex);
+}
+
+int write_stats_file(char* file_name)
+{
+    pthread_mutex_lock(&g_stats_file_mutex);
+
+    FILE* stats_file = fopen(file_name, "w");
+
+    if(stats_file == NULL)
+    {
+        pthread_mutex_unlock(&g_stats_file_mutex);
+        return E502M_ERR;
+    }
+
+    write_counter(stats_file, "pool_blocks_count", &g_stats.pool_blocks_count);
+    write_counter(stats_file, "pool_exhausted",    &g_stats.pool_exhausted);
+    write_counter(stats_file, "queue_memory_bytes", &g_stats.queue_memory_bytes);
+    write_counter(stats_file, "queue_high_water",  &g_stats.queue_high_water);
+    write_counter(stats_file, "spilled_bytes",     &g_stats.spilled_bytes);
+    write_counter(stats_file, "backlog_bytes",     &g_stats.backlog_bytes);
+    write_average(stats_file, "recv_gap_us_avg",   &g_stats.recv_gap_us_total,
+                                                   &g_stats.recv_gap_count);
+    write_counter(stats_file, "recv_gap_us_max",   &g_stats.recv_gap_us_max);
+    write_average(stats_file, "conversion_us_avg", &g_stats.conversion_us_total,
+                                                   &g_stats.conversion_count);
+    write_counter(stats_file, "conversion_us_max", &g_stats.conversion_us_max);
+    write_counter(stats_file, "conversion_errors", &g_stats.conversion_errors);
+
+    long long demux_us = __atomic_load_n(&g_stats.demux_us_total, __ATOMIC_RELAXED);
+
+    fprintf(stats_file, "demux_samples_per_s=%lld\n",
+            demux_us > 0 ? __atomic_load_n(&g_stats.demux_samples, __ATOMIC_RELAXED) * 1000000 / demux_us : 0);
+
+    write_counter(stats_file, "write_calls",       &g_stats.write_calls);
+    write_counter(stats_file, "rotations",         &g_stats.rotations);
+    write_counter(stats_file, "rotation_stall_us_last", &g_stats.rotation_stall_us_last);
+    write_counter(stats_file, "rotation_stall_us_max", &g_stats.rotation_stall_us_max);
+    write_counter(stats_file, "rotation_failures", &g_stats.rotation_failures);
+    write_counter(stats_file, "read_block_changes", &g_stats.read_block_changes);
+    write_counter(stats_file, "memory_locked",     &g_stats.memory_locked);
+    write_counter(stats_file, "merge_gaps",        &g_stats.merge_gaps);
+    write_counter(stats_file, "merge_lost_frames", &g_stats.merge_lost_frames);
+    write_counter(stats_file, "preroll_memory_bytes", &g_stats.preroll_memory_bytes);
+    write_counter(stats_file, "preroll_snapshots", &g_stats.preroll_snapshots);
+    write_counter(stats_file, "preroll_snapshot_failures", &g_stats.preroll_snapshot_failures);
+    write_counter(stats_file, "huge_pages_bytes",  &g_stats.huge_pages_bytes);
+    write_counter(stats_file, "ordinary_pages_bytes", &g_stats.ordinary_pages_bytes);
+
+    for(module_stats* m = g_module_stats; m != NULL; m = m->next)
+    {
+        write_module_stats(stats_file, m);
+    }
+
+    fclose(stats_file);
+
+    pthread_mutex_unlock(&g_stats_file_mutex);
+
+    return E502M_ERR_OK;
+}
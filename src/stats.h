@@ -0,0 +1,182 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "stats.h" contains declaration of runtime counters
+    of the program. Counters are updated from several
+    threads and periodically saved in stats file.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#define STATS_FILE_NAME "e502monitor.stats"
+#define WALL_STEP_LOG_US 1000 // changes of offset of wall time which are logged (us)
+
+typedef struct {
+    long long pool_blocks_count; // count of blocks in pool
+    long long pool_exhausted;    // how many times pool was empty
+    long long queue_memory_bytes;// memory of all blocks of pool
+    long long queue_high_water;  // max count of blocks in queue
+    long long spilled_bytes;     // total bytes written in backlog file
+    long long backlog_bytes;     // bytes waiting in backlog file
+
+    long long recv_gap_us_total; // time between end of X502_Recv
+    long long recv_gap_count;    //  and start of next X502_Recv
+    long long recv_gap_us_max;
+
+    long long conversion_us_total; // time of conversion of blocks
+    long long conversion_count;
+    long long conversion_us_max;
+    long long conversion_errors;
+
+    long long demux_us_total;    // time of distribution of samples by files
+    long long demux_samples;     // count of distributed samples
+    long long write_calls;       // count of writes of frames in files
+
+    long long rotations;              // count of switches of output files
+    long long rotation_stall_us_last; // delay of writing at last switch
+    long long rotation_stall_us_max;
+    long long rotation_failures;      // switches skipped because next files weren't opened
+
+    long long read_block_changes;     // changes of size by auto tuning
+
+    long long memory_locked;          // 1 - memory is locked in RAM
+
+    long long merge_gaps;             // gaps in merged files
+    long long merge_lost_frames;      // zero frames of modules in merged files
+
+
+    long long preroll_memory_bytes;   // memory of rings of pre-roll samples
+    long long preroll_snapshots;      // snapshots written on demand
+    long long preroll_snapshot_failures; // snapshots overwritten before they were written
+
+    long long huge_pages_bytes;       // bytes of sample buffers in huge pages
+    long long ordinary_pages_bytes;   // bytes of sample buffers in ordinary pages
+} e502monitor_stats;
+
+extern e502monitor_stats g_stats;
+
+// counters which have own value in each module
+typedef struct module_stats {
+    char      serial[33];             // serial number of module ("" - the only module)
+
+    long long read_block_size;        // current size of read in words
+    long long driver_buffer_size;     // stream buffer of driver in words (0 - default)
+    long long read_timeout_ms;
+    long long pool_min_free;          // minimal count of free blocks of queue
+
+    long long receive_priority;       // SCHED_FIFO priority of receiving thread (0 - none)
+    long long sched_latency_us_last;  // lateness of wakeup of receiving thread
+    long long sched_latency_us_total;
+    long long sched_latency_count;
+    long long sched_latency_us_max;
+
+    long long clock_residual_us;      // rms residual of clock model of module
+    long long clock_residual_us_max;  // max residual of accepted stamps
+    long long clock_drift_ppb;        // deviation of rate of module from nominal
+    long long clock_outliers;         // stamps rejected by clock model
+
+    long long dropped_blocks;         // blocks dropped on queue overflow
+    long long dropped_samples;        // samples dropped on queue overflow
+    long long unconverted_blocks;     // blocks lost because module was closed
+
+    long long reconnects;             // count of reconnects of module
+    long long reconnect_lost_samples; // samples lost during reconnects
+    long long reconnect_gap_us_last;  // duration of loss at last reconnect
+    long long reconnect_gap_us_max;
+
+    long long short_reads;            // reads which returned less words than requested
+    long long fifo_overruns;          // overflows of buffer of module
+    long long overrun_lost_samples;   // samples lost in module (estimated by time)
+    long long channel_misalignments;  // ADC words of unexpected logical channel
+    long long misalign_lost_samples;  // samples skipped to restore order of channels
+    long long unexpected_words;       // words without ADC data
+    long long gaps;                   // gaps of all causes in output files
+    long long gap_lost_samples;       // samples lost in all gaps
+
+    struct module_stats* next;        // next module in stats file
+} module_stats;
+
+/*
+    Atomically adds value to counter.
+*/
+void stats_add(long long* counter, long long value);
+
+/*
+    Atomically sets value of counter.
+*/
+void stats_set(long long* counter, long long value);
+
+/*
+    Atomically stores value if it is greater
+    than current value of counter.
+*/
+void stats_update_max(long long* counter, long long value);
+
+/*
+    Atomically stores value if it is less
+    than current value of counter.
+*/
+void stats_update_min(long long* counter, long long value);
+
+/*
+    Returns time of monotonic clock in microseconds.
+*/
+long long monotonic_us();
+
+/*
+    Measures difference of wall and monotonic clocks again,
+    so times of data follow synchronization and steps of
+    system clock. Called at start of segments, times of
+    one segment are converted by the same offset.
+
+    Returns wall time minus monotonic time (us).
+*/
+long long update_wall_offset();
+
+/*
+    Returns last measured wall time minus monotonic
+    time (us). It is measured at first call if
+    update_wall_offset wasn't called yet.
+*/
+long long wall_clock_offset();
+
+/*
+    Converts time of monotonic clock to wall time (us from
+    epoch) by last measured offset, which is shared by
+    all modules.
+*/
+long long wall_from_monotonic(long long mono_us);
+
+/*
+    Adds counters of module to stats file. They are
+    written after common counters as "<serial>.name=value"
+    lines ("module.name=value" for the only module).
+
+    stats  - counters of module, they must be valid
+             until unregister_module_stats
+    serial - serial number of module ("" - any)
+*/
+void register_module_stats(module_stats* stats, const char* serial);
+
+/*
+    Removes counters of module from stats file.
+    Does nothing if they weren't added.
+*/
+void unregister_module_stats(module_stats* stats);
+
+/*
+    Writes all counters in file as
+    "name=value" lines.
+
+    file_name - name of stats file
+
+    Returns error index.
+*/
+int write_stats_file(char* file_name);
+
+#endif // STATS_H
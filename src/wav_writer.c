@@ -0,0 +1,430 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "wav_writer.c" contains realization of output
+    audio files.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "wav_writer.h"
+#include "wavfile.h"
+#include "common.h"
+#include "logging.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAV_FORMAT_PCM   1
+#define WAV_FORMAT_FLOAT 3
+
+// Normalized sample 1.0 is code 2^(bits - 1), the same
+// full scale as adc_full_scale_volts, so pcm24 keeps ADC
+// codes. Positive full scale is clipped to the max code
+#define PCM16_FULL_SCALE 32768.
+#define PCM24_FULL_SCALE 8388608.
+
+#define RIFF_OFFSET 0  // "RIFF"/"RF64" and size of file
+#define JUNK_OFFSET 12 // JUNK chunk is replaced by ds64 in RF64
+#define FMT_OFFSET  48 // fmt and data chunks from wav_hdr
+#define DS64_SIZE   28
+
+static int write_all(int fd, const void* data, size_t size)
+{
+    const char* ptr = (const char*)data;
+
+    while(size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+
+        if(written < 0)
+        {
+            if(errno == EINTR){ continue; }
+
+            return E502M_ERR;
+        }
+
+        ptr += written;
+        size -= written;
+    }
+
+    return E502M_ERR_OK;
+}
+
+static int pwrite_all(int fd, const void* data, size_t size, off_t offset)
+{
+    return pwrite(fd, data, size, offset) == (ssize_t)size ? E502M_ERR_OK : E502M_ERR;
+}
+
+static void put_u32(char* dst, uint32_t value){ memcpy(dst, &value, sizeof(value)); }
+static void put_u64(char* dst, uint64_t value){ memcpy(dst, &value, sizeof(value)); }
+
+static int sample_size_of(int sample_format)
+{
+    switch(sample_format)
+    {
+        case SAMPLE_DOUBLE: return 8;
+        case SAMPLE_PCM16:  return 2;
+        case SAMPLE_PCM24:  return 3;
+        default:            return 4;
+    }
+}
+
+wav_writer* open_wav_writer(const char* file_name,
+                            int channels,
+                            int sample_format,
+                            int sample_rate)
+{
+    wav_writer* writer = (wav_writer*)calloc(1, sizeof(wav_writer));
+
+    if(writer == NULL){ return NULL; }
+
+    writer->channels = channels;
+    writer->sample_format = sample_format;
+    writer->sample_size = sample_size_of(sample_format);
+    writer->sample_rate = sample_rate;
+    writer->data_bytes = 0;
+    writer->error = 0;
+    writer->buffer = NULL;
+
+    if(sample_format != SAMPLE_FLOAT32)
+    {
+        writer->buffer = (char*)malloc((size_t)WAV_BUFFER_FRAMES * channels * writer->sample_size);
+
+        if(writer->buffer == NULL)
+        {
+            free(writer);
+            return NULL;
+        }
+    }
+
+    writer->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(writer->fd < 0)
+    {
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+
+    wav_hdr whdr = create_wav_hdr(channels, sample_rate, writer->sample_size * 8, 0);
+
+    whdr.audio_format = sample_format == SAMPLE_PCM16 || sample_format == SAMPLE_PCM24 ?
+                        WAV_FORMAT_PCM : WAV_FORMAT_FLOAT;
+
+    char header[WAV_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+
+    memcpy(header + RIFF_OFFSET, "RIFF", 4);
+    put_u32(header + RIFF_OFFSET + 4, WAV_HEADER_SIZE - 8);
+    memcpy(header + RIFF_OFFSET + 8, "WAVE", 4);
+
+    memcpy(header + JUNK_OFFSET, "JUNK", 4);
+    put_u32(header + JUNK_OFFSET + 4, DS64_SIZE);
+
+    // fmt and data chunks are the tail of wav_hdr
+    memcpy(header + FMT_OFFSET, (char*)&whdr + 12, sizeof(wav_hdr) - 12);
+
+    if(write_all(writer->fd, header, sizeof(header)) != E502M_ERR_OK)
+    {
+        close(writer->fd);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+// Converts samples in buffer of writer
+static void convert_samples(wav_writer* writer, const float* samples, int count)
+{
+    switch(writer->sample_format)
+    {
+        case SAMPLE_DOUBLE:
+        {
+            double* dst = (double*)writer->buffer;
+
+            for(int i = 0; i < count; i++){ dst[i] = samples[i]; }
+
+            break;
+        }
+        case SAMPLE_PCM16:
+        {
+            int16_t* dst = (int16_t*)writer->buffer;
+
+            for(int i = 0; i < count; i++)
+            {
+                long code = lrint(samples[i] * PCM16_FULL_SCALE);
+
+                dst[i] = (int16_t)(code > INT16_MAX ? INT16_MAX : (code < INT16_MIN ? INT16_MIN : code));
+            }
+
+            break;
+        }
+        case SAMPLE_PCM24:
+        {
+            unsigned char* dst = (unsigned char*)writer->buffer;
+
+            for(int i = 0; i < count; i++)
+            {
+                long code = lrint(samples[i] * PCM24_FULL_SCALE);
+
+                if(code > 0x7FFFFF){ code = 0x7FFFFF; }
+                if(code < -0x800000){ code = -0x800000; }
+
+                dst[3 * i]     = code & 0xFF;
+                dst[3 * i + 1] = (code >> 8) & 0xFF;
+                dst[3 * i + 2] = (code >> 16) & 0xFF;
+            }
+
+            break;
+        }
+    }
+}
+
+int write_wav_frames(wav_writer* writer, const float* frames, int frames_count)
+{
+    if(writer->error){ return E502M_ERR; }
+
+    size_t samples = (size_t)frames_count * writer->channels;
+
+    if(writer->sample_format == SAMPLE_FLOAT32)
+    {
+        if(write_all(writer->fd, frames, samples * sizeof(float)) != E502M_ERR_OK)
+        {
+            writer->error = 1;
+            return E502M_ERR;
+        }
+
+        writer->data_bytes += samples * sizeof(float);
+
+        return E502M_ERR_OK;
+    }
+
+    size_t chunk = (size_t)WAV_BUFFER_FRAMES * writer->channels;
+
+    for(size_t done = 0; done < samples; done += chunk)
+    {
+        size_t count = samples - done < chunk ? samples - done : chunk;
+
+        convert_samples(writer, frames + done, count);
+
+        if(write_all(writer->fd, writer->buffer, count * writer->sample_size) != E502M_ERR_OK)
+        {
+            writer->error = 1;
+            return E502M_ERR;
+        }
+
+        writer->data_bytes += count * writer->sample_size;
+    }
+
+    return E502M_ERR_OK;
+}
+
+int close_wav_writer(wav_writer** writer)
+{
+    wav_writer* w = *writer;
+
+    int err = w->error ? E502M_ERR : E502M_ERR_OK;
+
+    // chunks have even size
+    long long pad = w->data_bytes & 1;
+
+    if(pad && write_all(w->fd, "", 1) != E502M_ERR_OK){ err = E502M_ERR; }
+
+    long long riff_size = WAV_HEADER_SIZE - 8 + w->data_bytes + pad;
+
+    char riff[8];
+    char size[4];
+
+    if(riff_size <= WAV_RIFF_MAX_SIZE)
+    {
+        memcpy(riff, "RIFF", 4);
+        put_u32(riff + 4, (uint32_t)riff_size);
+        put_u32(size, (uint32_t)w->data_bytes);
+
+        if( pwrite_all(w->fd, riff, sizeof(riff), RIFF_OFFSET) != E502M_ERR_OK ||
+            pwrite_all(w->fd, size, sizeof(size), WAV_HEADER_SIZE - 4) != E502M_ERR_OK )
+        {
+            err = E502M_ERR;
+        }
+    }
+    else
+    {
+        // sizes are in ds64 chunk, 32-bit sizes are -1
+        char ds64[8 + DS64_SIZE];
+
+        memset(ds64, 0, sizeof(ds64));
+
+        memcpy(ds64, "ds64", 4);
+        put_u32(ds64 + 4, DS64_SIZE);
+        put_u64(ds64 + 8, riff_size);
+        put_u64(ds64 + 16, w->data_bytes);
+        put_u64(ds64 + 24, w->data_bytes / ((long long)w->channels * w->sample_size));
+        put_u32(ds64 + 32, 0);
+
+        memcpy(riff, "RF64", 4);
+        put_u32(riff + 4, 0xFFFFFFFF);
+        put_u32(size, 0xFFFFFFFF);
+
+        if( pwrite_all(w->fd, ds64, sizeof(ds64), JUNK_OFFSET) != E502M_ERR_OK ||
+            pwrite_all(w->fd, size, sizeof(size), WAV_HEADER_SIZE - 4) != E502M_ERR_OK ||
+            pwrite_all(w->fd, riff, sizeof(riff), RIFF_OFFSET) != E502M_ERR_OK )
+        {
+            err = E502M_ERR;
+        }
+    }
+
+    if(close(w->fd) != 0){ err = E502M_ERR; }
+
+    free(w->buffer);
+    free(w);
+
+    *writer = NULL;
+
+    return err;
+}
+
+int repair_wav_file(const char* file_name)
+{
+    int fd = open(file_name, O_RDWR);
+
+    if(fd < 0){ return E502M_ERR; }
+
+    char header[WAV_HEADER_SIZE];
+    struct stat st;
+
+    // header of native writer has fixed layout
+    if( pread(fd, header, sizeof(header), 0) != sizeof(header) || fstat(fd, &st) != 0 ||
+        memcmp(header + RIFF_OFFSET, "RIFF", 4) != 0 ||
+        memcmp(header + JUNK_OFFSET, "JUNK", 4) != 0 ||
+        memcmp(header + WAV_HEADER_SIZE - 8, "data", 4) != 0 )
+    {
+        close(fd);
+        return E502M_ERR;
+    }
+
+    int16_t channels;
+    int16_t block_align;
+
+    memcpy(&channels, header + FMT_OFFSET + 10, sizeof(channels));
+    memcpy(&block_align, header + FMT_OFFSET + 20, sizeof(block_align));
+
+    wav_writer* writer = (wav_writer*)calloc(1, sizeof(wav_writer));
+
+    if(writer == NULL || channels <= 0 || block_align <= 0 || block_align % channels != 0)
+    {
+        free(writer);
+        close(fd);
+        return E502M_ERR;
+    }
+
+    writer->fd = fd;
+    writer->channels = channels;
+    writer->sample_size = block_align / channels;
+    writer->data_bytes = (st.st_size - WAV_HEADER_SIZE) / block_align * block_align;
+
+    if( ftruncate(fd, WAV_HEADER_SIZE + writer->data_bytes) != 0 ){ writer->error = 1; }
+
+    lseek(fd, 0, SEEK_END);
+
+    return close_wav_writer(&writer);
+}
+
+audio_file* open_audio_file(const char* file_name,
+                            int channels,
+                            int sample_format,
+                            int sample_rate,
+                            int wav_writer)
+{
+    audio_file* file = (audio_file*)calloc(1, sizeof(audio_file));
+
+    if(file == NULL){ return NULL; }
+
+    if(wav_writer == WAV_WRITER_NATIVE)
+    {
+        file->native = open_wav_writer(file_name, channels, sample_format, sample_rate);
+
+        if(file->native == NULL)
+        {
+            free(file);
+            return NULL;
+        }
+
+        return file;
+    }
+
+    SF_INFO sfinfo;
+
+    // RF64 is written as WAV while file is less than 4 GB
+    sfinfo.channels = channels;
+    sfinfo.format = SF_FORMAT_RF64;
+    sfinfo.samplerate = sample_rate;
+
+    switch(sample_format)
+    {
+        case SAMPLE_DOUBLE: sfinfo.format |= SF_FORMAT_DOUBLE; break;
+        case SAMPLE_PCM16:  sfinfo.format |= SF_FORMAT_PCM_16; break;
+        case SAMPLE_PCM24:  sfinfo.format |= SF_FORMAT_PCM_24; break;
+        default:            sfinfo.format |= SF_FORMAT_FLOAT;
+    }
+
+    if( !(file->sndfile = sf_open(file_name, SFM_WRITE, &sfinfo)) )
+    {
+        free(file);
+        return NULL;
+    }
+
+    sf_command(file->sndfile, SFC_RF64_AUTO_DOWNGRADE, NULL, SF_TRUE);
+
+    // overloaded samples are clipped instead of wrapping
+    sf_command(file->sndfile, SFC_SET_CLIPPING, NULL, SF_TRUE);
+
+    return file;
+}
+
+void write_audio_frames(audio_file* file, const float* frames, int frames_count)
+{
+    if(file->native != NULL)
+    {
+        int failed = file->native->error;
+
+        // error is logged once
+        if(write_wav_frames(file->native, frames, frames_count) != E502M_ERR_OK && !failed)
+        {
+            logg("Ошибка записи wav-файла");
+        }
+
+        return;
+    }
+
+    sf_writef_float(file->sndfile, frames, frames_count);
+}
+
+void close_audio_file(audio_file** file)
+{
+    if((*file)->native != NULL)
+    {
+        if(close_wav_writer(&(*file)->native) != E502M_ERR_OK)
+        {
+            logg("Ошибка записи wav-файла");
+        }
+    }
+    else
+    {
+        sf_close((*file)->sndfile);
+    }
+
+    free(*file);
+    *file = NULL;
+}
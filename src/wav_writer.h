@@ -0,0 +1,114 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "wav_writer.h" contains declaration of output audio
+    files. File is written by libsndfile or by native
+    streaming writer, which writes whole batches of frames
+    by one write() and fills header when file is closed.
+    Files larger than 4 GB are finished as RF64 by both
+    writers.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include "config.h"
+
+#include <sndfile.h>
+
+#define WAV_HEADER_SIZE   80      // RIFF, JUNK (place for ds64), fmt and data headers
+#define WAV_RIFF_MAX_SIZE 0xFFFFFFFFLL
+#define WAV_BUFFER_FRAMES 16384   // frames converted at once for non-float32 formats
+
+typedef struct {
+    int       fd;
+    int       channels;
+    int       sample_format;   // SAMPLE_* from config.h
+    int       sample_size;     // bytes of one sample
+    int       sample_rate;
+    long long data_bytes;      // bytes written in data chunk
+    char*     buffer;          // converted samples
+    int       error;           // 1 - writing failed
+} wav_writer;
+
+typedef struct {
+    SNDFILE*    sndfile;       // file of libsndfile or NULL
+    wav_writer* native;        // file of native writer or NULL
+} audio_file;
+
+/*
+    Creates WAV file and writes header with
+    zero sizes.
+
+    file_name     - name of file
+    channels      - count of channels
+    sample_format - format of samples
+    sample_rate   - sample rate
+
+    Returns pointer to writer or NULL if something was wrong.
+*/
+wav_writer* open_wav_writer(const char* file_name,
+                            int channels,
+                            int sample_format,
+                            int sample_rate);
+
+/*
+    Writes interleaved frames. Samples of pcm formats
+    are multiplied by 2^(bits - 1) and clipped to range
+    of code.
+
+    Returns error index.
+*/
+int write_wav_frames(wav_writer* writer, const float* frames, int frames_count);
+
+/*
+    Writes sizes in header and closes file. If data
+    doesn't fit in RIFF file header is changed to RF64.
+
+    Returns error index.
+*/
+int close_wav_writer(wav_writer** writer);
+
+/*
+    Writes sizes in header of file of native writer which
+    wasn't closed (program was terminated). Incomplete
+    frame at the end is dropped.
+
+    file_name - name of file
+
+    Returns error index. Files of other writers aren't changed.
+*/
+int repair_wav_file(const char* file_name);
+
+/*
+    Opens output file with selected writer.
+
+    file_name     - name of file
+    channels      - count of channels
+    sample_format - format of samples
+    sample_rate   - sample rate
+    wav_writer    - WAV_WRITER_SNDFILE or WAV_WRITER_NATIVE
+
+    Returns pointer to file or NULL if something was wrong.
+*/
+audio_file* open_audio_file(const char* file_name,
+                            int channels,
+                            int sample_format,
+                            int sample_rate,
+                            int wav_writer);
+
+/*
+    Writes interleaved frames in file.
+*/
+void write_audio_frames(audio_file* file, const float* frames, int frames_count);
+
+/*
+    Closes file and frees memory.
+*/
+void close_audio_file(audio_file** file);
+
+#endif // WAV_WRITER_H
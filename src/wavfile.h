@@ -7,6 +7,10 @@
     Author: Gapeev Maksim
     Email: gm16493@gmail.com
 */
+
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
 #include <stdint.h>
 #include <stdio.h>
 
@@ -85,4 +89,6 @@ void print_hdr_info(wav_hdr *hdr)
     printf("Bites per sample:\t%i\n", hdr->bps);
     printf("Subchink 2 Id:\t%s\n", hdr->subchunk2_id);
     printf("Subchunk 2 size:\t%i\n", hdr->subchunk2_size);
-}
\ No newline at end of file
+}
+
+#endif // WAVFILE_H
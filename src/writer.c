@@ -0,0 +1,244 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "writer.c" contains realization of group of
+    writing threads.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "writer.h"
+#include "stats.h"
+#include "logging.h"
+
+#include <stdlib.h>
+
+typedef struct {
+    writer_group* group;
+    file_writer*  writer;
+} writer_thread_arg;
+
+static void* writer_thread(void* arg)
+{
+    writer_group* group = ((writer_thread_arg*)arg)->group;
+    file_writer* writer = ((writer_thread_arg*)arg)->writer;
+
+    free(arg);
+
+    frame_batch* batch;
+    int size, file, last_buffer_index;
+
+    while( !__atomic_load_n(&group->stop, __ATOMIC_ACQUIRE) || !ring_empty(writer->ring) )
+    {
+        pop_from_ring(writer->ring,
+                      (void**)&batch,
+                      &size,
+                      &file,
+                      &last_buffer_index,
+                      WRITER_POP_TIMEOUT);
+
+        if(batch == NULL){ continue; }
+
+        write_audio_frames(group->files[batch->file], batch->frames, batch->frames_count);
+
+        stats_add(&g_stats.write_calls, 1);
+
+        push_to_ring(writer->free_ring, batch, 0, 0, NOT_LAST_BUFFER);
+    }
+
+    return NULL;
+}
+
+// Frees memory of writer. Thread must be stopped
+static void free_writer(file_writer* writer)
+{
+    if(writer->ring != NULL){ destroy_spsc_ring(&writer->ring); }
+    if(writer->free_ring != NULL){ destroy_spsc_ring(&writer->free_ring); }
+
+    free_sample_memory(&writer->memory);
+}
+
+static void free_group(writer_group* group)
+{
+    free(group->writers);
+    free(group->writer_of_file);
+    free(group->batches);
+    free(group);
+}
+
+writer_group* create_writer_group(int writers_count,
+                                  routing_plan* plan,
+                                  audio_file** files,
+                                  int huge_pages)
+{
+    writer_group* group = (writer_group*)malloc(sizeof(writer_group));
+
+    if(group == NULL){ return NULL; }
+
+    int files_count = plan->files_count;
+
+    group->writers_count = writers_count;
+    group->writers = (file_writer*)calloc(writers_count, sizeof(file_writer));
+    group->files_count = files_count;
+    group->writer_of_file = (int*)malloc(sizeof(int) * files_count);
+    group->batches = (file_batches*)calloc(files_count, sizeof(file_batches));
+    group->files = files;
+    group->stop = 0;
+
+    if(group->writers == NULL || group->writer_of_file == NULL || group->batches == NULL)
+    {
+        free_group(group);
+        return NULL;
+    }
+
+    for(int i = 0; i < files_count; i++){ group->writer_of_file[i] = i % writers_count; }
+
+    for(int w = 0; w < writers_count; w++)
+    {
+        file_writer* writer = &group->writers[w];
+
+        // batch has size of buffer of plan with its incomplete frame
+        size_t floats = 0;
+        int files_of_writer = 0;
+
+        for(int i = w; i < files_count; i += writers_count)
+        {
+            floats += (size_t)(plan->buffers[i].capacity + 1) * plan->buffers[i].channels * WRITER_BATCHES;
+            files_of_writer++;
+        }
+
+        float* memory = (float*)alloc_sample_memory(&writer->memory, sizeof(float) * floats, huge_pages);
+
+        // each ring can hold all batches of thread
+        writer->ring = create_spsc_ring(WRITER_BATCHES * files_of_writer);
+        writer->free_ring = create_spsc_ring(WRITER_BATCHES * files_of_writer);
+
+        if(memory == NULL || writer->ring == NULL || writer->free_ring == NULL)
+        {
+            logg("Ошибка создания очереди потока записи");
+
+            for(int j = 0; j <= w; j++){ free_writer(&group->writers[j]); }
+
+            free_group(group);
+            return NULL;
+        }
+
+        for(int i = w; i < files_count; i += writers_count)
+        {
+            file_batches* batches = &group->batches[i];
+            size_t batch_floats = (size_t)(plan->buffers[i].capacity + 1) * plan->buffers[i].channels;
+
+            for(int b = 0; b <= WRITER_BATCHES; b++)
+            {
+                // the last batch is current buffer of plan
+                if(b < WRITER_BATCHES)
+                {
+                    batches->batches[b].frames = memory;
+                    memory += batch_floats;
+
+                    batches->free_batches[b] = &batches->batches[b];
+                } else {
+                    batches->batches[b].frames = plan->buffers[i].frames;
+                }
+
+                batches->batches[b].frames_count = 0;
+                batches->batches[b].file = i;
+            }
+
+            batches->lent = &batches->batches[WRITER_BATCHES];
+            batches->free_count = WRITER_BATCHES;
+        }
+    }
+
+    for(int w = 0; w < writers_count; w++)
+    {
+        writer_thread_arg* arg = (writer_thread_arg*)malloc(sizeof(writer_thread_arg));
+        arg->group = group;
+        arg->writer = &group->writers[w];
+
+        pthread_create(&group->writers[w].thread, NULL, writer_thread, arg);
+    }
+
+    return group;
+}
+
+void destroy_writer_group(writer_group** group)
+{
+    __atomic_store_n(&(*group)->stop, 1, __ATOMIC_RELEASE);
+
+    for(int w = 0; w < (*group)->writers_count; w++)
+    {
+        pthread_join((*group)->writers[w].thread, NULL);
+        free_writer(&(*group)->writers[w]);
+    }
+
+    free_group(*group);
+
+    *group = NULL;
+}
+
+// Takes back written batches of thread. If wait is
+// set, waits for the first batch
+static void collect_free_batches(writer_group* group, file_writer* writer, int wait)
+{
+    frame_batch* batch;
+    int size, first_lch, last_buffer_index;
+    int timeout = wait ? -1 : 0;
+
+    do
+    {
+        pop_from_ring(writer->free_ring,
+                      (void**)&batch,
+                      &size,
+                      &first_lch,
+                      &last_buffer_index,
+                      timeout);
+
+        if(batch != NULL)
+        {
+            file_batches* batches = &group->batches[batch->file];
+
+            batches->free_batches[batches->free_count++] = batch;
+        }
+
+        timeout = 0;
+
+    } while(batch != NULL);
+}
+
+float* submit_frames(writer_group* group, int file, float* frames, int frames_count)
+{
+    file_writer* writer = &group->writers[group->writer_of_file[file]];
+    file_batches* batches = &group->batches[file];
+
+    collect_free_batches(group, writer, 0);
+
+    while(batches->free_count == 0){ collect_free_batches(group, writer, 1); }
+
+    // buffer of plan is passed as is
+    frame_batch* batch = batches->lent;
+
+    batch->frames = frames;
+    batch->frames_count = frames_count;
+
+    batches->lent = batches->free_batches[--batches->free_count];
+
+    push_to_ring(writer->ring, batch, frames_count, file, NOT_LAST_BUFFER);
+
+    return batches->lent->frames;
+}
+
+void wait_writers_idle(writer_group* group)
+{
+    for(int i = 0; i < group->files_count; i++)
+    {
+        file_batches* batches = &group->batches[i];
+
+        while(batches->free_count < WRITER_BATCHES)
+        {
+            collect_free_batches(group, &group->writers[group->writer_of_file[i]], 1);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    "writer.h" contains declaration of group of writing
+    threads. Output files are distributed between threads,
+    each thread gets batches of frames of its files through
+    own queue and writes them, so slow file doesn't delay
+    other files.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "spsc_ring.h"
+#include "wav_writer.h"
+#include "route.h"
+
+#include <pthread.h>
+
+#define WRITER_BATCHES     8   // count of free batches of each file
+#define WRITER_POP_TIMEOUT 100 // ms
+
+typedef struct {
+    float* frames;       // interleaved frames
+    int    frames_count; // count of frames in batch
+    int    file;         // index of output file
+} frame_batch;
+
+// Batches of one file. They are exchanged with buffer of
+// routing plan, so frames aren't copied
+typedef struct {
+    frame_batch  batches[WRITER_BATCHES + 1];
+    frame_batch* lent;                   // batch which is buffer of routing plan
+    frame_batch* free_batches[WRITER_BATCHES];
+    int          free_count;             // batches owned by dispatching thread
+} file_batches;
+
+typedef struct {
+    pthread_t     thread;
+    spsc_ring*    ring;         // batches for writing
+    spsc_ring*    free_ring;    // written batches
+    sample_memory memory;       // memory of batches of files of thread
+} file_writer;
+
+typedef struct {
+    int           writers_count;
+    file_writer*  writers;
+    int           files_count;
+    int*          writer_of_file; // index of thread for each file
+    file_batches* batches;        // batches of each file
+    audio_file**  files;          // output files
+    int           stop;           // 1 - threads must finish
+} writer_group;
+
+/*
+    Creates group of writing threads. Buffers of routing
+    plan become batches of group: plan fills one batch of
+    each file and exchanges it for free one when frames
+    are submitted.
+
+    writers_count - count of threads
+    plan          - routing plan, batches have size of its buffers
+    files         - array of output files. Files can be
+                    replaced while threads are idle.
+    huge_pages    - pages of batches (HUGE_PAGES_*)
+
+    Returns pointer to group or NULL if something was wrong.
+*/
+writer_group* create_writer_group(int writers_count,
+                                  routing_plan* plan,
+                                  audio_file** files,
+                                  int huge_pages);
+
+/*
+    Writes all passed frames, stops threads
+    and frees memory.
+*/
+void destroy_writer_group(writer_group** group);
+
+/*
+    Passes buffer of file with frames to its thread and
+    returns free batch of the same file in exchange. If
+    file has no free batches waits.
+
+    Called only from one dispatching thread.
+
+    group        - group
+    file         - index of file
+    frames       - buffer filled by routing plan (the last
+                   returned batch of file)
+    frames_count - count of complete frames in buffer
+
+    Returns frames of free batch.
+*/
+float* submit_frames(writer_group* group, int file, float* frames, int frames_count);
+
+/*
+    Waits until all passed frames are written. It is
+    used before closing of files.
+*/
+void wait_writers_idle(writer_group* group);
+
+#endif // WRITER_H
@@ -0,0 +1,182 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Validation of checker of continuity of data stream
+    (continuity.c). Stream of ADC words is generated and
+    damaged in known places: overflow message of module,
+    lost words, word without ADC data and word of unused
+    channel. Checker must find each break at its position,
+    also for channels which alias in channel field of word.
+
+    Build: make contcheck
+    Usage: contcheck [channel_count]
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/continuity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STREAM_WORDS 1000
+
+static int channel_numbers[MAX_CHANNELS];
+static int failed = 0;
+
+static uint32_t adc_word(int lch, int code)
+{
+    return ADC_WORD_FLAG |
+           (((uint32_t)channel_numbers[lch] << ADC_WORD_CH_SHIFT) & ADC_WORD_CH_MASK) |
+           ((uint32_t)code & 0xFFFFFF);
+}
+
+// Fills stream with words of consecutive logical channels
+static void fill_stream(uint32_t* raw, int size, int first_lch, int channel_count)
+{
+    for(int i = 0; i < size; i++){ raw[i] = adc_word((first_lch + i) % channel_count, i); }
+}
+
+static void expect_break(const char* name,
+                         continuity_checker* checker,
+                         const uint32_t* raw,
+                         int size,
+                         int first_lch,
+                         int kind,
+                         int position,
+                         int skip,
+                         int lch)
+{
+    continuity_break brk;
+
+    int result = check_continuity(checker, raw, size, first_lch, &brk);
+
+    int ok = result == kind && brk.kind == kind &&
+             (kind == CONTINUITY_OK || (brk.position == position && brk.skip == skip && brk.lch == lch));
+
+    if(!ok){ failed = 1; }
+
+    printf("%-24s вид: %d  позиция: %d  пропуск: %d  канал после: %d  %s\n",
+           name, brk.kind, brk.position, brk.skip, brk.lch, ok ? "OK" : "ОШИБКА");
+}
+
+int main(int argc, char** argv)
+{
+    int channel_count = argc > 1 ? atoi(argv[1]) : 4;
+
+    if(channel_count < 2 || channel_count > MAX_CHANNELS)
+    {
+        printf("Неверное количество каналов\n");
+        return EXIT_FAILURE;
+    }
+
+    // physical channels aren't equal to logical ones
+    for(int i = 0; i < channel_count; i++){ channel_numbers[i] = (i * 5 + 3) % MAX_CHANNELS; }
+
+    e502monitor_config config;
+    memset(&config, 0, sizeof(config));
+
+    config.channel_count = channel_count;
+    config.channel_numbers = channel_numbers;
+
+    continuity_checker checker;
+
+    if( init_continuity_checker(&checker, &config) != E502M_ERR_OK )
+    {
+        printf("Ошибка инициализации\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t raw[STREAM_WORDS];
+    int first_lch = 1;
+
+    fill_stream(raw, STREAM_WORDS, first_lch, channel_count);
+    expect_break("непрерывный поток", &checker, raw, STREAM_WORDS, first_lch,
+                 CONTINUITY_OK, 0, 0, 0);
+
+    // stream starts from other channel than expected
+    expect_break("сдвиг в начале", &checker, raw, STREAM_WORDS, 0,
+                 CONTINUITY_MISALIGN, 0, 0, first_lch);
+
+    // module lost data and inserted message, stream
+    // continues from other channel
+    fill_stream(raw, STREAM_WORDS, first_lch, channel_count);
+    raw[300] = STREAM_MSG_OVERFLOW;
+    fill_stream(raw + 301, STREAM_WORDS - 301, 0, channel_count);
+    expect_break("переполнение модуля", &checker, raw, STREAM_WORDS, first_lch,
+                 CONTINUITY_OVERRUN, 300, 1, 0);
+
+    // message at the end of block
+    fill_stream(raw, STREAM_WORDS, first_lch, channel_count);
+    raw[STREAM_WORDS - 1] = STREAM_MSG_OVERFLOW;
+    expect_break("переполнение в конце", &checker, raw, STREAM_WORDS, first_lch,
+                 CONTINUITY_OVERRUN, STREAM_WORDS - 1, 1, -1);
+
+    // one word is lost
+    fill_stream(raw, 500, first_lch, channel_count);
+    fill_stream(raw + 500, STREAM_WORDS - 500, (first_lch + 501) % channel_count, channel_count);
+    expect_break("потеря слова", &checker, raw, STREAM_WORDS, first_lch,
+                 CONTINUITY_MISALIGN, 500, 0, (first_lch + 501) % channel_count);
+
+    // word of digital inputs doesn't break order of channels
+    fill_stream(raw, STREAM_WORDS, first_lch, channel_count);
+    memmove(raw + 201, raw + 200, sizeof(uint32_t) * (STREAM_WORDS - 201));
+    raw[200] = 0x00001234;
+    expect_break("слово без данных АЦП", &checker, raw, STREAM_WORDS, first_lch,
+                 CONTINUITY_FOREIGN, 200, 1, (first_lch + 200) % channel_count);
+
+    // channel which isn't used in configuration
+    int unused = -1;
+
+    for(int ch = 0; ch < MAX_CHANNELS && unused < 0; ch++)
+    {
+        unused = ch;
+
+        for(int i = 0; i < channel_count; i++){ if(channel_numbers[i] == ch){ unused = -1; } }
+    }
+
+    if(unused >= 0)
+    {
+        fill_stream(raw, STREAM_WORDS, first_lch, channel_count);
+        raw[700] = ADC_WORD_FLAG | ((uint32_t)unused << ADC_WORD_CH_SHIFT);
+        expect_break("неиспользуемый канал", &checker, raw, STREAM_WORDS, first_lch,
+                     CONTINUITY_MISALIGN, 700, 1, -1);
+    }
+
+    // channels 1 and 17 have the same channel field of word,
+    // order of stream is checked by position
+    int aliased[3] = { 1, 17, 5 };
+
+    memcpy(channel_numbers, aliased, sizeof(aliased));
+    config.channel_count = 2;
+
+    if( init_continuity_checker(&checker, &config) != E502M_ERR_OK )
+    {
+        printf("Ошибка инициализации\n");
+        return EXIT_FAILURE;
+    }
+
+    fill_stream(raw, STREAM_WORDS, 1, 2);
+    expect_break("каналы 1, 17", &checker, raw, STREAM_WORDS, 1,
+                 CONTINUITY_OK, 0, 0, 0);
+
+    fill_stream(raw, STREAM_WORDS, 0, 2);
+    raw[400] = ADC_WORD_FLAG | (7u << ADC_WORD_CH_SHIFT);
+    expect_break("каналы 1, 17, чужой", &checker, raw, STREAM_WORDS, 0,
+                 CONTINUITY_MISALIGN, 400, 1, -1);
+
+    // word after loss has ambiguous channel, words are
+    // lost up to word of channel 5
+    config.channel_count = 3;
+    init_continuity_checker(&checker, &config);
+
+    fill_stream(raw, 302, 0, 3);
+    fill_stream(raw + 302, STREAM_WORDS - 302, 0, 3);
+    expect_break("каналы 1, 17, 5", &checker, raw, STREAM_WORDS, 0,
+                 CONTINUITY_MISALIGN, 302, 2, 2);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Validation and benchmark of native converter of raw
+    ADC words (adc_convert.c). Stream is converted by
+    X502_ProcessData and by each supported instruction
+    set, results are compared in units in the last place.
+
+    Raw file contains words as they are returned by
+    X502_Recv. If file isn't given, stream is generated.
+
+    Build: make convcheck
+    Usage: convcheck [raw_file|-] [channel_count] [range] [mode]
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/adc_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GENERATED_WORDS 4000000
+#define BENCH_REPEATS   20
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long long ulp_distance(double a, double b)
+{
+    long long ia, ib;
+
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+
+    // map doubles to monotonic integers
+    if(ia < 0){ ia = (long long)0x8000000000000000ULL - ia; }
+    if(ib < 0){ ib = (long long)0x8000000000000000ULL - ib; }
+
+    return ia > ib ? ia - ib : ib - ia;
+}
+
+static uint32_t* read_raw_file(char* file_name, int* size)
+{
+    FILE* raw_file = fopen(file_name, "rb");
+
+    if(raw_file == NULL){ return NULL; }
+
+    fseek(raw_file, 0, SEEK_END);
+    long bytes = ftell(raw_file);
+    fseek(raw_file, 0, SEEK_SET);
+
+    *size = (int)(bytes / sizeof(uint32_t));
+
+    uint32_t* raw = (uint32_t*)malloc(sizeof(uint32_t) * (*size));
+
+    if(raw != NULL && fread(raw, sizeof(uint32_t), *size, raw_file) != (size_t)*size)
+    {
+        free(raw);
+        raw = NULL;
+    }
+
+    fclose(raw_file);
+
+    return raw;
+}
+
+static uint32_t* generate_raw(int size, e502monitor_config* config, int mode)
+{
+    uint32_t* raw = (uint32_t*)malloc(sizeof(uint32_t) * size);
+
+    if(raw == NULL){ return NULL; }
+
+    srand(1);
+
+    for(int i = 0; i < size; i++)
+    {
+        int lch = i % config->channel_count;
+        int32_t code = (rand() % (2 * X502_ADC_SCALE_CODE_MAX)) - X502_ADC_SCALE_CODE_MAX;
+
+        raw[i] = ADC_WORD_FLAG |
+                 ((uint32_t)(mode & 0x3) << 28) |
+                 ((uint32_t)config->channel_numbers[lch] << ADC_WORD_CH_SHIFT) |
+                 ((uint32_t)code & 0xFFFFFF);
+    }
+
+    return raw;
+}
+
+int main(int argc, char** argv)
+{
+    char* file_name = argc > 1 ? argv[1] : "-";
+    int channel_count = argc > 2 ? atoi(argv[2]) : 1;
+    int range = argc > 3 ? atoi(argv[3]) : 2;
+    int mode = argc > 4 ? atoi(argv[4]) : 1;
+
+    if(channel_count < 1 || channel_count > MAX_CHANNELS)
+    {
+        printf("Неверное количество каналов: %d\n", channel_count);
+        return EXIT_FAILURE;
+    }
+
+    e502monitor_config config;
+    int numbers[MAX_CHANNELS];
+    int ranges[MAX_CHANNELS];
+
+    for(int i = 0; i < channel_count; i++)
+    {
+        numbers[i] = i;
+        ranges[i] = range;
+    }
+
+    config.channel_count = channel_count;
+    config.channel_numbers = numbers;
+    config.channel_ranges = ranges;
+
+    int size = GENERATED_WORDS;
+    uint32_t* raw = strcmp(file_name, "-") == 0 ? generate_raw(size, &config, mode)
+                                                : read_raw_file(file_name, &size);
+
+    if(raw == NULL)
+    {
+        printf("Ошибка чтения файла %s\n", file_name);
+        return EXIT_FAILURE;
+    }
+
+    double* expected = (double*)malloc(sizeof(double) * size);
+    double* converted = (double*)malloc(sizeof(double) * size);
+
+    // reference conversion
+    t_x502_hnd hnd = X502_Create();
+
+    X502_SetLChannelCount(hnd, channel_count);
+
+    for(int i = 0; i < channel_count; i++)
+    {
+        X502_SetLChannel(hnd, i, numbers[i], mode, ranges[i], 0);
+    }
+
+    double start = now_sec();
+    uint32_t expected_size = 0;
+
+    for(int r = 0; r < BENCH_REPEATS; r++)
+    {
+        expected_size = size;
+
+        int32_t err = X502_ProcessData(hnd, raw, size, X502_PROC_FLAGS_VOLT,
+                                       expected, &expected_size, NULL, NULL);
+
+        if(err != X502_ERR_OK)
+        {
+            printf("Ошибка X502_ProcessData: %s\n", X502_GetErrorString(err));
+            break;
+        }
+    }
+
+    double ref_time = (now_sec() - start) / BENCH_REPEATS;
+
+    X502_Free(hnd);
+
+    printf("Слов: %d, каналов: %d, диапазон: %d\n\n", size, channel_count, range);
+    printf("%-16s %10.1f Мотсч/с\n", "X502_ProcessData", expected_size / ref_time * 1e-6);
+
+    adc_converter conv;
+    init_adc_converter(&conv, &config, NULL);
+
+    int failed = 0;
+
+    for(int isa = ADC_ISA_SCALAR; isa <= ADC_ISA_AVX2; isa++)
+    {
+        if( set_adc_converter_isa(&conv, isa) != E502M_ERR_OK )
+        {
+            printf("%-16s не поддерживается\n", adc_isa_name(isa));
+            continue;
+        }
+
+        adc_convert_result result;
+
+        start = now_sec();
+
+        for(int r = 0; r < BENCH_REPEATS; r++)
+        {
+            adc_convert_double(&conv, raw, size, 0, converted, &result);
+        }
+
+        double time = (now_sec() - start) / BENCH_REPEATS;
+
+        long long max_ulp = 0;
+
+        for(int i = 0; i < result.samples && i < (int)expected_size; i++)
+        {
+            long long ulp = ulp_distance(expected[i], converted[i]);
+            if(ulp > max_ulp){ max_ulp = ulp; }
+        }
+
+        int ok = result.samples == (int)expected_size && max_ulp <= 1;
+        if(!ok){ failed = 1; }
+
+        printf("%-16s %10.1f Мотсч/с  отсчетов: %d  ошибок канала: %d  пропущено слов: %d  "
+               "макс. отличие: %lld ULP  %s\n",
+               adc_isa_name(isa), result.samples / time * 1e-6, result.samples,
+               result.channel_errors, result.skipped_words, max_ulp, ok ? "OK" : "ОШИБКА");
+    }
+
+    free(raw);
+    free(expected);
+    free(converted);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
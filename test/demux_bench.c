@@ -0,0 +1,452 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Benchmark of distribution of samples by output files:
+    old path (find_flac_file_index + data_frame with search
+    of channel and markers) and routing plan (route.c).
+    Frames are written in memory instead of files.
+
+    Then conversion and routing plan are run over buffers
+    of queue size in ordinary pages, transparent huge pages
+    and explicit huge pages (hugemem.c), with double and
+    float32 samples in blocks (sample_path).
+
+    At last kernels of routing plan for whole frames are
+    compared with generic loop for 1, 2, 4, 8 and 16 channels
+    in one file, in files of consecutive channels and in files
+    of channels in reverse order.
+
+    Build: make demux_bench
+    Usage: demux_bench [channel_count] [files_count] [blocks]
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/route.h"
+#include "../src/frame.h"
+#include "../src/common.h"
+#include "../src/adc_convert.h"
+#include "../src/hugemem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK_SIZE  1000000
+#define POOL_BLOCKS 8       // blocks of queue, buffers are larger than caches
+
+static e502monitor_config config;
+
+// layout of channels in config
+static int numbers[MAX_CHANNELS];
+static int counts[MAX_CHANNELS];
+static int distribution_data[MAX_CHANNELS][MAX_CHANNELS];
+static int* distribution[MAX_CHANNELS];
+static int formats[MAX_CHANNELS];
+static int ranges[MAX_CHANNELS];
+static float* sink;        // written frames
+static long   sink_frames; // count of written frames
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void write_frames(const float* frames, int channels, int count)
+{
+    memcpy(sink, frames, sizeof(float) * channels * count);
+    sink_frames += count;
+}
+
+// the same as find_flac_file_index() of old write_data()
+static int find_file_index(int channel_index)
+{
+    channel_index = config.channel_numbers[channel_index];
+
+    for(int i = 0; i < config.files_count; i++)
+    {
+        for(int j = 0; j < config.channel_counts_in_files[i]; j++)
+        {
+            if( config.channel_distribution[i][j] == channel_index ){ return i; }
+        }
+    }
+
+    return -1;
+}
+
+static double run_frames(const double* data, int blocks)
+{
+    data_frame** frames = (data_frame**)malloc(sizeof(data_frame*) * config.files_count);
+
+    for(int i = 0; i < config.files_count; i++)
+    {
+        frames[i] = create_frame(config.channel_counts_in_files[i], config.channel_distribution[i]);
+    }
+
+    double start = now_sec();
+
+    for(int b = 0; b < blocks; b++)
+    {
+        int ch_cntr = 0;
+
+        for(int i = 0; i < BLOCK_SIZE; i++, ch_cntr++)
+        {
+            if(ch_cntr == config.channel_count){ ch_cntr = 0; }
+
+            int file = find_file_index(ch_cntr);
+
+            add_data_in_frame(frames[file], data[i], config.channel_numbers[ch_cntr]);
+
+            if(is_frame_full(frames[file]) == FRAME_FULL)
+            {
+                write_frames(frames[file]->data, frames[file]->size, 1);
+                clear_frame(frames[file]);
+            }
+        }
+    }
+
+    double time = now_sec() - start;
+
+    for(int i = 0; i < config.files_count; i++){ destroy_frame(&frames[i]); }
+    free(frames);
+
+    return time;
+}
+
+static double run_plan(const double* data, int blocks)
+{
+    routing_plan* plan = create_routing_plan(&config, BLOCK_SIZE / config.channel_count + 2);
+
+    double start = now_sec();
+
+    for(int b = 0; b < blocks; b++)
+    {
+        demux_block(plan, data, BLOCK_SIZE, 0);
+
+        for(int i = 0; i < plan->files_count; i++)
+        {
+            demux_buffer* buffer = &plan->buffers[i];
+
+            write_frames(buffer->frames, buffer->channels, buffer->frames_count);
+            consume_frames(plan, i);
+        }
+    }
+
+    double time = now_sec() - start;
+
+    destroy_routing_plan(&plan);
+
+    return time;
+}
+
+static int sample_bytes(int sample_path)
+{
+    return sample_path == SAMPLE_PATH_FLOAT32 ? sizeof(float) : sizeof(double);
+}
+
+// Converts and distributes blocks of pool with buffers in pages of given kind
+static void run_pages(int huge_pages, int sample_path, int blocks)
+{
+    size_t words = (size_t)BLOCK_SIZE * POOL_BLOCKS;
+
+    sample_memory raw_memory, data_memory;
+
+    uint32_t* raw = (uint32_t*)alloc_sample_memory(&raw_memory, sizeof(uint32_t) * words, huge_pages);
+    void* data = alloc_sample_memory(&data_memory, sample_bytes(sample_path) * words, huge_pages);
+
+    config.huge_pages = huge_pages;
+
+    routing_plan* plan = create_routing_plan(&config, BLOCK_SIZE / config.channel_count + 2);
+
+    if(raw == NULL || data == NULL || plan == NULL)
+    {
+        printf("%-16s не удалось выделить память\n", huge_pages_name(huge_pages));
+        return;
+    }
+
+    // words are written before measurement, so pages are mapped
+    for(size_t i = 0; i < words; i++)
+    {
+        int lch = i % config.channel_count;
+
+        raw[i] = ADC_WORD_FLAG |
+                 ((uint32_t)config.channel_numbers[lch] << ADC_WORD_CH_SHIFT) |
+                 ((uint32_t)(i * 7919) & 0x7FFFFF);
+    }
+
+    memset(data, 0, sample_bytes(sample_path) * words);
+
+    adc_converter conv;
+    init_adc_converter(&conv, &config, NULL);
+
+    double convert_time = 0;
+    double demux_time = 0;
+
+    for(int b = 0; b < blocks * POOL_BLOCKS; b++)
+    {
+        size_t offset = (size_t)(b % POOL_BLOCKS) * BLOCK_SIZE;
+
+        double start = now_sec();
+
+        if(sample_path == SAMPLE_PATH_FLOAT32)
+        {
+            adc_convert_float(&conv, raw + offset, BLOCK_SIZE, 0, (float*)data + offset, NULL);
+        } else {
+            adc_convert_double(&conv, raw + offset, BLOCK_SIZE, 0, (double*)data + offset, NULL);
+        }
+
+        double middle = now_sec();
+
+        if(sample_path == SAMPLE_PATH_FLOAT32)
+        {
+            demux_block_float(plan, (float*)data + offset, BLOCK_SIZE, 0);
+        } else {
+            demux_block(plan, (double*)data + offset, BLOCK_SIZE, 0);
+        }
+
+        for(int i = 0; i < plan->files_count; i++){ consume_frames(plan, i); }
+
+        convert_time += middle - start;
+        demux_time += now_sec() - middle;
+    }
+
+    double samples = (double)blocks * POOL_BLOCKS * BLOCK_SIZE;
+
+    printf("%-9s %-8s перевод: %8.1f Мотсч/с  распределение: %8.1f Мотсч/с  "
+           "страницы: блоки %s, кадры %s\n",
+           huge_pages_name(huge_pages),
+           sample_path == SAMPLE_PATH_FLOAT32 ? "float32" : "double",
+           samples / convert_time * 1e-6,
+           samples / demux_time * 1e-6,
+           huge_pages_name(data_memory.pages),
+           huge_pages_name(plan->frames_memory.pages));
+
+    destroy_routing_plan(&plan);
+    free_sample_memory(&raw_memory);
+    free_sample_memory(&data_memory);
+}
+
+// Distributes channels by files in order of logical
+// channels or in reverse order, so frames aren't filled
+// in order of slots
+static void set_layout(int channel_count, int files_count, int reverse)
+{
+    for(int i = 0; i < channel_count; i++)
+    {
+        numbers[i] = i;
+        ranges[i] = 0;
+    }
+
+    for(int i = 0, ch = 0; i < files_count; i++)
+    {
+        counts[i] = channel_count / files_count + (i < channel_count % files_count ? 1 : 0);
+        distribution[i] = distribution_data[i];
+        formats[i] = SAMPLE_FLOAT32;
+
+        for(int j = 0; j < counts[i]; j++, ch++)
+        {
+            distribution[i][j] = reverse ? channel_count - 1 - ch : ch;
+        }
+    }
+
+    config.channel_count = channel_count;
+    config.channel_numbers = numbers;
+    config.files_count = files_count;
+    config.channel_counts_in_files = counts;
+    config.channel_distribution = distribution;
+    config.sample_formats = formats;
+    config.channel_ranges = ranges;
+    config.huge_pages = HUGE_PAGES_OFF;
+}
+
+// Distributes blocks by plan, block starts from logical channel
+// after the last one of previous block as in write_data()
+static double run_kernel(routing_plan* plan, const void* data, int sample_path, int blocks)
+{
+    int lch = 1 % config.channel_count;
+
+    double start = now_sec();
+
+    for(int b = 0; b < blocks; b++)
+    {
+        if(sample_path == SAMPLE_PATH_FLOAT32)
+        {
+            lch = demux_block_float(plan, (const float*)data, BLOCK_SIZE, lch);
+        } else {
+            lch = demux_block(plan, (const double*)data, BLOCK_SIZE, lch);
+        }
+
+        for(int i = 0; i < plan->files_count; i++){ consume_frames(plan, i); }
+    }
+
+    return now_sec() - start;
+}
+
+// Returns 1 if kernel of plan gives the same frames as generic loop
+static int same_frames(const void* data, int sample_path)
+{
+    routing_plan* plans[2];
+
+    for(int k = 0; k < 2; k++)
+    {
+        plans[k] = create_routing_plan(&config, BLOCK_SIZE / config.channel_count + 2);
+
+        if(k == 0){ plans[k]->kernel = DEMUX_GENERIC; }
+
+        // head and tail of block are incomplete frames
+        int size = BLOCK_SIZE - 3;
+
+        if(sample_path == SAMPLE_PATH_FLOAT32)
+        {
+            demux_block_float(plans[k], (const float*)data, size, 1 % config.channel_count);
+        } else {
+            demux_block(plans[k], (const double*)data, size, 1 % config.channel_count);
+        }
+    }
+
+    int same = 1;
+
+    for(int i = 0; i < config.files_count; i++)
+    {
+        demux_buffer* a = &plans[0]->buffers[i];
+        demux_buffer* b = &plans[1]->buffers[i];
+
+        if(a->frames_count != b->frames_count || a->filled != b->filled ||
+           memcmp(a->frames, b->frames, sizeof(float) * a->frames_count * a->channels) != 0)
+        {
+            same = 0;
+        }
+    }
+
+    destroy_routing_plan(&plans[0]);
+    destroy_routing_plan(&plans[1]);
+
+    return same;
+}
+
+// Compares kernels with generic loop for common layouts
+static void run_kernels(int blocks)
+{
+    double* data = (double*)malloc(sizeof(double) * BLOCK_SIZE);
+    float* fdata = (float*)malloc(sizeof(float) * BLOCK_SIZE);
+
+    for(int i = 0; i < BLOCK_SIZE; i++)
+    {
+        data[i] = (double)(i % 1000) * 1e-3;
+        fdata[i] = (float)data[i];
+    }
+
+    int channel_counts[5] = { 1, 2, 4, 8, 16 };
+
+    printf("\n%-8s %-6s %-8s %-11s %14s %14s %8s  %s\n",
+           "каналов", "файлов", "отсчеты", "ядро", "generic", "ядро", "ускор.", "проверка");
+
+    for(int c = 0; c < 5; c++)
+    {
+        // one file, files of consecutive channels, files in reverse order
+        for(int layout = 0; layout < 3; layout++)
+        {
+            int channel_count = channel_counts[c];
+            int files_count = layout == 0 ? 1 : (channel_count >= 4 ? 4 : channel_count);
+            int reverse = layout == 2;
+
+            if(layout > 0 && channel_count == 1){ continue; }
+
+            set_layout(channel_count, files_count, reverse);
+
+            for(int sample_path = SAMPLE_PATH_DOUBLE; sample_path <= SAMPLE_PATH_FLOAT32; sample_path++)
+            {
+                const void* samples = sample_path == SAMPLE_PATH_FLOAT32 ? (const void*)fdata :
+                                                                           (const void*)data;
+
+                routing_plan* plan = create_routing_plan(&config, BLOCK_SIZE / channel_count + 2);
+
+                int kernel = plan->kernel;
+                const char* name = demux_kernel_name(plan);
+
+                plan->kernel = DEMUX_GENERIC;
+                double generic_time = run_kernel(plan, samples, sample_path, blocks);
+
+                plan->kernel = kernel;
+                double kernel_time = run_kernel(plan, samples, sample_path, blocks);
+
+                destroy_routing_plan(&plan);
+
+                double count = (double)blocks * BLOCK_SIZE;
+
+                printf("%-8d %-6d %-8s %-11s %8.1f Мотсч/с %8.1f Мотсч/с %7.2fx  %s\n",
+                       channel_count,
+                       files_count,
+                       sample_path == SAMPLE_PATH_FLOAT32 ? "float32" : "double",
+                       name,
+                       count / generic_time * 1e-6,
+                       count / kernel_time * 1e-6,
+                       generic_time / kernel_time,
+                       same_frames(samples, sample_path) ? "OK" : "ОШИБКА");
+            }
+        }
+    }
+
+    free(data);
+    free(fdata);
+}
+
+int main(int argc, char** argv)
+{
+    int channel_count = argc > 1 ? atoi(argv[1]) : 16;
+    int files_count = argc > 2 ? atoi(argv[2]) : 4;
+    int blocks = argc > 3 ? atoi(argv[3]) : 20;
+
+    if(channel_count < 1 || channel_count > MAX_CHANNELS || files_count < 1 || files_count > channel_count)
+    {
+        printf("Неверное количество каналов или файлов\n");
+        return EXIT_FAILURE;
+    }
+
+    // channels are distributed by files in reverse order,
+    // so frames aren't filled in order of slots
+    set_layout(channel_count, files_count, 1);
+
+    double* data = (double*)malloc(sizeof(double) * BLOCK_SIZE);
+    sink = (float*)malloc(sizeof(float) * BLOCK_SIZE * 2);
+
+    for(int i = 0; i < BLOCK_SIZE; i++){ data[i] = (double)i; }
+
+    printf("Каналов: %d, файлов: %d, блоков: %d по %d отсчетов\n\n",
+           channel_count, files_count, blocks, BLOCK_SIZE);
+
+    double samples = (double)blocks * BLOCK_SIZE;
+
+    sink_frames = 0;
+    double time = run_frames(data, blocks);
+    printf("%-16s %10.1f Мотсч/с  кадров: %ld\n", "data_frame", samples / time * 1e-6, sink_frames);
+
+    sink_frames = 0;
+    time = run_plan(data, blocks);
+    printf("%-16s %10.1f Мотсч/с  кадров: %ld\n", "routing_plan", samples / time * 1e-6, sink_frames);
+
+    printf("\nБуферы очереди: %d блоков, double: %.0f МБ, float32: %.0f МБ\n\n",
+           POOL_BLOCKS,
+           (sizeof(uint32_t) + sizeof(double)) * (double)BLOCK_SIZE * POOL_BLOCKS / 1048576,
+           (sizeof(uint32_t) + sizeof(float)) * (double)BLOCK_SIZE * POOL_BLOCKS / 1048576);
+
+    int pages[3] = { HUGE_PAGES_OFF, HUGE_PAGES_THP, HUGE_PAGES_EXPLICIT };
+
+    for(int i = 0; i < 3; i++)
+    {
+        run_pages(pages[i], SAMPLE_PATH_DOUBLE, blocks);
+        run_pages(pages[i], SAMPLE_PATH_FLOAT32, blocks);
+    }
+
+    run_kernels(blocks);
+
+    free(data);
+    free(sink);
+
+    return 0;
+}
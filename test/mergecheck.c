@@ -0,0 +1,232 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Validation of merged output of several modules
+    (merge.c). Two modules record the same sine, second
+    module starts later and its clock is fast. Blocks are
+    passed with clock models fitted by jittered timestamps
+    as in acquisition of module, one block of second
+    module is dropped. Merged file is read back, channels
+    of modules are compared outside of gaps and the dropped
+    block must be listed as gap in .prop files.
+
+    Build: make mergecheck
+    Usage: mergecheck [nearest|resample] [drift_ppm] [jitter_us]
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glob.h>
+#include <unistd.h>
+
+#define CHECK_RATE        10000.0  // frames per second of modules
+#define CHECK_SECONDS     30
+#define CHECK_FILE_SIZE   2        // seconds of merged file
+#define CHECK_BLOCK       500      // frames in block
+#define CHECK_SIGNAL_HZ   20.0
+#define CHECK_START_US    1000000000LL // monotonic time of first sample
+#define CHECK_DELAY_US    3300     // start of second module
+#define CHECK_SETTLE_SEC  10       // model converges in first seconds
+#define CHECK_DROP_SEC    20       // block of second module is dropped
+#define CHECK_GAP_MARGIN  2        // frames around gap touched by interpolation
+#define CHECK_DIR         "/tmp/e502monitor_mergecheck"
+
+static double signal_at(double time_us)
+{
+    return sin(2 * M_PI * CHECK_SIGNAL_HZ * (time_us - CHECK_START_US) * 1e-6);
+}
+
+int main(int argc, char** argv)
+{
+    int mode = argc > 1 && strcmp(argv[1], "nearest") == 0 ? MERGE_NEAREST : MERGE_RESAMPLE;
+    double drift_ppm = argc > 2 ? atof(argv[2]) : 50;
+    double jitter_us = argc > 3 ? atof(argv[3]) : 300;
+
+    int channel_numbers[1] = {0};
+    char* channel_names[1] = {"ch0"};
+
+    e502monitor_config common;
+    e502monitor_config modules[2];
+    e502monitor_config* module_list[2] = {&modules[0], &modules[1]};
+
+    memset(&common, 0, sizeof(common));
+
+    common.merge_mode = mode;
+    common.file_size = CHECK_FILE_SIZE;
+    common.wav_writer = WAV_WRITER_NATIVE;
+    strcpy(common.merge_dir, CHECK_DIR);
+
+    for(int i = 0; i < 2; i++)
+    {
+        memset(&modules[i], 0, sizeof(modules[i]));
+
+        modules[i].channel_count = 1;
+        modules[i].adc_freq = CHECK_RATE;
+        modules[i].capture_mode = CAPTURE_WAV;
+        modules[i].channel_numbers = channel_numbers;
+        modules[i].channel_names = channel_names;
+        sprintf(modules[i].serial, "MODULE%d", i);
+    }
+
+    merge_stage* stage = create_merge_stage(&common, module_list, 2);
+
+    if(stage == NULL || start_merge_stage(stage) != E502M_ERR_OK)
+    {
+        printf("Ошибка создания объединения\n");
+        return EXIT_FAILURE;
+    }
+
+    // true interval between samples of each module
+    double sample_us[2] = { 1e6 / CHECK_RATE, 1e6 / (CHECK_RATE * (1 + drift_ppm * 1e-6)) };
+    double start_us[2] = { CHECK_START_US, CHECK_START_US + CHECK_DELAY_US };
+
+    // models are fitted as by writing threads of modules
+    clock_model clocks[2];
+
+    init_clock_model(&clocks[0], CHECK_RATE);
+    init_clock_model(&clocks[1], CHECK_RATE);
+
+    double samples[CHECK_BLOCK];
+    long long blocks = (long long)(CHECK_SECONDS * CHECK_RATE / CHECK_BLOCK);
+    long long drop_block = (long long)(CHECK_DROP_SEC * CHECK_RATE / CHECK_BLOCK);
+
+    srand(1);
+
+    for(long long b = 0; b < blocks; b++)
+    {
+        for(int i = 0; i < 2; i++)
+        {
+            long long first = b * CHECK_BLOCK;
+
+            if(i == 1 && b == drop_block){ continue; }
+
+            for(int j = 0; j < CHECK_BLOCK; j++)
+            {
+                samples[j] = signal_at(start_us[i] + (first + j) * sample_us[i]);
+            }
+
+            // block is received some time after its last sample
+            double delay = jitter_us * rand() / RAND_MAX;
+            long long time_us = (long long)(start_us[i] + (first + CHECK_BLOCK - 1) * sample_us[i] + delay);
+
+            clock_model_add(&clocks[i], (double)(first + CHECK_BLOCK), time_us);
+
+            push_merge_samples(stage, i, samples, CHECK_BLOCK, first, &clocks[i], time_us,
+                               i == 1 && b == drop_block + 1 ? GAP_OVERFLOW : 0);
+        }
+
+        // merging thread keeps up as with real modules
+        usleep(1000);
+    }
+
+    stop_merge_stage(stage);
+    destroy_merge_stage(&stage);
+
+    glob_t files;
+
+    if(glob(CHECK_DIR "/*/*_merged.wav", 0, NULL, &files) != 0)
+    {
+        printf("Объединенные файлы не найдены\n");
+        return EXIT_FAILURE;
+    }
+
+    double max_error = 0;
+    long long frames = 0;
+    long long gap_frames = 0;
+
+    for(size_t f = 0; f < files.gl_pathc; f++)
+    {
+        char prop_name[MERGE_NAME_SIZE];
+        snprintf(prop_name, sizeof(prop_name), "%s.prop", files.gl_pathv[f]);
+
+        FILE* prop = fopen(prop_name, "r");
+        char line[MERGE_NAME_SIZE];
+
+        long long gap_first[MAX_SEGMENT_GAPS];
+        long long gap_last[MAX_SEGMENT_GAPS];
+        int gaps_count = 0;
+
+        printf("%s\n", files.gl_pathv[f]);
+
+        while(prop != NULL && fgets(line, sizeof(line), prop) != NULL)
+        {
+            if(strncmp(line, "device=", 7) == 0){ printf("  %s", line); }
+
+            long long position, length;
+            char cause[32];
+
+            if(sscanf(line, "gap=%lld:%lld:%31[^:]", &position, &length, cause) == 3 &&
+               gaps_count < MAX_SEGMENT_GAPS)
+            {
+                printf("  %s", line);
+
+                if(strcmp(cause, "overflow") == 0){ gap_frames += length; }
+
+                gap_first[gaps_count] = frames + position - CHECK_GAP_MARGIN;
+                gap_last[gaps_count] = frames + position + length + CHECK_GAP_MARGIN;
+                gaps_count++;
+            }
+        }
+
+        if(prop != NULL){ fclose(prop); }
+
+        remove(prop_name);
+
+        FILE* file = fopen(files.gl_pathv[f], "rb");
+
+        fseek(file, WAV_HEADER_SIZE, SEEK_SET);
+
+        float frame[2];
+
+        while(fread(frame, sizeof(float), 2, file) == 2)
+        {
+            long long index = frames++;
+
+            if(index < CHECK_SETTLE_SEC * CHECK_RATE){ continue; }
+
+            int in_gap = 0;
+
+            for(int g = 0; g < gaps_count; g++)
+            {
+                if(index >= gap_first[g] && index < gap_last[g]){ in_gap = 1; }
+            }
+
+            if(in_gap){ continue; }
+
+            double error = fabs(frame[0] - frame[1]);
+
+            if(error > max_error){ max_error = error; }
+        }
+
+        fclose(file);
+
+        remove(files.gl_pathv[f]);
+    }
+
+    globfree(&files);
+
+    // error of sine by timing error: 2*pi*f*dt. Timestamps are
+    // averaged by model, nearest samples of two modules differ
+    // by up to one frame
+    double allowed_us = jitter_us / 5 + (mode == MERGE_NEAREST ? 1e6 / CHECK_RATE : 0);
+    double allowed = 2 * M_PI * CHECK_SIGNAL_HZ * allowed_us * 1e-6;
+
+    printf("\nРежим: %s, уход часов: %.1f ppm, разброс меток: %.0f мкс\n",
+           mode == MERGE_NEAREST ? "nearest" : "resample", drift_ppm, jitter_us);
+    printf("Кадров: %lld, макс. расхождение каналов: %.6f (допустимо %.6f, %.1f мкс)\n",
+           frames, max_error, allowed, max_error / (2 * M_PI * CHECK_SIGNAL_HZ) * 1e6);
+    printf("Кадров в пропусках: %lld (пропущен блок %d кадров)\n", gap_frames, CHECK_BLOCK);
+
+    // dropped block and frames around it used by interpolation
+    int gap_ok = gap_frames >= CHECK_BLOCK && gap_frames <= CHECK_BLOCK + CHECK_GAP_MARGIN;
+
+    return frames > 0 && max_error <= allowed && gap_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,194 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Validation of pre-roll ring (preroll.c). Blocks of
+    double and float samples are pushed in ring, one block
+    is lost. Snapshot of the last seconds is written, read
+    back and each sample is compared with its index in
+    stream. Lost samples must be zeros and described in
+    .prop file.
+
+    Build: make prerollcheck
+    Usage: prerollcheck [channel_count]
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/preroll.h"
+#include "../src/common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+
+#define CHECK_RATE       1000.0   // frames per second
+#define CHECK_SECONDS    10
+#define CHECK_PREROLL    2        // seconds of snapshot
+#define CHECK_BLOCK      250      // frames in block
+#define CHECK_LOST_BLOCK 36       // index of lost block (in last seconds)
+#define CHECK_START_US   1700000000000000LL
+#define CHECK_DIR        "/tmp/e502monitor_prerollcheck"
+
+int main(int argc, char** argv)
+{
+    int channel_count = argc > 1 ? atoi(argv[1]) : 3;
+
+    if(channel_count < 1 || channel_count > MAX_CHANNELS)
+    {
+        printf("Неверное количество каналов\n");
+        return EXIT_FAILURE;
+    }
+
+    int channel_numbers[MAX_CHANNELS];
+    char* channel_names[MAX_CHANNELS];
+    char names[MAX_CHANNELS][8];
+
+    for(int i = 0; i < channel_count; i++)
+    {
+        channel_numbers[i] = i;
+        sprintf(names[i], "ch%d", i);
+        channel_names[i] = names[i];
+    }
+
+    e502monitor_config config;
+    memset(&config, 0, sizeof(config));
+
+    config.channel_count = channel_count;
+    config.adc_freq = CHECK_RATE;
+    config.channel_numbers = channel_numbers;
+    config.channel_names = channel_names;
+    config.wav_writer = WAV_WRITER_NATIVE;
+    config.preroll_seconds = CHECK_PREROLL;
+    strcpy(config.serial, "MODULE0");
+    strcpy(config.preroll_dir, CHECK_DIR);
+
+    preroll_ring* ring = create_preroll_ring(&config);
+
+    if(ring == NULL)
+    {
+        printf("Ошибка создания кольца предзаписи\n");
+        return EXIT_FAILURE;
+    }
+
+    int block_size = CHECK_BLOCK * channel_count;
+    double* samples = (double*)malloc(sizeof(double) * block_size);
+    float* fsamples = (float*)malloc(sizeof(float) * block_size);
+
+    long long blocks = (long long)(CHECK_SECONDS * CHECK_RATE / CHECK_BLOCK);
+    long long lost_first = -1;
+
+    // value of sample is its index in stream
+    for(long long b = 0; b < blocks; b++)
+    {
+        long long first = b * block_size;
+
+        if(b == CHECK_LOST_BLOCK)
+        {
+            gap_info gap = { first, block_size, GAP_OVERFLOW, 0, 0 };
+            add_preroll_gap(ring, &gap);
+
+            lost_first = first;
+            continue;
+        }
+
+        for(int j = 0; j < block_size; j++)
+        {
+            samples[j] = (double)(first + j);
+            fsamples[j] = (float)(first + j);
+        }
+
+        if(b % 2 == 0)
+        {
+            push_preroll_samples(ring, samples, 0, block_size, first);
+        } else {
+            push_preroll_samples(ring, fsamples, 1, block_size, first);
+        }
+    }
+
+    request_preroll_snapshot(ring);
+
+    long long first_sample = 0;
+    long long end_sample = 0;
+
+    if(preroll_snapshot_requested(ring)){ get_preroll_range(ring, &first_sample, &end_sample); }
+
+    double frame_us = 1e6 / CHECK_RATE;
+
+    take_preroll_snapshot(ring,
+                          first_sample,
+                          end_sample,
+                          CHECK_START_US + (long long)(first_sample / channel_count * frame_us),
+                          CHECK_START_US + (long long)(end_sample / channel_count * frame_us));
+
+    // waits for snapshot
+    destroy_preroll_ring(&ring);
+
+    free(samples);
+    free(fsamples);
+
+    glob_t files;
+
+    if(glob(CHECK_DIR "/*/*_preroll.wav", 0, NULL, &files) != 0 || files.gl_pathc != 1)
+    {
+        printf("Файл снимка не найден\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(files.gl_pathv[0], "rb");
+
+    fseek(file, WAV_HEADER_SIZE, SEEK_SET);
+
+    long long index = first_sample;
+    long long errors = 0;
+    float value;
+
+    while(fread(&value, sizeof(float), 1, file) == 1)
+    {
+        int lost = index >= lost_first && index < lost_first + block_size;
+        float expected = lost ? 0.f : (float)index;
+
+        if(value != expected){ errors++; }
+
+        index++;
+    }
+
+    fclose(file);
+
+    printf("%s\n", files.gl_pathv[0]);
+
+    long long expected_frames = (long long)(CHECK_PREROLL * CHECK_RATE);
+    long long frames = (index - first_sample) / channel_count;
+
+    char prop_name[PREROLL_NAME_SIZE + 10];
+    snprintf(prop_name, sizeof(prop_name), "%s.prop", files.gl_pathv[0]);
+
+    FILE* prop = fopen(prop_name, "r");
+    char line[PREROLL_NAME_SIZE];
+    char expected_gap[100];
+    int gap_found = 0;
+
+    sprintf(expected_gap, "gap=%lld:%d:overflow:",
+            (lost_first - first_sample) / channel_count, CHECK_BLOCK);
+
+    while(prop != NULL && fgets(line, sizeof(line), prop) != NULL)
+    {
+        printf("  %s", line);
+
+        if(strncmp(line, expected_gap, strlen(expected_gap)) == 0){ gap_found = 1; }
+    }
+
+    if(prop != NULL){ fclose(prop); }
+
+    remove(files.gl_pathv[0]);
+    remove(prop_name);
+
+    globfree(&files);
+
+    printf("\nКадров: %lld (ожидалось %lld), неверных отсчетов: %lld, пропуск в .prop: %s\n",
+           frames, expected_frames, errors, gap_found ? "да" : "нет");
+
+    return frames == expected_frames && errors == 0 && gap_found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,223 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Benchmark of queues between receiving and writing threads:
+    old pdouble_queue (mutex + list + polling with usleep) and
+    spsc_ring (lock-free ring + eventfd wakeup).
+
+    Build: make ring_bench
+    Usage: ring_bench [seconds] [channel_count] [adc_freq]
+
+    adc_freq is frequency of each channel, blocks come at
+    rate of words of all channels.
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/pdouble_queue.h"
+#include "../src/spsc_ring.h"
+#include "../src/block_pool.h"
+#include "../src/common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define READ_TIMEOUT 2000 // ms, default value of read_timeout
+#define POOL_BLOCKS  10
+#define FAST_ITEMS   2000000
+
+typedef struct {
+    int    use_ring;
+    int    items_count;
+    int    block_size;
+    long   period_us;      // pause between blocks (0 - no pause)
+    int    poll_sleep_us;  // sleep of pdouble_queue consumer
+
+    double* push_time;     // time of push of each block
+    double  latency_sum;
+    double  latency_max;
+    long    wakeups;       // count of pop calls
+} bench_ctx;
+
+static pdouble_queue* queue;
+static spsc_ring*     ring;
+static block_pool*    pool;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_sec()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+static void* consumer(void* arg)
+{
+    bench_ctx* ctx = (bench_ctx*)arg;
+    int received = 0;
+
+    while(received < ctx->items_count)
+    {
+        data_block* block;
+        int size, first_lch, last_buffer_index;
+
+        ctx->wakeups++;
+
+        if(ctx->use_ring)
+        {
+            pop_from_ring(ring, (void**)&block, &size, &first_lch,
+                          &last_buffer_index, READ_TIMEOUT / 2);
+        } else {
+            pop_from_pdqueue(queue, &block, &size, &first_lch, &last_buffer_index);
+        }
+
+        if(block == NULL)
+        {
+            if(!ctx->use_ring && ctx->poll_sleep_us > 0){ usleep(ctx->poll_sleep_us); }
+            continue;
+        }
+
+        double latency = now_sec() - ctx->push_time[first_lch];
+
+        ctx->latency_sum += latency;
+        if(latency > ctx->latency_max){ ctx->latency_max = latency; }
+
+        release_block(pool, block);
+        received++;
+    }
+
+    return NULL;
+}
+
+static void run(bench_ctx* ctx, char* name)
+{
+    ctx->push_time = (double*)malloc(sizeof(double) * ctx->items_count);
+    ctx->latency_sum = 0;
+    ctx->latency_max = 0;
+    ctx->wakeups = 0;
+
+    pthread_t thread;
+
+    double cpu_start = cpu_sec();
+    double start = now_sec();
+
+    pthread_create(&thread, NULL, consumer, ctx);
+
+    for(int i = 0; i < ctx->items_count; i++)
+    {
+        if(ctx->period_us > 0)
+        {
+            // keep rate of module: block i is ready at start + i * period
+            double ready = start + (double)i * ctx->period_us * 1e-6;
+            double pause = ready - now_sec();
+            if(pause > 0){ usleep((useconds_t)(pause * 1e6)); }
+        }
+
+        data_block* block = acquire_block(pool);
+
+        // index of block is passed as first_lch
+        ctx->push_time[i] = now_sec();
+
+        if(ctx->use_ring)
+        {
+            push_to_ring(ring, block, ctx->block_size, i, NOT_LAST_BUFFER);
+        } else {
+            push_to_pdqueue(queue, block, ctx->block_size, i, NOT_LAST_BUFFER);
+        }
+    }
+
+    pthread_join(thread, NULL);
+
+    double elapsed = now_sec() - start;
+    double cpu = cpu_sec() - cpu_start;
+
+    printf("%-28s blocks: %8d  blocks/s: %11.0f  latency avg: %9.3f ms  max: %9.3f ms  "
+           "pops: %9ld  cpu: %6.3f s\n",
+           name,
+           ctx->items_count,
+           ctx->items_count / elapsed,
+           ctx->latency_sum / ctx->items_count * 1e3,
+           ctx->latency_max * 1e3,
+           ctx->wakeups,
+           cpu);
+
+    free(ctx->push_time);
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    int channel_count = argc > 2 ? atoi(argv[2]) : 16;
+    double adc_freq = argc > 3 ? atof(argv[3]) : 125000.0;
+
+    if(channel_count < 1 || channel_count > MAX_CHANNELS || adc_freq <= 0)
+    {
+        printf("Неверное количество каналов или частота АЦП\n");
+        return EXIT_FAILURE;
+    }
+
+    // words of all channels per second
+    double rate = adc_freq * channel_count;
+
+    // same size as init_config() uses in release build,
+    // block starts from the same logical channel
+    int block_size = (int)(adc_freq / 2);
+
+    block_size -= block_size % channel_count;
+
+    if(block_size < channel_count){ block_size = channel_count; }
+
+    long period_us = (long)(1e6 * block_size / rate);
+
+    printf("Каналов: %d, частота АЦП: %.0f Гц, слов в секунду: %.0f, блок: %d отсчетов, "
+           "период блока: %ld мкс\n\n",
+           channel_count, adc_freq, rate, block_size, period_us);
+
+    queue = create_pdouble_queue(POOL_BLOCKS);
+    ring = create_spsc_ring(POOL_BLOCKS);
+    pool = create_block_pool(block_size, POOL_BLOCKS, SAMPLE_PATH_DOUBLE, HUGE_PAGES_OFF);
+
+    bench_ctx ctx;
+
+    // real rate of module
+    ctx.items_count = (int)(seconds * rate / block_size);
+    ctx.block_size = block_size;
+    ctx.period_us = period_us;
+    ctx.poll_sleep_us = READ_TIMEOUT / 2;
+
+    ctx.use_ring = 0;
+    run(&ctx, "pdouble_queue (real rate)");
+
+    ctx.use_ring = 1;
+    run(&ctx, "spsc_ring (real rate)");
+
+    // maximum throughput of queue itself
+    ctx.items_count = FAST_ITEMS;
+    ctx.period_us = 0;
+    ctx.poll_sleep_us = 0;
+
+    ctx.use_ring = 0;
+    run(&ctx, "pdouble_queue (no pause)");
+
+    ctx.use_ring = 1;
+    run(&ctx, "spsc_ring (no pause)");
+
+    destroy_pdouble_queue(&queue);
+    destroy_spsc_ring(&ring);
+    destroy_block_pool(&pool);
+
+    return 0;
+}
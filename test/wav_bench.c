@@ -0,0 +1,127 @@
+/*
+    This file part of e502monitor source code.
+    Licensed under GPLv3.
+
+    Benchmark of writing of output files: libsndfile
+    (sf_writef_float) and native writer (wav_writer.c).
+    Both writers get the same batches of frames. Speed is
+    printed in MB/s of written samples and CPU time per MB.
+
+    Build: make wav_bench
+    Usage: wav_bench [megabytes] [channels] [format] [batch_frames] [dir]
+           format - float32, double, pcm16 or pcm24
+
+    Author: Gapeev Maksim
+    Email: gm16493@gmail.com
+*/
+
+#include "../src/wav_writer.h"
+#include "../src/common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+static double now_sec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int parse_format(const char* name)
+{
+    if(strcmp(name, "double") == 0){ return SAMPLE_DOUBLE; }
+    if(strcmp(name, "pcm16") == 0) { return SAMPLE_PCM16; }
+    if(strcmp(name, "pcm24") == 0) { return SAMPLE_PCM24; }
+
+    return SAMPLE_FLOAT32;
+}
+
+static int sample_size(int format)
+{
+    switch(format)
+    {
+        case SAMPLE_DOUBLE: return 8;
+        case SAMPLE_PCM16:  return 2;
+        case SAMPLE_PCM24:  return 3;
+        default:            return 4;
+    }
+}
+
+static void run(const char* name,
+                const char* file_name,
+                int wav_writer,
+                const float* frames,
+                int channels,
+                int format,
+                int batch_frames,
+                long long batches)
+{
+    double wall = now_sec(CLOCK_MONOTONIC);
+    double cpu = now_sec(CLOCK_PROCESS_CPUTIME_ID);
+
+    audio_file* file = open_audio_file(file_name, channels, format, 2000000, wav_writer);
+
+    if(file == NULL)
+    {
+        printf("%-8s: не могу создать файл %s\n", name, file_name);
+        return;
+    }
+
+    for(long long b = 0; b < batches; b++)
+    {
+        write_audio_frames(file, frames, batch_frames);
+    }
+
+    close_audio_file(&file);
+
+    wall = now_sec(CLOCK_MONOTONIC) - wall;
+    cpu = now_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+    double mb = (double)batches * batch_frames * channels * sample_size(format) / (1024.0 * 1024.0);
+
+    printf("%-8s: %8.1f МБ за %6.3f с, %8.1f МБ/с, CPU %6.3f мс/МБ\n",
+           name, mb, wall, mb / wall, cpu * 1000.0 / mb);
+}
+
+int main(int argc, char** argv)
+{
+    int megabytes    = argc > 1 ? atoi(argv[1]) : 1024;
+    int channels     = argc > 2 ? atoi(argv[2]) : 4;
+    int format       = argc > 3 ? parse_format(argv[3]) : SAMPLE_FLOAT32;
+    int batch_frames = argc > 4 ? atoi(argv[4]) : 65536;
+    const char* dir  = argc > 5 ? argv[5] : ".";
+
+    float* frames = (float*)malloc(sizeof(float) * batch_frames * channels);
+
+    for(int i = 0; i < batch_frames * channels; i++)
+    {
+        frames[i] = 0.9f * sinf(i * 0.001f);
+    }
+
+    long long batches = (long long)megabytes * 1024 * 1024 /
+                        ((long long)batch_frames * channels * sample_size(format));
+
+    if(batches < 1){ batches = 1; }
+
+    char sndfile_name[500] = "";
+    char native_name[500] = "";
+
+    sprintf(sndfile_name, "%s/wav_bench_sndfile.wav", dir);
+    sprintf(native_name, "%s/wav_bench_native.wav", dir);
+
+    printf("Каналов: %d, кадров в записи: %d, записей: %lld\n", channels, batch_frames, batches);
+
+    run("sndfile", sndfile_name, WAV_WRITER_SNDFILE, frames, channels, format, batch_frames, batches);
+    run("native", native_name, WAV_WRITER_NATIVE, frames, channels, format, batch_frames, batches);
+
+    remove(sndfile_name);
+    remove(native_name);
+
+    free(frames);
+
+    return 0;
+}